@@ -9,6 +9,11 @@
 #include <mutex>
 #include <vector>
 
+struct sensorValue_t {
+    uint16_t serial;
+    float value;
+};
+
 class DatastoreClass {
 public:
     DatastoreClass()
@@ -20,13 +25,16 @@ public:
     void addSensor(uint16_t serial);
     bool validSensor(uint16_t serial);
     void addValue(uint16_t serial, float value);
+    void addValues(const std::vector<sensorValue_t>& values); // one poll, written as one batch
 
     static bool getTmTime(struct tm* info, time_t time, uint32_t ms);
 
     bool getTemperature(uint16_t serial, uint32_t& time, float& value);
-    bool getTemperatureFile(uint16_t serial, time_t start, uint32_t length, ResponseFiller& responseFiller);
-    bool getBackup(ResponseFiller& responseFiller);
+    bool getTemperatureFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller);
+    bool getTemperatureRange(RangeQuery& range, GraphDataFormat format, ResponseFiller& responseFiller);
+    bool getBackup(BackupRange& range, ResponseFiller& responseFiller);
     bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
+    bool mergeBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
     bool valueChanged(uint16_t serial, uint32_t seconds);
 
 private:
@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IDataStoreDevice.h"
+#include <vector>
+
+// Compressed backup: header (magic, version, 3 reserved bytes), records, trailer. Without the ecc of the RamBuffer,
+// time and value are stored as delta to the previous entry of the same sensor.
+//
+// record:  uint8_t slot of the sensor, BACKUPSTREAM_NEW_SENSOR: followed by uint16_t serial, it gets the next slot
+//          (the slots start again at 0 if all are used)
+//          varint zigzag(time delta), a new sensor starts with the time of the previous record
+//          varint value: bit 0 clear: zigzag(delta in 1/16) in the bits above, bit 0 set: followed by the float
+// trailer: BACKUPSTREAM_END, uint32_t entry count, uint16_t crc16 of all bytes before
+const char BACKUPSTREAM_MAGIC[4] = { 'T', 'L', 'B', 'Z' };
+const uint8_t BACKUPSTREAM_VERSION = 1;
+const uint8_t BACKUPSTREAM_HEADER_LENGTH = 8;
+const uint8_t BACKUPSTREAM_NEW_SENSOR = 0xFE;
+const uint8_t BACKUPSTREAM_END = 0xFF;
+const uint8_t BACKUPSTREAM_MAX_RECORD = 1 + 2 + 5 + 5 + 4;
+
+// Per sensor state, the same on both sides.
+class BackupStreamSensors {
+public:
+    typedef struct {
+        uint16_t serial;
+        uint32_t time;
+        float value;
+    } sensor_t;
+
+    int find(uint16_t serial) const;
+    uint8_t add(uint16_t serial, uint32_t time);
+    sensor_t& operator[](uint8_t slot) { return _sensors[slot]; }
+    size_t size() const { return _sensors.size(); }
+
+private:
+    std::vector<sensor_t> _sensors;
+};
+
+// Writes the stream into the buffers of a response, records are split across buffers like by GraphDataWriter.
+// A buffer of nullptr only counts the bytes, e.g. to skip to the offset of a Range request.
+class BackupStreamEncoder {
+public:
+    BackupStreamEncoder();
+
+    void begin(uint8_t* buffer, size_t maxLen); // writes the rest of the last record first
+    bool full() const { return _pos == _maxLen; }
+    void add(const dataEntry_t& entry);
+    void finish(); // trailer
+    size_t end() const { return _pos; }
+    size_t getPosition() const { return _offset + _pos; } // bytes of the stream until the end of this buffer
+
+private:
+    void write(const uint8_t* data, size_t len);
+
+    uint8_t* _buffer = nullptr;
+    size_t _maxLen = 0;
+    size_t _pos = 0;
+    size_t _offset = 0;
+    uint8_t _pending[BACKUPSTREAM_HEADER_LENGTH + BACKUPSTREAM_MAX_RECORD];
+    uint8_t _pendingLen = 0;
+
+    BackupStreamSensors _sensors;
+    uint32_t _lastTime = 0;
+    uint32_t _count = 0;
+    uint16_t _crc = 0;
+};
+
+// Decodes the stream in the chunks of an upload, a record can be split across chunks.
+class BackupStreamDecoder {
+public:
+    // false if the stream is corrupt
+    bool write(const uint8_t* data, size_t len, std::vector<dataEntry_t>& entries);
+    bool finished() const { return _finished; } // trailer found and valid
+    uint32_t getCount() const { return _count; }
+
+private:
+    size_t decode(std::vector<dataEntry_t>& entries); // bytes of the record in _carry, 0 if not complete
+
+    uint8_t _carry[BACKUPSTREAM_MAX_RECORD + 8];
+    uint8_t _carryLen = 0;
+    bool _header = false;
+    bool _finished = false;
+    bool _error = false;
+
+    BackupStreamSensors _sensors;
+    uint32_t _lastTime = 0;
+    uint32_t _count = 0;
+    uint16_t _crc = 0;
+};
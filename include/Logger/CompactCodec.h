@@ -0,0 +1,30 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IRamBuffer.h"
+
+const uint8_t COMPACT_NEW_SLOT = 0xFF; // followed by the 16 bit serial
+const uint8_t COMPACT_MAX_SLOTS = COMPACT_NEW_SLOT; // serials per block
+const uint8_t COMPACT_ENTRY_LENGTH = 5; // slot, value, time offset
+const float COMPACT_VALUE_SCALE = 16.0f; // resolution of the DS18B20 is 1/16 °C
+const int16_t COMPACT_VALUE_NAN = INT16_MIN;
+
+// Compact entries of one block: 1 byte slot of the serial, 2 bytes value as fixed point with 1/16 resolution and
+// 2 bytes time offset to the time of the first entry of the block. The first entry of a serial in the block is
+// preceded by COMPACT_NEW_SLOT and the serial.
+class CompactCodec {
+public:
+    void reset();
+
+    // Appends the entry to data with length used bytes. Returns false if the entry does not fit into maxLength
+    // or the time offset to baseTime does not fit into 16 bit.
+    bool encode(uint8_t* data, uint16_t maxLength, uint16_t& length, time_t baseTime, uint16_t serial, time_t time, float value);
+
+    // Reads the entry at pos and moves pos to the next entry. Returns false at the end of the data or on invalid data.
+    bool decode(const uint8_t* data, uint16_t length, uint16_t& pos, time_t baseTime, dataEntry_t& entry);
+
+private:
+    uint16_t _serials[COMPACT_MAX_SLOTS];
+    uint8_t _slotCount = 0;
+};
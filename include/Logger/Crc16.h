@@ -27,7 +27,7 @@ private:
 
 public:
     // The Calculation results differs from other 16 bit crc implementations. I dont want to have other results (historical reasons)
-    static unsigned int fastCrc(uint8_t data[], uint8_t start, uint16_t length, uint16_t polynomial, uint16_t xorIn, uint16_t xorOut, uint16_t msbMask, uint16_t mask)
+    static unsigned int fastCrc(uint8_t data[], uint8_t start, uint16_t length, uint16_t polynomial, uint16_t xorIn, uint16_t /* xorOut */, uint16_t msbMask, uint16_t /* mask */)
     {
         unsigned int crc = xorIn;
 
@@ -66,4 +66,32 @@ public:
         //  XModem parameters: poly=0x1021 init=0x0000 xorout=0x0000
         return fastCrc(data, 0, length, 0x1021, 0x0000, 0x0000, 0x8000, 0xffff);
     }
+
+    //-------------------------------------------------------
+    // XModem as Calc with a table, a lookup per byte instead of 8 bit steps. Continues crc, 0 to start.
+    //-------------------------------------------------------
+    static uint16_t Update(uint16_t crc, const uint8_t* data, size_t length)
+    {
+        static const Table table;
+        for (size_t i = 0; i < length; i++) {
+            crc = (crc << 8) ^ table.values[(crc >> 8) ^ data[i]];
+        }
+        return crc;
+    }
+
+private:
+    struct Table {
+        uint16_t values[256];
+
+        Table()
+        {
+            for (unsigned int i = 0; i < 256; i++) {
+                unsigned int crc = i << 8;
+                for (uint8_t bit = 0; bit < 8; bit++) {
+                    crc = crc & 0x8000 ? (crc << 1) ^ 0x1021 : crc << 1;
+                }
+                values[i] = crc;
+            }
+        }
+    };
 };
@@ -2,6 +2,7 @@
 #pragma once
 
 #include "IDataStoreDevice.h"
+#include <vector>
 
 class Datasensor {
 public:
@@ -11,7 +12,7 @@ public:
     {
         return _serial;
     }
-    void addValue(IDataStoreDevice* device, float value);
+    void addValue(std::vector<dataEntry_t>& batch, float value); // values to write are appended to batch
     bool getTemperature(uint32_t& time, float& value);
     bool valueChanged(uint32_t seconds);
 
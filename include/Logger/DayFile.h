@@ -0,0 +1,115 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+
+// Binary day file of a sensor on the SD card (/YYYY/MM/DD_SSSS.bin): header, then blocks of fixed size records
+// in time order. The header holds the first record of every hour, so a query seeks to the block of its start time.
+// A partially filled block is rewritten until it is full, the header when an hour gets its first record.
+//
+// record: uint32_t seconds since the start of the day, int16_t value in 1/100 (the resolution of the text file)
+const char DAYFILE_MAGIC[4] = { 'T', 'L', 'D', 'F' };
+const uint8_t DAYFILE_VERSION = 1;
+const uint8_t DAYFILE_HOURS = 25; // the day daylight saving time ends
+const uint8_t DAYFILE_BLOCK_RECORDS = 42;
+const uint32_t DAYFILE_NO_RECORD = 0xFFFFFFFF;
+const uint8_t DAYFILE_MAX_LINE = 24; // "1700000000;-327.68\n"
+
+#pragma pack(push, 2)
+typedef struct
+{
+    uint32_t offset; // seconds since start
+    int16_t value; // 1/100
+} dayFileRecord_t;
+
+typedef struct
+{
+    dayFileRecord_t records[DAYFILE_BLOCK_RECORDS];
+    uint16_t count; // valid records
+    uint16_t crc;
+} dayFileBlock_t;
+
+typedef struct
+{
+    char magic[4];
+    uint8_t version;
+    uint8_t recordsPerBlock;
+    uint16_t serial;
+    uint32_t start; // local midnight
+    uint32_t hours[DAYFILE_HOURS]; // first record of the hour, DAYFILE_NO_RECORD if none
+    uint16_t crc;
+} dayFileHeader_t;
+#pragma pack(pop)
+
+typedef std::function<bool(uint32_t index, dayFileBlock_t& block)> DayFileBlockReader; // false at the end of the file
+
+class DayFile {
+public:
+    static time_t dayStart(time_t time); // local midnight
+    static void initHeader(dayFileHeader_t& header, uint16_t serial, time_t time); // no records
+    // header of a file with an invalid header, e.g. a torn write: the hours from the records of the valid blocks
+    static void rebuildHeader(dayFileHeader_t& header, uint16_t serial, time_t time, uint32_t blocks, const DayFileBlockReader& reader);
+    static bool isHeader(const dayFileHeader_t& header);
+    static bool isBlock(const dayFileBlock_t& block);
+    static void seal(dayFileHeader_t& header);
+    static void seal(dayFileBlock_t& block);
+    static size_t blockOffset(uint32_t block) { return sizeof(dayFileHeader_t) + block * sizeof(dayFileBlock_t); }
+    static uint32_t findRecord(const dayFileHeader_t& header, time_t time); // first record of the hour of time or later
+    static size_t formatLine(const dayFileHeader_t& header, const dayFileRecord_t& record, char* line); // as the text file
+    static bool parseLine(const char* line, time_t& time, float& value);
+};
+
+// Builds header and blocks of a day file in RAM, the caller writes them (header if headerChanged, then the open block).
+class DayFileWriter {
+public:
+    void begin(uint16_t serial, time_t time); // new file for the day of time
+    // continues an existing file with blocks blocks, last: the last one if it is valid. The records added since
+    // begin are moved behind the records of the file.
+    bool resume(const dayFileHeader_t& header, uint32_t blocks, const dayFileBlock_t* last);
+    // as resume, for a file without a valid header of this day: the header is rebuilt from the blocks and rewritten
+    void rebuild(uint32_t blocks, const DayFileBlockReader& reader, const dayFileBlock_t* last);
+
+    bool full() const { return _block.count == DAYFILE_BLOCK_RECORDS; } // write the block before the next add
+    bool add(time_t time, float value); // false if time is not on this day or the file is full
+    void written(); // header and block are on the card, the next block starts if this one is full
+
+    bool headerChanged() const { return _headerChanged; }
+    const dayFileHeader_t& header();
+    const dayFileBlock_t& block();
+    size_t blockOffset() const { return DayFile::blockOffset(_blockIndex); }
+
+private:
+    dayFileHeader_t _header;
+    dayFileBlock_t _block;
+    uint32_t _blockIndex = 0;
+    bool _headerChanged = false;
+};
+
+// CSV lines "time;value\n" of a day file from the first record at or after start, like the text file. The lines are
+// split across the buffers of a response. Blocks with a wrong crc are skipped.
+class DayFileReader {
+public:
+    typedef DayFileBlockReader BlockReader;
+
+    DayFileReader(const dayFileHeader_t& header, time_t start, BlockReader reader);
+    size_t read(uint8_t* buffer, size_t maxLen); // 0 at the end
+    uint32_t getSkippedBlocks() const { return _skipped; }
+
+private:
+    bool nextRecord(dayFileRecord_t& record);
+
+    dayFileHeader_t _header;
+    time_t _start;
+    BlockReader _reader;
+    dayFileBlock_t _block;
+    uint32_t _blockIndex;
+    uint16_t _recordIndex;
+    bool _loaded = false;
+    bool _end = false;
+    bool _started = false; // first record at or after start found
+    uint32_t _skipped = 0;
+    char _line[DAYFILE_MAX_LINE];
+    uint8_t _lineLen = 0;
+    uint8_t _linePos = 0;
+};
@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IRamBuffer.h"
+
+const uint8_t GORILLA_SLOT_BITS = 5;
+const uint8_t GORILLA_NEW_SLOT = (1 << GORILLA_SLOT_BITS) - 1; // followed by the 16 bit serial
+const uint8_t GORILLA_MAX_SLOTS = GORILLA_NEW_SLOT; // serials per block
+
+// Compression of the entries of one block, see "Gorilla: A Fast, Scalable, In-Memory Time Series Database".
+// The entries of all serials are stored in one bit stream. Per serial (slot) the time is stored as delta of
+// delta and the value as xor to the previous value of this serial.
+// Encoding and decoding use the same state, so decoding a stream restores the state for further encoding.
+class GorillaCodec {
+public:
+    void reset();
+
+    // Appends the entry to the bit stream data with bits used bits. Returns false if the entry does not fit into maxBits.
+    bool encode(uint8_t* data, uint16_t maxBits, uint16_t& bits, uint16_t serial, time_t time, float value);
+
+    // Reads the entry at pos and moves pos to the next entry. Returns false at the end of the stream or on invalid data.
+    bool decode(const uint8_t* data, uint16_t bits, uint16_t& pos, dataEntry_t& entry);
+
+private:
+    typedef struct {
+        uint16_t serial;
+        uint32_t time; // modulo 2^32 like time_t on the device
+        uint32_t delta;
+        uint32_t value;
+        uint8_t leading; // xor window of the last value, leading > 31 -> no window
+        uint8_t trailing;
+    } slot_t;
+
+    void initSlot(slot_t& slot, uint16_t serial) const;
+
+    slot_t _slots[GORILLA_MAX_SLOTS];
+    uint8_t _slotCount = 0;
+
+    // new slots start with the last time and value of the block, they are typically close to it
+    uint32_t _lastTime = 0;
+    uint32_t _lastValue = 0;
+};
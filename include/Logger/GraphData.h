@@ -0,0 +1,91 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IDataStoreDevice.h"
+#include <vector>
+
+const char GRAPHDATA_MAGIC[2] = { 'T', 'G' };
+const uint8_t GRAPHDATA_VERSION = 1;
+const uint8_t GRAPHDATA_VERSION_TAGGED = 2; // several sensors, every record starts with the index of its sensor
+const uint8_t GRAPHDATA_MAX_VALUES = 3;
+const int16_t GRAPHDATA_NAN = INT16_MIN;
+
+#pragma pack(push, 1)
+// Binary format: header, then records of recordSize bytes:
+// [uint8_t sensor index (tagged only)], uint32_t time delta to the previous record (the first one to baseTime),
+// valueCount * int16_t value in 1/100 degree. Raw values have one value, tiles three (avg, min, max).
+typedef struct
+{
+    char magic[2];
+    uint8_t version;
+    uint8_t recordSize;
+    uint32_t baseTime;
+} graphDataHeader_t;
+#pragma pack(pop)
+
+// Writes the binary format into the buffers of a chunked response.
+// Records are split across buffers, so every buffer is filled completely until the end of the data.
+class GraphDataWriter {
+public:
+    GraphDataWriter(time_t baseTime, uint8_t valueCount, bool tagged = false);
+
+    void begin(uint8_t* buffer, size_t maxLen); // writes the rest of the last record first
+    bool full() const { return _pos == _maxLen; }
+    void add(time_t time, const float* values, uint8_t index = 0);
+    size_t end() const { return _pos; }
+
+private:
+    void write(const uint8_t* data, size_t len);
+
+    uint8_t* _buffer = nullptr;
+    size_t _maxLen = 0;
+    size_t _pos = 0;
+    uint8_t _valueCount;
+    bool _tagged;
+    uint32_t _lastTime;
+    uint8_t _pending[sizeof(graphDataHeader_t) + 5 + GRAPHDATA_MAX_VALUES * 2]; // not yet written bytes
+    uint8_t _pendingLen = 0;
+};
+
+// Min/max decimation for max_points: the range is split per sensor into maxPoints / 2 buckets of equal time,
+// from every bucket the minimum and the maximum value are kept in the order of their time. Streaming with
+// constant memory, peaks are kept. maxPoints = 0 passes all values.
+class GraphDecimator {
+public:
+    GraphDecimator(time_t start, uint32_t length, uint32_t maxPoints, size_t sensors);
+
+    void add(uint8_t index, time_t time, float value); // queues the points of a finished bucket
+    void finish(); // queues the open buckets
+    bool next(uint8_t& index, time_t& time, float& value);
+
+private:
+    typedef struct {
+        time_t time;
+        float value;
+    } point_t;
+
+    typedef struct {
+        uint32_t bucket;
+        uint32_t count;
+        point_t min;
+        point_t max;
+    } bucket_t;
+
+    typedef struct {
+        uint8_t index;
+        point_t point;
+    } output_t;
+
+    void flush(uint8_t index);
+
+    time_t _start;
+    uint32_t _width; // seconds per bucket, 0: no decimation
+    uint32_t _lastBucket = 0; // values at the end of the range
+    std::vector<bucket_t> _buckets; // open bucket per sensor
+    std::vector<output_t> _output;
+    size_t _outputPos = 0;
+};
+
+// Converts a text response ("time;value" lines) into the binary format, e.g. for the files of the SD card.
+ResponseFiller graphDataFromText(ResponseFiller textFiller, time_t start, uint32_t length, uint32_t maxPoints);
@@ -2,16 +2,74 @@
 #pragma once
 
 #include <Arduino.h>
+#include <vector>
+
+#pragma pack(push, 2)
+typedef struct
+{
+    uint16_t serial;
+    time_t time;
+    float value;
+} dataEntry_t; // 2 + 4 + 4 => 10 Bytes
+#pragma pack(pop)
 
 typedef std::function<size_t(uint8_t* buffer, size_t maxLen, size_t alreadySent)> ResponseFiller;
 
+enum class GraphDataFormat : uint8_t {
+    Text, // "time;value" lines, tiles "time;avg;min;max"
+    Binary, // see GraphData.h
+};
+
+// Part of a backup. The backup is a snapshot of the data, it can be read by its id until the data is overwritten.
+// So a download can be resumed or loaded in parallel parts.
+struct BackupRange {
+    String snapshot; // empty: new snapshot, afterwards its id
+    size_t offset = 0;
+    size_t length = SIZE_MAX; // afterwards the bytes of this part
+    size_t total = 0; // afterwards the size of the whole backup
+    bool compressed = false; // BackupStream format instead of the stored one
+    bool pending = false; // afterwards: the size is counted in the background, ask again later with the snapshot
+};
+
+// Values from <= time < to, in pages of at most limit values (0: all). The cursor of a page continues the query
+// where the last one ended, it is empty after the last page.
+struct RangeQuery {
+    std::vector<uint16_t> serials;
+    time_t from = 0;
+    time_t to = 0;
+    uint32_t limit = 0;
+    String cursor; // empty: first page, afterwards the cursor of the next page
+};
+
 ////////////////////////
 
 class IDataStoreDevice {
 public:
     virtual ~IDataStoreDevice() { }
     virtual void writeValue(uint16_t serial, time_t time, float value) = 0;
-    virtual bool getFile(uint16_t serial, time_t start, uint32_t length, ResponseFiller& responseFiller) = 0;
-    virtual bool getBackup(ResponseFiller& responseFiller) = 0;
+    // values of one poll, in order
+    virtual void writeBatch(const dataEntry_t* entries, size_t count)
+    {
+        for (size_t i = 0; i < count; i++) {
+            writeValue(entries[i].serial, entries[i].time, entries[i].value);
+        }
+    }
+    // Several serials are read in one pass, every line (record) starts with its serial (index in serials).
+    // maxPoints > 0: min/max per bucket, at most maxPoints values per sensor (see GraphDecimator)
+    virtual bool getFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller) = 0;
+    // raw values in pages, without pagination all values on the first page
+    virtual bool getRange(RangeQuery& range, GraphDataFormat format, ResponseFiller& responseFiller)
+    {
+        if (!range.cursor.isEmpty() || range.to <= range.from) {
+            return false;
+        }
+        return getFile(range.serials, range.from, range.to - range.from - 1, 0, format, responseFiller);
+    }
+    // min, max and average per period of at most resolution seconds, false if not available
+    virtual bool getTileFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, GraphDataFormat format, ResponseFiller& responseFiller) = 0;
+    // false if not supported or the snapshot is not available anymore
+    virtual bool getBackup(BackupRange& range, ResponseFiller& responseFiller) = 0;
     virtual bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final) = 0;
+    // Inserts a backup into the actual data while the logging continues, false if not supported
+    virtual bool mergeBackup(size_t, const uint8_t*, size_t, bool) { return false; }
 };
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IDataStoreDevice.h"
+#include <vector>
+
+enum class RamBufferFormat : uint8_t {
+    Entry, // every entry has its own ecc (RamBuffer)
+    Block, // entries are grouped in blocks with a shared ecc (RamBlockBuffer)
+    Compressed, // as Block, entries are compressed with GorillaCodec
+    Compact, // as Block, entries are stored with 5 bytes by CompactCodec
+};
+
+// Backups of block formats start with this magic, followed by the format
+const char RAMBUFFER_BACKUP_MAGIC[4] = { 'T', 'L', 'R', 'B' };
+
+enum class IntegrityState : uint8_t {
+    Verifying,
+    Verified,
+    Failed, // too many errors -> PowerOnInitialize
+};
+
+// Read position for getEntry. A new search starts with a default constructed cursor.
+struct RamBufferCursor {
+    void* pos = nullptr; // actual entry or block
+    size_t index = 0; // next entry in entries
+    std::vector<dataEntry_t> entries; // decoded entries of the actual block
+    uint32_t position = 0; // getSnapshotEntry: next entry (block) counted from the first one of the snapshot
+};
+
+// Part of the ring between two positions (entries or blocks counted since the start, they are not reused). Its
+// content does not change until it is overwritten, so it can be read in any order and by several requests.
+struct RamBufferSnapshot {
+    uint32_t first = 0;
+    uint32_t last = 0; // behind the last entry (block)
+};
+
+class IRamBuffer {
+public:
+    virtual ~IRamBuffer() { }
+    virtual void PowerOnInitialize() = 0;
+
+    // IntegrityCheck in steps: begin checks the header, afterwards the buffer can be used. continue verifies up to
+    // count entries (or blocks) from the newest to the oldest one. Until then getEntry returns only verified entries.
+    // Without decode the entries are not checked by their ecc, e.g. after a software reset.
+    virtual bool beginIntegrityCheck(bool decode) = 0;
+    virtual IntegrityState continueIntegrityCheck(size_t count) = 0;
+    virtual uint8_t getVerifyProgress() const = 0; // percent
+
+    bool IntegrityCheck()
+    {
+        if (!beginIntegrityCheck(true)) {
+            return false;
+        }
+        IntegrityState state;
+        while ((state = continueIntegrityCheck(SIZE_MAX)) == IntegrityState::Verifying) { }
+        return state == IntegrityState::Verified;
+    }
+
+    virtual void writeValue(uint16_t serial, time_t time, float value) = 0;
+    // same as writeValue for every entry, the header is committed and the cache flushed only once
+    virtual void writeBatch(const dataEntry_t* entries, size_t count) = 0;
+    // Inserts entries ordered by time between the stored ones, identical entries are skipped. If the result does not
+    // fit, the oldest entries are dropped. In steps like the IntegrityCheck: begin is false if the format does not
+    // support it, continue moves or links up to count entries and is true when finished, merged: inserted entries.
+    // Until then the buffer must not be read or written.
+    virtual bool beginMerge(const dataEntry_t* entries, size_t count) = 0;
+    virtual bool continueMerge(size_t count, size_t& merged) = 0;
+
+    bool mergeBatch(const dataEntry_t* entries, size_t count, size_t& merged)
+    {
+        merged = 0;
+        if (!beginMerge(entries, count)) {
+            return false;
+        }
+        while (!continueMerge(SIZE_MAX, merged)) { }
+        return true;
+    }
+    virtual bool getEntry(uint16_t serial, time_t time, RamBufferCursor& cursor, dataEntry_t& entry) = 0;
+    // entries of several sensors in one pass, ordered as stored
+    virtual bool getEntry(const std::vector<uint16_t>& serials, time_t time, RamBufferCursor& cursor, dataEntry_t& entry) = 0;
+    // from <= time < to, not limited to one day
+    virtual bool getEntry(const std::vector<uint16_t>& serials, time_t from, time_t to, RamBufferCursor& cursor, dataEntry_t& entry) = 0;
+    // Position of a cursor that stays valid until its entry (block) is overwritten, to continue a query in a later
+    // request without a new search. restoreCursor is false if it is not valid anymore, serials as before.
+    virtual void saveCursor(const RamBufferCursor& cursor, uint32_t& position, uint32_t& index) const = 0;
+    virtual bool restoreCursor(uint32_t position, uint32_t index, const std::vector<uint16_t>& serials, RamBufferCursor& cursor) const = 0;
+    // Backup of the actual data, the block formats seal the open block for it
+    virtual RamBufferSnapshot getSnapshot() = 0;
+    virtual bool isSnapshotValid(const RamBufferSnapshot& snapshot) const = 0; // false if overwritten meanwhile
+    virtual size_t getBackupSize(const RamBufferSnapshot& snapshot) const = 0;
+    virtual size_t readBackup(const RamBufferSnapshot& snapshot, size_t offset, uint8_t* buffer, size_t len) const = 0;
+    // all entries of the snapshot in the stored order, e.g. for the compressed backup (see BackupStream.h)
+    virtual bool getSnapshotEntry(const RamBufferSnapshot& snapshot, RamBufferCursor& cursor, dataEntry_t& entry) const = 0;
+
+    bool getBackup(ResponseFiller& responseFiller)
+    {
+        RamBufferSnapshot snapshot = getSnapshot();
+        responseFiller = [this, snapshot](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+            return isSnapshotValid(snapshot) ? readBackup(snapshot, alreadySent, buffer, maxLen) : 0;
+        };
+        return true;
+    }
+    virtual bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final) = 0;
+
+    virtual RamBufferFormat getFormat() const = 0;
+    virtual time_t getOldestTime() const = 0;
+    virtual size_t getTotalBytes() const = 0;
+    virtual size_t getUsedBytes() const = 0;
+    virtual size_t getBackupSize() const = 0;
+    virtual size_t getRebootCount() const = 0;
+    virtual size_t getErrorCount() const = 0;
+};
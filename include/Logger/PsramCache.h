@@ -0,0 +1,39 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+
+const uint8_t PSRAM_CACHE_RANGES = 6; // written ranges until the next flush
+const size_t PSRAM_CACHE_LINE = 32; // smallest cache line of ESP32 and ESP32-S3
+
+// The PSRAM keeps its content on a software reset, but the cache in front of it is lost.
+// Written ranges are collected and written back with flush:
+// ESP32-S3: only the cache lines of the ranges are written back (ROM function Cache_WriteBack_Addr).
+// ESP32: no write back by address -> read the cache area once per cache line, this evicts the dirty lines.
+// A full write back by any instance also writes back the ranges of the other instances.
+class PsramCache {
+public:
+    PsramCache(uint8_t* cache, size_t cacheSize);
+
+    void add(const void* addr, size_t size);
+    void flush();
+    void flushAll();
+
+    static uint64_t getBytesAdded() { return _bytesAdded; } // written bytes of all instances, e.g. for benchmarks
+
+private:
+    typedef struct {
+        uintptr_t begin;
+        uintptr_t end;
+    } range_t;
+
+    uint8_t* _cache;
+    size_t _cacheSize;
+    range_t _ranges[PSRAM_CACHE_RANGES];
+    uint8_t _rangeCount = 0;
+    bool _overflow = false; // more ranges than _ranges -> flushAll
+    uint32_t _flushAllCount = 0; // _flushAllTotal when the last range was added
+
+    static uint32_t _flushAllTotal;
+    static uint64_t _bytesAdded;
+};
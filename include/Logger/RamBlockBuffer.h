@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "CompactCodec.h"
+#include "GorillaCodec.h"
+#include "IRamBuffer.h"
+#include "PsramCache.h"
+#include "RamBuffer.h"
+#include "RS-FEC.h"
+
+#pragma pack(push, 2)
+const uint8_t BLOCK_ECC_LENGTH = 16; // Max corrected bytes per code word ECC_LENGTH/2
+const uint8_t BLOCK_WORD_LENGTH = 255 - BLOCK_ECC_LENGTH; // RS code word is limited to 255 bytes
+const uint8_t BLOCK_WORDS = 8; // code words per block
+const size_t BLOCK_DATA_LENGTH = BLOCK_WORDS * BLOCK_WORD_LENGTH;
+
+typedef struct
+{
+    time_t time; // time of the first entry, 0 for an invalid block
+    uint16_t count; // entries in block
+    uint16_t length; // used payload bytes, bits for the compressed format
+} dataBlockInfo_t;
+
+const size_t BLOCK_PAYLOAD_LENGTH = BLOCK_DATA_LENGTH - sizeof(dataBlockInfo_t);
+
+typedef struct
+{
+    dataBlockInfo_t info;
+    uint8_t payload[BLOCK_PAYLOAD_LENGTH];
+    // Sealed block: ecc of the code words. Open block (header->last): CRC16 of the code words in the first two bytes.
+    char ecc[BLOCK_WORDS][BLOCK_ECC_LENGTH];
+} dataBlock_t; // 8 * (239 + 16) => 2040 Bytes
+
+///
+const uint8_t BLOCK_HEADER_ECC_LENGTH = 96;  // Max corrected bytes ECC_LENGTH/2
+typedef struct
+{
+    uint32_t format; // RamBufferFormat
+    dataBlock_t* start;
+    dataBlock_t* first;
+    dataBlock_t* last; // open block
+    dataBlock_t* end;
+    size_t rebootCount;
+    size_t errorCount;
+    char ecc[BLOCK_HEADER_ECC_LENGTH];
+} dataBlockHeader_t;
+
+const int BLOCK_HEADER_MSG_LENGTH = sizeof(dataBlockHeader_t) - BLOCK_HEADER_ECC_LENGTH;
+
+typedef struct
+{
+    char magic[sizeof(RAMBUFFER_BACKUP_MAGIC)];
+    uint16_t format; // RamBufferFormat
+    uint16_t blockSize;
+} dataBlockBackup_t; // followed by the blocks from first to last
+
+#pragma pack(pop)
+
+class RamBlockBuffer : public IRamBuffer {
+public:
+    RamBlockBuffer(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize, RamBufferFormat format);
+    void PowerOnInitialize();
+    bool beginIntegrityCheck(bool decode);
+    IntegrityState continueIntegrityCheck(size_t count);
+    uint8_t getVerifyProgress() const;
+    void flushCache();
+
+    void writeValue(uint16_t serial, time_t time, float value);
+    void writeBatch(const dataEntry_t* entries, size_t count);
+    bool beginMerge(const dataEntry_t* entries, size_t count);
+    bool continueMerge(size_t count, size_t& merged);
+    bool getEntry(uint16_t serial, time_t time, RamBufferCursor& cursor, dataEntry_t& entry);
+    bool getEntry(const std::vector<uint16_t>& serials, time_t time, RamBufferCursor& cursor, dataEntry_t& entry);
+    bool getEntry(const std::vector<uint16_t>& serials, time_t from, time_t to, RamBufferCursor& cursor, dataEntry_t& entry);
+    void saveCursor(const RamBufferCursor& cursor, uint32_t& position, uint32_t& index) const;
+    bool restoreCursor(uint32_t position, uint32_t index, const std::vector<uint16_t>& serials, RamBufferCursor& cursor) const;
+    RamBufferSnapshot getSnapshot();
+    bool isSnapshotValid(const RamBufferSnapshot& snapshot) const;
+    size_t getBackupSize(const RamBufferSnapshot& snapshot) const;
+    size_t readBackup(const RamBufferSnapshot& snapshot, size_t offset, uint8_t* buffer, size_t len) const;
+    bool getSnapshotEntry(const RamBufferSnapshot& snapshot, RamBufferCursor& cursor, dataEntry_t& entry) const;
+    bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
+
+    RamBufferFormat getFormat() const { return _format; }
+    time_t getOldestTime() const;
+
+    size_t getTotalBlocks() const { return _blocks; }
+    size_t getUsedBlocks() const { return (_header->last >= _header->first ? _header->last - _header->first : _blocks - (_header->first - _header->last)) + 1; }
+    size_t getTotalBytes() const { return getTotalBlocks() * sizeof(dataBlock_t); }
+    size_t getUsedBytes() const { return getUsedBlocks() * sizeof(dataBlock_t); }
+    size_t getBackupSize() const { return sizeof(dataBlockBackup_t) + getUsedBytes(); }
+    size_t getRebootCount() const { return _header->rebootCount; }
+    size_t getErrorCount() const { return _header->errorCount; }
+
+private:
+    int toIndex(const dataBlock_t* block) const { return block - _header->start; }
+    uint32_t getLastPosition() const { return _wraps * _blocks + toIndex(_header->last); } // see RamBufferSnapshot
+    dataBlock_t* nextBlock(dataBlock_t* block) const { return ++block == _header->end ? _header->start : block; }
+    dataBlock_t* findStart(time_t time);
+    bool isBlock(const dataBlock_t* block) const;
+    bool isUsed(const dataBlock_t* block) const;
+    IntegrityState finishIntegrityCheck();
+
+    void initBlock(dataBlock_t* block);
+    void sealBlock(dataBlock_t* block);
+    bool decodeBlock(dataBlock_t* block);
+    void updateCrc(dataBlock_t* block, size_t word);
+    bool checkCrc(dataBlock_t* block);
+
+    void append(uint16_t serial, time_t time, float value);
+    void startBlock(); // seal the open block and open the next one
+    bool appendEntry(dataBlock_t* block, uint16_t serial, time_t time, float value);
+    bool getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, RamBufferCursor& cursor, dataEntry_t& entry);
+    void loadEntries(const dataBlock_t* block, const uint16_t* serials, size_t count, RamBufferCursor& cursor) const;
+    void restoreEntries(const uint8_t* data, size_t len);
+    void restoreCodec();
+
+private:
+    dataBlockHeader_t* _header;
+    size_t _blocks;
+    RamBufferFormat _format;
+    PsramCache _cache;
+    GorillaCodec _codec; // encoder state of the open block (compressed format)
+    CompactCodec _compactCodec; // encoder state of the open block (compact format)
+    uint32_t _wraps = 1; // last went from end to start, position of the blocks for snapshots
+
+    dataBlock_t* _verifyBlock = nullptr; // oldest verified block, nullptr if IntegrityCheck is not running
+    bool _verifyDecode;
+    size_t _verifyCount;
+    size_t _verifyTotal;
+    size_t _oldErrors;
+    size_t _newErrors;
+
+    enum class RestoreMode {
+        None,
+        Blocks, // backup of the same block format -> copy blocks
+        Entries, // backup of RamBuffer -> decode entries and append
+    } _restoreMode = RestoreMode::None;
+    size_t _restoreOffset = 0;
+    uint8_t _restoreCarry[sizeof(dataEntryFEC_t)]; // incomplete entry of the last chunk
+    size_t _restoreCarryLen = 0;
+
+    RS::ReedSolomon<sizeof(dataEntry_t), DATAENTRY_ECC_LENGTH> _rsData;
+    RS::ReedSolomon<BLOCK_WORD_LENGTH, BLOCK_ECC_LENGTH> _rsBlock;
+    RS::ReedSolomon<BLOCK_HEADER_MSG_LENGTH, BLOCK_HEADER_ECC_LENGTH> _rsHeader;
+};
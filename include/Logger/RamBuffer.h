@@ -2,19 +2,14 @@
 #pragma once
 
 #include <Arduino.h>
-#include "IDataStoreDevice.h"
+#include "IRamBuffer.h"
+#include "PsramCache.h"
 #include "RS-FEC.h"
+#include <map>
 
 #pragma pack(push, 2)
 const uint8_t DATAENTRY_ECC_LENGTH = 6;  // Max corrected bytes ECC_LENGTH/2
 
-typedef struct
-{
-    uint16_t serial;
-    time_t time;
-    float value;
-} dataEntry_t; // 2 + 4 + 4 => 10 Bytes
-
 typedef struct
 {
     dataEntry_t entry;
@@ -25,34 +20,66 @@ static inline dataEntry_t* toEntry(dataEntryFEC_t* p) { return &p->entry; }
 static inline dataEntryFEC_t* toFec(dataEntry_t* p) { return reinterpret_cast<dataEntryFEC_t*>(p); }
 
 ///
-const uint8_t HEADER_ECC_LENGTH = 96;  // Max corrected bytes ECC_LENGTH/2
+// first and last after a write, stored alternately in two slots and protected by a CRC16
 typedef struct
 {
-    dataEntryFEC_t* start;
+    uint32_t seq;
     dataEntryFEC_t* first;
     dataEntryFEC_t* last;
+    uint16_t crc;
+} dataEntryCommit_t;
+
+const uint8_t HEADER_ECC_LENGTH = 96;  // Max corrected bytes ECC_LENGTH/2
+const uint32_t HEADER_COMMIT_INTERVAL = 256; // commits until the header ecc is updated
+typedef struct
+{
+    dataEntryFEC_t* start;
     dataEntryFEC_t* end;
     size_t rebootCount;
     size_t errorCount;
+    dataEntryCommit_t base; // first and last at the last update of ecc
     char ecc[HEADER_ECC_LENGTH];
+    dataEntryFEC_t* first; // actual values, restored from the newest valid commit
+    dataEntryFEC_t* last;
+    dataEntryCommit_t commit[2];
 } dataEntryHeader_t;
 
-const int HEADER_MSG_LENGTH = sizeof(dataEntryHeader_t) - HEADER_ECC_LENGTH;
+const int HEADER_MSG_LENGTH = offsetof(dataEntryHeader_t, ecc);
+
+// Per entry link to the next entry with the same serial (distance in entries).
+// The links are only a search hint, they are rebuilt by IntegrityCheck and not part of a backup.
+typedef uint16_t dataEntryLink_t;
+const dataEntryLink_t LINK_NONE = 0; // no successor known -> linear search
+const dataEntryLink_t LINK_FAR = 0xFFFF; // successor is further away -> jump and continue linear search
 
 #pragma pack(pop)
 
-class RamBuffer {
+class RamBuffer : public IRamBuffer {
 public:
     RamBuffer(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize);
     void PowerOnInitialize();
-    bool IntegrityCheck();
+    bool beginIntegrityCheck(bool decode);
+    IntegrityState continueIntegrityCheck(size_t count);
+    uint8_t getVerifyProgress() const;
     void flushCache();
 
     void writeValue(uint16_t serial, time_t time, float value);
-    bool getEntry(uint16_t serial, time_t time, dataEntry_t*& act);
-    bool getBackup(ResponseFiller& responseFiller);
+    void writeBatch(const dataEntry_t* entries, size_t count);
+    bool beginMerge(const dataEntry_t* entries, size_t count);
+    bool continueMerge(size_t count, size_t& merged);
+    bool getEntry(uint16_t serial, time_t time, RamBufferCursor& cursor, dataEntry_t& entry);
+    bool getEntry(const std::vector<uint16_t>& serials, time_t time, RamBufferCursor& cursor, dataEntry_t& entry);
+    bool getEntry(const std::vector<uint16_t>& serials, time_t from, time_t to, RamBufferCursor& cursor, dataEntry_t& entry);
+    void saveCursor(const RamBufferCursor& cursor, uint32_t& position, uint32_t& index) const;
+    bool restoreCursor(uint32_t position, uint32_t index, const std::vector<uint16_t>& serials, RamBufferCursor& cursor) const;
+    RamBufferSnapshot getSnapshot();
+    bool isSnapshotValid(const RamBufferSnapshot& snapshot) const;
+    size_t getBackupSize(const RamBufferSnapshot& snapshot) const;
+    size_t readBackup(const RamBufferSnapshot& snapshot, size_t offset, uint8_t* buffer, size_t len) const;
+    bool getSnapshotEntry(const RamBufferSnapshot& snapshot, RamBufferCursor& cursor, dataEntry_t& entry) const;
     bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
 
+    RamBufferFormat getFormat() const { return RamBufferFormat::Entry; }
     time_t getOldestTime() const {
         if (_header->first == _header->last) return 0;
         return _header->first->entry.time;
@@ -60,19 +87,62 @@ public:
 
     size_t getTotalElements() const { return _elements-1; }
     size_t getUsedElements() const { return _header->last >= _header->first ? _header->last - _header->first : getTotalElements(); }
+    size_t getTotalBytes() const { return getTotalElements() * sizeof(dataEntryFEC_t); }
+    size_t getUsedBytes() const { return getUsedElements() * sizeof(dataEntryFEC_t); }
+    size_t getBackupSize() const { return getUsedBytes(); }
     size_t getRebootCount() const { return _header->rebootCount; }
     size_t getErrorCount() const { return _header->errorCount; }
 
 private:
     int toIndex(const dataEntryFEC_t* entry) const { return entry - _header->start; }
+    uint32_t getLastPosition() const { return _wraps * _elements + toIndex(_header->last); } // see RamBufferSnapshot
+    void append(const dataEntry_t& entry);
+    bool getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, RamBufferCursor& cursor, dataEntry_t& entry);
+    bool getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, dataEntry_t*& act);
     dataEntry_t* findStart(time_t time);
+    bool isStored(const dataEntry_t& entry);
+    dataEntryFEC_t* at(size_t pos) const { return _header->start + (toIndex(_header->first) + pos) % _elements; } // counted from first
+    dataEntry_t* nextEntry(uint16_t serial, dataEntry_t* act);
+
+    bool isEntry(const dataEntryFEC_t* entry) const;
+    bool isUsed(const dataEntryFEC_t* entry) const;
+    void linkEntry(dataEntryFEC_t* entry);
+    void linkEntryBackward(dataEntryFEC_t* entry);
+    void rebuildLinks();
+    void finishMergeMove();
+
+    IntegrityState finishIntegrityCheck();
+    void commitHeader(bool full);
+    bool isValidCommit(const dataEntryCommit_t& commit) const;
 
 private:
     dataEntryHeader_t* _header;
     size_t _elements;
-    uint8_t* _cache;
-    size_t _cacheSize;
+    dataEntryLink_t* _links;
+    std::map<uint16_t, dataEntryFEC_t*> _tail; // newest entry per serial
+    std::map<uint16_t, dataEntryFEC_t*> _head; // oldest verified entry per serial while IntegrityCheck is running
+    PsramCache _cache;
     uint8_t* _restorePos = nullptr;
+    uint32_t _seq = 0; // last commit
+    uint32_t _wraps = 1; // last went from end to start, position of the entries for snapshots
+
+    // merge in steps: the stored entries newer than the batch are moved, then the links from _mergeTouched are rebuilt
+    enum class MergeState { Idle, Move, Scan, Link };
+    MergeState _mergeState = MergeState::Idle;
+    std::vector<dataEntry_t> _mergeBatch; // sorted, without the stored entries
+    size_t _mergeUsed, _mergeLiveFirst, _mergeBatchFirst; // entries before, dropped ones
+    size_t _mergeWrite, _mergeRead, _mergeNext; // positions of the Move, counted from the old first
+    size_t _mergeTouched; // oldest moved or inserted entry, counted from the new first
+    size_t _mergePos; // position of the Scan (backward) and the Link (forward)
+    size_t _mergeFound; // serials of _tail found by the Scan
+    std::map<uint16_t, dataEntryFEC_t*> _mergeTail; // newest entry per serial before _mergeTouched
+
+    dataEntryFEC_t* _verifyPos = nullptr; // oldest verified entry, nullptr if IntegrityCheck is not running
+    bool _verifyDecode;
+    size_t _verifyCount;
+    size_t _verifyTotal;
+    size_t _oldErrors;
+    size_t _newErrors;
     RS::ReedSolomon<sizeof(dataEntry_t), DATAENTRY_ECC_LENGTH> _rsData;
     RS::ReedSolomon<HEADER_MSG_LENGTH, HEADER_ECC_LENGTH> _rsHeader;
 };
@@ -1,45 +1,133 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "BackupStream.h"
 #include "IDataStoreDevice.h"
-#include "RamBuffer.h"
+#include "IRamBuffer.h"
+#include "SeqLock.h"
+#include "StagingRing.h"
+#include "TileIndex.h"
 #include <Arduino.h>
+#include <TaskSchedulerDeclarations.h>
+#include <atomic>
 #include <memory>
 #include <mutex>
 #include <vector>
 #include "TimeoutMutex.h"
 
+// Storage format of the RamDrive, e.g. build_flags = -DRAMDRIVE_FORMAT=Block
+#ifndef RAMDRIVE_FORMAT
+#define RAMDRIVE_FORMAT Entry
+#endif
+
+// IntegrityCheck in the background: entries (or blocks) per step
+const size_t RAMDRIVE_VERIFY_ENTRIES = 256;
+const size_t RAMDRIVE_VERIFY_BLOCKS = 4;
+
+// part of the PSRAM used by the TileIndex
+const size_t RAMDRIVE_TILE_DIVISOR = 16;
+
+// reads of a chunk without lock before the writers are locked out
+const uint8_t RAMDRIVE_READ_RETRIES = 3;
+
+// values waiting while the RamDrive is busy (backup, restore), written in batches of RAMDRIVE_DRAIN_BATCH per lock
+const size_t RAMDRIVE_STAGING_SIZE = 256;
+const size_t RAMDRIVE_DRAIN_BATCH = 32;
+
+// entries of a merged backup inserted together, every batch moves the newer entries
+const size_t RAMDRIVE_MERGE_BATCH = 4096;
+// entries moved or linked per lock while a batch is merged, far below the maxUse of RAMDRIVE_MERGE_LOCK_MS
+const size_t RAMDRIVE_MERGE_STEP = 8192;
+const int RAMDRIVE_MERGE_LOCK_MS = 1000;
+// entries per step while the TileIndex is rebuilt after a merge
+const size_t RAMDRIVE_REBUILD_ENTRIES = 1024;
+// bytes of a compressed backup per step while its size is counted
+const size_t RAMDRIVE_COUNT_BYTES = 32 * 1024;
+
+struct RamDriveQuery;
+struct RamDriveBackupStream;
+
 class RamDriveClass : public IDataStoreDevice {
 public:
-    RamDriveClass();
+    RamDriveClass(RamBufferFormat format);
     ~RamDriveClass()
     {
         delete _ramBuffer;
+        delete _tiles;
     }
 
+    void init(Scheduler& scheduler);
+
     static void AllocateRamDrive();
     static void FreeRamDrive();
+#ifdef RAMDRIVE_BENCHMARK
+    static void Benchmark(); // write throughput on a scratch buffer, build_flags = -DRAMDRIVE_BENCHMARK
+#endif
 
-    size_t getSizeBytes() const { return _ramBuffer->getTotalElements() * sizeof(dataEntryFEC_t); }
-    size_t getUsedBytes() const { return _ramBuffer->getUsedElements() * sizeof(dataEntryFEC_t); }
+    size_t getSizeBytes() const { return _ramBuffer->getTotalBytes(); }
+    size_t getUsedBytes() const { return _ramBuffer->getUsedBytes(); }
+    size_t getBackupSize() const { return _ramBuffer->getBackupSize(); }
     time_t getOldestTime() const { return _ramBuffer->getOldestTime(); }
     size_t getRebootCount() const { return _ramBuffer->getRebootCount(); }
     size_t getErrorCount() const { return _ramBuffer->getErrorCount(); }
+    uint8_t getVerifyProgress() const { return _ramBuffer->getVerifyProgress(); }
+    uint32_t getReadRetries() const { return _readRetries; }
+    uint32_t getStagedCount() const { return _staging.getStaged(); }
+    uint32_t getDrainedCount() const { return _staging.getDrained(); }
+    uint32_t getOverflowCount() const { return _staging.getOverflow(); }
 
     // IDataStoreDevice
     virtual void writeValue(uint16_t serial, time_t time, float value);
-    virtual bool getFile(uint16_t serial, time_t start, uint32_t length, ResponseFiller& responseFiller);
-    virtual bool getBackup(ResponseFiller& responseFiller);
+    virtual void writeBatch(const dataEntry_t* entries, size_t count);
+    virtual bool getFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller);
+    virtual bool getTileFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, GraphDataFormat format, ResponseFiller& responseFiller);
+    virtual bool getRange(RangeQuery& range, GraphDataFormat format, ResponseFiller& responseFiller);
+    virtual bool getBackup(BackupRange& range, ResponseFiller& responseFiller);
     virtual bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
+    virtual bool mergeBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final);
 
 private:
+    bool getQueryFile(std::shared_ptr<RamDriveQuery> query, ResponseFiller& responseFiller);
+    bool getBackupStream(BackupRange& range, const RamBufferSnapshot& snapshot, ResponseFiller& responseFiller);
+    bool restoreBackupStream(const uint8_t* data, size_t len, bool final);
+    bool isSnapshotValid(const RamBufferSnapshot& snapshot);
+    void countBackupStream();
+    bool mergeEntries();
+    void rebuildTiles();
+    void resetTiles(); // writers locked: the tiles are empty and rebuilt from the entries
+    bool readConsistent(const std::function<void()>& read);
     void startupCheck();
+    void verify();
+    void drain();
     time_t getStartOfDay(const tm& timeinfo);
 
 private:
-    RamBuffer* _ramBuffer;
-    TimeoutMutex _mutexRamDrive;
+    IRamBuffer* _ramBuffer;
+    TileIndex* _tiles;
+    Task _verifyTask;
+    Task _drainTask;
+    Task _rebuildTask;
+    Task _countTask;
+    size_t _verifyCount;
+    TimeoutMutex _mutexRamDrive; // writers
+    SeqLock _seqLock; // readers, see readConsistent
+    std::atomic<uint32_t> _readRetries { 0 }; // incremented by concurrent readers
+    uint32_t _backupEpoch; // part of the snapshot ids, they are not valid after a reboot
+    std::mutex _mutexBackupStream;
+    String _backupStreamId; // snapshot of the compressed backup with the size _backupStreamTotal
+    size_t _backupStreamTotal = 0;
+    std::shared_ptr<RamDriveBackupStream> _backupStreamCheckpoint; // state at the end of the last part
+    String _backupStreamCountId; // snapshot counted by _countTask
+    std::shared_ptr<RamDriveBackupStream> _backupStreamCounter;
+    std::unique_ptr<BackupStreamDecoder> _restoreDecoder; // restore of a compressed backup
+    std::unique_ptr<BackupStreamDecoder> _mergeDecoder; // merge of a compressed backup
+    std::vector<dataEntry_t> _mergeEntries; // decoded, not yet merged
+    size_t _mergeCount = 0;
+    volatile bool _tilesRebuild = false; // drain does not write the tiles, _rebuildTask catches up
+    uint32_t _rebuildPosition = 0; // next entry for the tiles, snapshot position
+    StagingRing<dataEntry_t, RAMDRIVE_STAGING_SIZE> _staging; // writeValue -> RamBuffer, no lock
     volatile bool _restoreInProgress = false;
+    volatile bool _mergeInProgress = false; // the entries are moved between the locks, no reads and writes
 
 private:
     static uint8_t* _ramDrive;
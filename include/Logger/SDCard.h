@@ -1,14 +1,36 @@
 // SPDX-License-Identifier: GPL-2.0-or-later
 #pragma once
 
+#include "DayFile.h"
 #include "FS.h"
 #include "IDataStoreDevice.h"
 #include "SD.h"
 #include "SPI.h"
+#include "TextFileIndex.h"
 #include <Arduino.h>
 #include <ESPAsyncWebServer.h>
 #include <TaskSchedulerDeclarations.h>
+#include <map>
 #include <mutex>
+#include <set>
+
+// Write-behind: the lines of a sensor are buffered and appended to its day file when the buffer is full, after
+// SDCARD_FLUSH_INTERVAL, on a new day, before the file is read and before a restart. A reset loses the buffered lines.
+const size_t SDCARD_LINE_BUFFER = 256; // bytes per sensor, ~18 lines
+const uint32_t SDCARD_FLUSH_INTERVAL = 10 * 60 * 1000; // ms
+const uint8_t SDCARD_OPEN_FILES = 8; // day files kept open for appending, the least recently written one is closed
+
+// Format of the day files, e.g. build_flags = -DSDCARD_FORMAT=Binary
+// Text: /YYYY/MM/DD_SSSS.txt, lines "time;value". Binary: /YYYY/MM/DD_SSSS.bin, see DayFile.h. The text files of
+// the days before the switch are still read, test/tools/dayfile_convert converts between both.
+#ifndef SDCARD_FORMAT
+#define SDCARD_FORMAT Text
+#endif
+
+enum class SDCardFormat : uint8_t {
+    Text,
+    Binary,
+};
 
 enum SDCardState_t {
     Init,
@@ -20,29 +42,56 @@ enum SDCardState_t {
 
 class SDCardClass : public IDataStoreDevice {
 public:
-    SDCardClass();
+    SDCardClass(SDCardFormat format);
     void init(Scheduler& scheduler);
 
     // IDataStoreDevice
     virtual void writeValue(uint16_t serial, time_t time, float value);
-    virtual bool getFile(uint16_t serial, time_t time_start, uint32_t length, ResponseFiller& responseFiller);
-    virtual bool getBackup(ResponseFiller& responseFiller) { return false; }
+    virtual void writeBatch(const dataEntry_t* entries, size_t count);
+    virtual bool getFile(const std::vector<uint16_t>& serials, time_t time_start, uint32_t length, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller);
+    virtual bool getTileFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, GraphDataFormat format, ResponseFiller& responseFiller) { return false; }
+    virtual bool getBackup(BackupRange& range, ResponseFiller& responseFiller) { return false; }
     virtual bool restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final) { return false; }
 
+    void flush(); // all buffered lines, e.g. before a restart
+
 private:
+    struct Sensor {
+        File file; // day file, open for appending
+        int day = -1; // of the buffered lines and the file
+        time_t time = 0; // of the first buffered line, selects the file
+        uint32_t since = 0; // millis of the first buffered line
+        uint32_t lastWrite = 0; // millis, the least recently written file is closed first
+        size_t length = 0; // buffered bytes (Text) or records (Binary)
+        char lines[SDCARD_LINE_BUFFER];
+        DayFileWriter writer; // Binary: header and open block of the day file
+        bool resumed = false; // Binary: an existing file of the day was checked
+    };
+
     void loop();
 
     void scanCard();
-    bool openFile(uint16_t serial, const time_t time, const char* mode, File& file);
+    void getFileName(uint16_t serial, const time_t time, SDCardFormat format, char* buffer, size_t len); // creates the directory
+    bool openFile(uint16_t serial, const time_t time, const char* mode, File& file, SDCardFormat format);
+    bool openDayFile(uint16_t serial, Sensor& sensor, bool& created);
+    void bufferLine(uint16_t serial, time_t time, float value);
+    void flushSensor(uint16_t serial, Sensor& sensor);
+    void flushBlock(uint16_t serial, Sensor& sensor);
+    void closeLeastRecent();
 
 private:
     Task _loopTask;
 
     uint32_t _lastActionTime;
     SDCardState_t _state;
+    SDCardFormat _format;
 
     File _file; // used by getFile
     bool _fileOpen;
+    TextFileIndex _textIndex; // start positions in the text files for getFile
     std::mutex _mutex;
+
+    std::map<uint16_t, Sensor> _sensors;
+    std::set<int> _directories; // months with an existing directory
 };
 extern SDCardClass* pSDCard;
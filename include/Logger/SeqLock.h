@@ -0,0 +1,38 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <atomic>
+#include <stdint.h>
+
+// Sequence lock for one writer and any number of readers. The writer makes the sequence odd while it changes the
+// data. A reader remembers the sequence before it reads and repeats the read if the sequence was odd or has changed
+// afterwards. Readers never block the writer, the writer never waits for readers.
+// Several writers have to be serialized by the caller (e.g. a mutex).
+class SeqLock {
+public:
+    void writeBegin()
+    {
+        _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+    }
+
+    void writeEnd()
+    {
+        _seq.store(_seq.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // odd: a write is running, the read is invalid anyway
+    uint32_t readBegin() const
+    {
+        return _seq.load(std::memory_order_acquire);
+    }
+
+    bool readValid(uint32_t seq) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (seq & 1) == 0 && _seq.load(std::memory_order_relaxed) == seq;
+    }
+
+private:
+    std::atomic<uint32_t> _seq { 0 };
+};
@@ -0,0 +1,80 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded lock-free ring for any number of producers and one consumer. Every slot has a sequence number that tells
+// whether it is free for the producer of round n or filled for the consumer of round n. Producers never wait: if
+// the ring is full the value is rejected and counted as overflow.
+// The consumer has to be serialized by the caller (e.g. a mutex).
+template <typename T, size_t Size>
+class StagingRing {
+    static_assert(Size >= 2 && (Size & (Size - 1)) == 0, "Size must be a power of 2");
+
+public:
+    StagingRing()
+    {
+        for (size_t i = 0; i < Size; i++) {
+            _slots[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    bool push(const T& value)
+    {
+        uint32_t pos = _head.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = _slots[pos & (Size - 1)];
+            uint32_t seq = slot.seq.load(std::memory_order_acquire);
+            int32_t diff = static_cast<int32_t>(seq - pos);
+            if (diff == 0) {
+                if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    slot.value = value;
+                    slot.seq.store(pos + 1, std::memory_order_release);
+                    _staged.fetch_add(1, std::memory_order_relaxed);
+                    return true;
+                }
+            } else if (diff < 0) {
+                _overflow.fetch_add(1, std::memory_order_relaxed);
+                return false; // full
+            } else {
+                pos = _head.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // consumer only
+    bool pop(T& value)
+    {
+        Slot& slot = _slots[_tail & (Size - 1)];
+        if (slot.seq.load(std::memory_order_acquire) != _tail + 1) {
+            return false; // empty or the producer is not finished yet
+        }
+        value = slot.value;
+        slot.seq.store(_tail + Size, std::memory_order_release);
+        _tail++;
+        _drained.fetch_add(1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool empty() const { return _slots[_tail & (Size - 1)].seq.load(std::memory_order_acquire) != _tail + 1; }
+
+    uint32_t getStaged() const { return _staged.load(std::memory_order_relaxed); }
+    uint32_t getDrained() const { return _drained.load(std::memory_order_relaxed); }
+    uint32_t getOverflow() const { return _overflow.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq;
+        T value;
+    };
+
+    Slot _slots[Size];
+    std::atomic<uint32_t> _head { 0 };
+    uint32_t _tail = 0;
+
+    std::atomic<uint32_t> _staged { 0 };
+    std::atomic<uint32_t> _drained { 0 };
+    std::atomic<uint32_t> _overflow { 0 };
+};
@@ -0,0 +1,46 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include <functional>
+#include <vector>
+
+const uint8_t TEXTFILE_INDEX_FILES = 8; // day files with cached positions, the least recently used one is dropped
+const uint8_t TEXTFILE_INDEX_POINTS = 32; // positions per file
+const uint16_t TEXTFILE_SCAN = 512; // the search stops at this distance, the rest is read sequentially
+const uint8_t TEXTFILE_PROBE = 48; // bytes read per step: the end of a line and the time of the next one
+
+// Start position in a text day file ("time;value" lines in time order) for a query from start: binary search on the
+// file, each step seeks into the middle, skips to the next line and reads its time. The line starts and times found
+// are kept per file as a sparse index, the next search of the same file starts between the nearest of them. The
+// files are only appended, so the positions stay valid.
+class TextFileIndex {
+public:
+    typedef std::function<size_t(size_t position, uint8_t* buffer, size_t len)> Reader; // bytes read
+
+    // a line start before the first line with a time >= start, at most TEXTFILE_SCAN bytes (and a line) before it
+    size_t find(uint32_t file, size_t size, time_t start, Reader reader);
+    void clear() { _files.clear(); }
+    uint32_t getProbes() const { return _probes; } // reads of all searches
+
+    static uint32_t fileKey(uint16_t serial, time_t time); // serial and local day
+
+private:
+    struct Point {
+        uint32_t position; // line start
+        time_t time;
+    };
+    struct Entry {
+        uint32_t key;
+        uint32_t used;
+        std::vector<Point> points; // ordered by position
+    };
+
+    Entry& getEntry(uint32_t key);
+    bool probe(size_t position, size_t size, Reader& reader, Point& point); // first line start at or after position
+    void addPoint(Entry& entry, const Point& point);
+
+    std::vector<Entry> _files;
+    uint32_t _used = 0;
+    uint32_t _probes = 0;
+};
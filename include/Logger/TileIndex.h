@@ -0,0 +1,99 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+#include "IDataStoreDevice.h"
+#include "PsramCache.h"
+#include <vector>
+
+const uint8_t TILE_LEVELS = 3;
+const uint32_t TILE_PERIODS[TILE_LEVELS] = { 60, 15 * 60, 60 * 60 }; // seconds
+// Tiles per sensor and level: a day of 1 minute tiles, for the coarser levels the shortest query that selects them
+// with the 720 points of a chart. A smaller TileIndex shares its tiles out in the same ratio.
+const uint16_t TILE_CAPACITY[TILE_LEVELS] = { 24 * 60, 8 * 24 * 4, 31 * 24 };
+const uint8_t TILE_SENSORS = 32; // slots at most, a sensor without a slot has no tiles
+const uint8_t TILE_SENSORS_MIN = 8; // slots at least, with less tiles if they do not fit
+const uint32_t TILE_SLOT_IDLE = 24 * 60 * 60; // the slot of a sensor without values for this time can be reused
+
+#pragma pack(push, 2)
+typedef struct
+{
+    uint16_t serial;
+    uint16_t count;
+    time_t time; // start of the period
+    float min;
+    float max;
+    float sum;
+    uint16_t crc;
+} dataTile_t;
+
+typedef struct
+{
+    uint32_t offset; // first tile of the level
+    uint32_t capacity;
+    uint32_t first; // oldest tile, index relative to offset
+    uint32_t count;
+} dataTileRing_t;
+
+typedef struct
+{
+    uint16_t used;
+    uint16_t serial;
+    dataTileRing_t rings[TILE_LEVELS];
+    uint16_t crc;
+} dataTileSlot_t;
+
+typedef struct
+{
+    uint32_t size; // layout check
+    uint16_t slotCount;
+    uint16_t crc;
+    dataTileSlot_t slots[TILE_SENSORS];
+} dataTileHeader_t;
+#pragma pack(pop)
+
+// Read position for getTile. A new search starts with a default constructed cursor.
+struct TileCursor {
+    bool started = false;
+    std::vector<uint32_t> index; // next tile per serial, relative to first
+    std::vector<uint32_t> first; // ring.first per serial at the last call, to follow overwritten tiles
+};
+
+// Min, max and sum of the values per sensor and period (1 minute, 15 minutes, 1 hour) in PSRAM next to the RamBuffer.
+// Every sensor has a slot with a ring of tiles per level, ordered by time. A tile is created by the first value of
+// the sensor in its period and updated by the following ones.
+class TileIndex {
+public:
+    TileIndex(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize);
+    void PowerOnInitialize();
+    bool IntegrityCheck();
+    void flushCache();
+
+    void writeValue(uint16_t serial, time_t time, float value);
+
+    // Coarsest level with a period up to resolution, -1 if the raw values are needed.
+    int getLevel(uint32_t resolution) const;
+
+    // False if tiles of the serials from start on were dropped (or not written for lack of a slot).
+    bool covers(const std::vector<uint16_t>& serials, time_t start, int level) const;
+
+    // Next valid tile of the serials in start .. start + length, ordered by time.
+    bool getTile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, int level, TileCursor& cursor, dataTile_t& tile) const;
+
+private:
+    dataTile_t* getTile(const dataTileRing_t& ring, uint32_t index) const { return &_tiles[ring.offset + (ring.first + index) % ring.capacity]; }
+    dataTileSlot_t* findSlot(uint16_t serial) const;
+    dataTileSlot_t* assignSlot(uint16_t serial, time_t time);
+    uint32_t findStart(const dataTileRing_t& ring, time_t time) const;
+    void updateCrc(dataTile_t* tile);
+    bool checkCrc(const dataTile_t* tile) const;
+    void commitSlot(dataTileSlot_t* slot);
+    void commitHeader();
+
+private:
+    dataTileHeader_t* _header;
+    dataTile_t* _tiles;
+    size_t _size;
+    uint32_t _tileCount;
+    PsramCache _cache;
+};
@@ -6,6 +6,12 @@
 #include <ESPAsyncWebServer.h>
 #include <TaskSchedulerDeclarations.h>
 #include "Logger/TimeoutMutex.h"
+#include <atomic>
+
+// graph requests running at the same time (the RamDrive readers do not lock)
+const uint8_t GRAPHDATA_MAX_READERS = 3;
+// backup downloads running at the same time, e.g. parts of one backup
+const uint8_t BACKUP_MAX_READERS = 4;
 
 class WebApiWsLiveClass {
 public:
@@ -30,7 +36,9 @@ private:
     unsigned long _lastPublishStats = 0;
     std::mutex _mutexStatus;
 
-    TimeoutMutex _mutexFileReponse;
+    TimeoutMutex _mutexFileReponse; // backup upload
+    std::atomic<uint8_t> _graphReaders { 0 };
+    std::atomic<uint8_t> _backupReaders { 0 };
 
     Task _wsCleanupTask;
     void wsCleanupTaskCb();
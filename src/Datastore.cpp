@@ -3,8 +3,6 @@
  * Copyright (C) 2023 Thomas Basler and others
  */
 #include "Datastore.h"
-#include "Configuration.h"
-#include "Logger/DS18B20List.h"
 #include "MessageOutput.h"
 
 DatastoreClass Datastore;
@@ -40,17 +38,30 @@ bool DatastoreClass::validSensor(uint16_t serial)
 }
 
 void DatastoreClass::addValue(uint16_t serial, float value)
+{
+    addValues({ { serial, value } });
+}
+
+void DatastoreClass::addValues(const std::vector<sensorValue_t>& values)
 {
     std::lock_guard<std::mutex> lock(_mutexSensorList);
     if (_device == nullptr)
         return;
 
-    for (const auto& entry : _list) {
-        if (entry->Serial() != serial) {
-            continue;
+    std::vector<dataEntry_t> batch;
+    batch.reserve(values.size() * 2); // last and new value if changed
+    for (const auto& value : values) {
+        for (const auto& entry : _list) {
+            if (entry->Serial() != value.serial) {
+                continue;
+            }
+            entry->addValue(batch, value.value);
+            break;
         }
-        entry->addValue(_device, value);
-        break;
+    }
+
+    if (!batch.empty()) {
+        _device->writeBatch(batch.data(), batch.size());
     }
 }
 
@@ -92,20 +103,32 @@ bool DatastoreClass::getTmTime(struct tm* info, time_t time, uint32_t ms)
     return false;
 }
 
-bool DatastoreClass::getTemperatureFile(uint16_t serial, time_t start, uint32_t length, ResponseFiller& responseFiller)
+bool DatastoreClass::getTemperatureFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller)
 {
     if (_device == nullptr)
         return false;
 
-    return _device->getFile(serial, start, length, responseFiller);
+    // min, max and average if a coarser resolution is enough
+    if (resolution > 0 && _device->getTileFile(serials, start, length, resolution, format, responseFiller))
+        return true;
+
+    return _device->getFile(serials, start, length, maxPoints, format, responseFiller);
 }
 
-bool DatastoreClass::getBackup(ResponseFiller& responseFiller)
+bool DatastoreClass::getTemperatureRange(RangeQuery& range, GraphDataFormat format, ResponseFiller& responseFiller)
 {
     if (_device == nullptr)
         return false;
 
-    return _device->getBackup(responseFiller);
+    return _device->getRange(range, format, responseFiller);
+}
+
+bool DatastoreClass::getBackup(BackupRange& range, ResponseFiller& responseFiller)
+{
+    if (_device == nullptr)
+        return false;
+
+    return _device->getBackup(range, responseFiller);
 }
 
 bool DatastoreClass::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
@@ -115,3 +138,11 @@ bool DatastoreClass::restoreBackup(size_t alreadyWritten, const uint8_t* data, s
 
     return _device->restoreBackup(alreadyWritten, data, len, final);
 }
+
+bool DatastoreClass::mergeBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
+{
+    if (_device == nullptr)
+        return false;
+
+    return _device->mergeBackup(alreadyWritten, data, len, final);
+}
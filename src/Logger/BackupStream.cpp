@@ -0,0 +1,285 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/BackupStream.h"
+#include "Logger/Crc16.h"
+
+static uint32_t zigzag(int32_t value)
+{
+    return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+}
+
+static int32_t unzigzag(uint32_t value)
+{
+    return static_cast<int32_t>((value >> 1) ^ (0u - (value & 1)));
+}
+
+static uint8_t putVarint(uint8_t* data, uint32_t value)
+{
+    uint8_t len = 0;
+    while (value >= 0x80) {
+        data[len++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    data[len++] = value;
+    return len;
+}
+
+// 1: value read, 0: more bytes needed, -1: too long
+static int getVarint(const uint8_t* data, size_t len, size_t& pos, uint32_t& value)
+{
+    value = 0;
+    for (uint8_t i = 0; i < 5; i++) {
+        if (pos + i >= len) {
+            return 0;
+        }
+        value |= static_cast<uint32_t>(data[pos + i] & 0x7F) << (7 * i);
+        if ((data[pos + i] & 0x80) == 0) {
+            pos += i + 1;
+            return 1;
+        }
+    }
+    return -1;
+}
+
+static float applyDelta(float last, int32_t delta)
+{
+    return last + static_cast<float>(delta) / 16.0f;
+}
+
+// true if the value is reproduced exactly by the delta in 1/16
+static bool getDelta(float last, float value, int32_t& delta)
+{
+    float scaled = (value - last) * 16.0f;
+    if (!(fabsf(scaled) < (1 << 24))) {
+        return false; // also NaN
+    }
+    delta = lroundf(scaled);
+    float decoded = applyDelta(last, delta);
+    return memcmp(&decoded, &value, sizeof(value)) == 0;
+}
+
+int BackupStreamSensors::find(uint16_t serial) const
+{
+    for (size_t i = 0; i < _sensors.size(); i++) {
+        if (_sensors[i].serial == serial) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+uint8_t BackupStreamSensors::add(uint16_t serial, uint32_t time)
+{
+    if (_sensors.size() == BACKUPSTREAM_NEW_SENSOR) {
+        _sensors.clear();
+    }
+    _sensors.push_back({ serial, time, 0.0f });
+    return _sensors.size() - 1;
+}
+
+BackupStreamEncoder::BackupStreamEncoder()
+{
+    // the header is sent with the first buffer
+    memset(_pending, 0, BACKUPSTREAM_HEADER_LENGTH);
+    memcpy(_pending, BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC));
+    _pending[sizeof(BACKUPSTREAM_MAGIC)] = BACKUPSTREAM_VERSION;
+    _pendingLen = BACKUPSTREAM_HEADER_LENGTH;
+    _crc = Crc16::Update(0, _pending, _pendingLen);
+}
+
+void BackupStreamEncoder::begin(uint8_t* buffer, size_t maxLen)
+{
+    _buffer = buffer;
+    _maxLen = maxLen;
+    _offset += _pos;
+    _pos = 0;
+
+    uint8_t pending[sizeof(_pending)];
+    uint8_t len = _pendingLen;
+    memcpy(pending, _pending, len);
+    _pendingLen = 0;
+    write(pending, len);
+}
+
+void BackupStreamEncoder::add(const dataEntry_t& entry)
+{
+    uint8_t record[BACKUPSTREAM_MAX_RECORD];
+    uint8_t len = 0;
+    uint16_t serial = entry.serial;
+    uint32_t time = entry.time;
+    float value = entry.value;
+
+    int slot = _sensors.find(serial);
+    if (slot < 0) {
+        record[len++] = BACKUPSTREAM_NEW_SENSOR;
+        record[len++] = serial & 0xFF;
+        record[len++] = serial >> 8;
+        slot = _sensors.add(serial, _lastTime);
+    } else {
+        record[len++] = slot;
+    }
+
+    BackupStreamSensors::sensor_t& sensor = _sensors[slot];
+    len += putVarint(&record[len], zigzag(static_cast<int32_t>(time - sensor.time)));
+
+    int32_t delta;
+    if (getDelta(sensor.value, value, delta)) {
+        len += putVarint(&record[len], zigzag(delta) << 1);
+    } else {
+        record[len++] = 1;
+        memcpy(&record[len], &value, sizeof(value));
+        len += sizeof(value);
+    }
+
+    sensor.time = time;
+    sensor.value = value;
+    _lastTime = time;
+    _count++;
+    _crc = Crc16::Update(_crc, record, len);
+    write(record, len);
+}
+
+void BackupStreamEncoder::finish()
+{
+    uint8_t trailer[7];
+    trailer[0] = BACKUPSTREAM_END;
+    for (uint8_t i = 0; i < 4; i++) {
+        trailer[1 + i] = _count >> (8 * i);
+    }
+    _crc = Crc16::Update(_crc, trailer, 5);
+    trailer[5] = _crc & 0xFF;
+    trailer[6] = _crc >> 8;
+    write(trailer, sizeof(trailer));
+}
+
+void BackupStreamEncoder::write(const uint8_t* data, size_t len)
+{
+    size_t count = min(len, _maxLen - _pos);
+    if (_buffer != nullptr) {
+        memcpy(&_buffer[_pos], data, count);
+    }
+    _pos += count;
+
+    // rest for the next buffer
+    memcpy(&_pending[_pendingLen], &data[count], len - count);
+    _pendingLen += len - count;
+}
+
+bool BackupStreamDecoder::write(const uint8_t* data, size_t len, std::vector<dataEntry_t>& entries)
+{
+    while (!_error) {
+        size_t count = min(len, sizeof(_carry) - _carryLen);
+        memcpy(&_carry[_carryLen], data, count);
+        _carryLen += count;
+        data += count;
+        len -= count;
+
+        size_t used;
+        while (_carryLen > 0 && (used = decode(entries)) > 0) {
+            memmove(_carry, &_carry[used], _carryLen - used);
+            _carryLen -= used;
+        }
+        if (_carryLen == sizeof(_carry)) {
+            _error = true; // no record is that long
+        }
+        if (len == 0) {
+            break;
+        }
+    }
+    return !_error;
+}
+
+size_t BackupStreamDecoder::decode(std::vector<dataEntry_t>& entries)
+{
+    if (_error || _finished) {
+        _error = true; // data behind the trailer
+        return 0;
+    }
+
+    if (!_header) {
+        if (_carryLen < BACKUPSTREAM_HEADER_LENGTH) {
+            return 0;
+        }
+        if (memcmp(_carry, BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC)) != 0 || _carry[sizeof(BACKUPSTREAM_MAGIC)] != BACKUPSTREAM_VERSION) {
+            _error = true;
+            return 0;
+        }
+        _crc = Crc16::Update(0, _carry, BACKUPSTREAM_HEADER_LENGTH);
+        _header = true;
+        return BACKUPSTREAM_HEADER_LENGTH;
+    }
+
+    uint8_t slot = _carry[0];
+    if (slot == BACKUPSTREAM_END) {
+        if (_carryLen < 7) {
+            return 0;
+        }
+        uint32_t count = 0;
+        for (uint8_t i = 0; i < 4; i++) {
+            count |= static_cast<uint32_t>(_carry[1 + i]) << (8 * i);
+        }
+        _crc = Crc16::Update(_crc, _carry, 5);
+        if (count != _count || (_carry[5] | (_carry[6] << 8)) != _crc) {
+            _error = true;
+            return 0;
+        }
+        _finished = true;
+        return 7;
+    }
+
+    // the whole record is parsed before the state is changed
+    size_t pos = 1;
+    uint16_t serial = 0;
+    if (slot == BACKUPSTREAM_NEW_SENSOR) {
+        if (_carryLen < 3) {
+            return 0;
+        }
+        serial = _carry[1] | (_carry[2] << 8);
+        pos = 3;
+    } else if (slot >= _sensors.size()) {
+        _error = true;
+        return 0;
+    }
+
+    uint32_t timeDelta, valueDelta;
+    int rc = getVarint(_carry, _carryLen, pos, timeDelta);
+    if (rc > 0) {
+        rc = getVarint(_carry, _carryLen, pos, valueDelta);
+    }
+    if (rc <= 0) {
+        _error = rc < 0;
+        return 0;
+    }
+    float value = 0.0f;
+    if (valueDelta & 1) {
+        if (valueDelta != 1) {
+            _error = true;
+            return 0;
+        }
+        if (_carryLen < pos + sizeof(value)) {
+            return 0;
+        }
+        memcpy(&value, &_carry[pos], sizeof(value));
+        pos += sizeof(value);
+    }
+
+    if (slot == BACKUPSTREAM_NEW_SENSOR) {
+        slot = _sensors.add(serial, _lastTime);
+    }
+    BackupStreamSensors::sensor_t& sensor = _sensors[slot];
+    sensor.time += unzigzag(timeDelta);
+    sensor.value = (valueDelta & 1) ? value : applyDelta(sensor.value, unzigzag(valueDelta >> 1));
+    _lastTime = sensor.time;
+
+    dataEntry_t entry;
+    entry.serial = sensor.serial;
+    entry.time = sensor.time;
+    entry.value = sensor.value;
+    entries.push_back(entry);
+    _count++;
+    _crc = Crc16::Update(_crc, _carry, pos);
+    return pos;
+}
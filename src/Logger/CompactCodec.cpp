@@ -0,0 +1,75 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/CompactCodec.h"
+
+void CompactCodec::reset()
+{
+    _slotCount = 0;
+}
+
+bool CompactCodec::encode(uint8_t* data, uint16_t maxLength, uint16_t& length, time_t baseTime, uint16_t serial, time_t time, float value)
+{
+    if (time < baseTime || time - baseTime > UINT16_MAX) {
+        return false;
+    }
+
+    uint8_t slot = 0;
+    while (slot < _slotCount && _serials[slot] != serial) {
+        slot++;
+    }
+    bool newSlot = slot == _slotCount;
+    if (newSlot && _slotCount >= COMPACT_MAX_SLOTS) {
+        return false;
+    }
+    if (length + COMPACT_ENTRY_LENGTH + (newSlot ? 3 : 0) > maxLength) {
+        return false;
+    }
+
+    int16_t fixed = COMPACT_VALUE_NAN;
+    if (!isnan(value)) {
+        fixed = constrain(roundf(value * COMPACT_VALUE_SCALE), -INT16_MAX, INT16_MAX);
+    }
+    uint16_t offset = time - baseTime;
+
+    uint8_t* p = &data[length];
+    if (newSlot) {
+        _serials[_slotCount++] = serial;
+        *p++ = COMPACT_NEW_SLOT;
+        *p++ = serial & 0xFF;
+        *p++ = serial >> 8;
+    }
+    *p++ = slot;
+    *p++ = fixed & 0xFF;
+    *p++ = static_cast<uint16_t>(fixed) >> 8;
+    *p++ = offset & 0xFF;
+    *p++ = offset >> 8;
+    length = p - data;
+    return true;
+}
+
+bool CompactCodec::decode(const uint8_t* data, uint16_t length, uint16_t& pos, time_t baseTime, dataEntry_t& entry)
+{
+    if (pos < length && data[pos] == COMPACT_NEW_SLOT) {
+        if (_slotCount >= COMPACT_MAX_SLOTS || pos + 3 > length) {
+            return false;
+        }
+        _serials[_slotCount++] = data[pos + 1] | (data[pos + 2] << 8);
+        pos += 3;
+    }
+    if (pos + COMPACT_ENTRY_LENGTH > length || data[pos] >= _slotCount) {
+        return false;
+    }
+
+    const uint8_t* p = &data[pos];
+    int16_t fixed = static_cast<int16_t>(p[1] | (p[2] << 8));
+    uint16_t offset = p[3] | (p[4] << 8);
+
+    entry.serial = _serials[p[0]];
+    entry.time = baseTime + offset;
+    entry.value = fixed == COMPACT_VALUE_NAN ? NAN : fixed / COMPACT_VALUE_SCALE;
+    pos += COMPACT_ENTRY_LENGTH;
+    return true;
+}
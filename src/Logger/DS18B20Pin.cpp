@@ -95,6 +95,8 @@ void DS18B20Pin::readTemperature()
     _sensors.requestTemperatures();
     auto config = Configuration.get();
 
+    std::vector<sensorValue_t> values;
+    values.reserve(_list.size());
     for (const auto& entry : _list) {
         float temp;
         if (config.DS18B20.Fahrenheit) {
@@ -111,6 +113,7 @@ void DS18B20Pin::readTemperature()
             }
         }
         MessageOutput.printf("Temp %04X: %.2f\r\n", entry->_serial, temp);
-        Datastore.addValue(entry->_serial, temp);
+        values.push_back({ entry->_serial, temp });
     }
+    Datastore.addValues(values);
 }
@@ -19,7 +19,7 @@ Datasensor::Datasensor(uint16_t serial, uint8_t mDay)
 {
 }
 
-void Datasensor::addValue(IDataStoreDevice* device, float value)
+void Datasensor::addValue(std::vector<dataEntry_t>& batch, float value)
 {
     struct tm timeinfo;
     _timeValid = getLocalTime(&timeinfo, 5);
@@ -42,9 +42,9 @@ void Datasensor::addValue(IDataStoreDevice* device, float value)
     if (_actValueChanged || bNewDay) {
         // write last value
         if (_firstTime != _lastTime && _lastTime > 0) {
-            device->writeValue(_serial, _lastTime, _value);
+            batch.push_back({ _serial, _lastTime, _value });
         }
-        device->writeValue(_serial, now, value);
+        batch.push_back({ _serial, now, value });
 
         _firstTime = now;
         _oldLastTime = _lastTime;
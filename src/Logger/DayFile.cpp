@@ -0,0 +1,260 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/DayFile.h"
+#include "Logger/Crc16.h"
+
+time_t DayFile::dayStart(time_t time)
+{
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    timeinfo.tm_hour = 0;
+    timeinfo.tm_min = 0;
+    timeinfo.tm_sec = 0;
+    timeinfo.tm_isdst = -1;
+    return mktime(&timeinfo);
+}
+
+void DayFile::initHeader(dayFileHeader_t& header, uint16_t serial, time_t time)
+{
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, DAYFILE_MAGIC, sizeof(header.magic));
+    header.version = DAYFILE_VERSION;
+    header.recordsPerBlock = DAYFILE_BLOCK_RECORDS;
+    header.serial = serial;
+    header.start = dayStart(time);
+    memset(header.hours, 0xFF, sizeof(header.hours));
+}
+
+void DayFile::rebuildHeader(dayFileHeader_t& header, uint16_t serial, time_t time, uint32_t blocks, const DayFileBlockReader& reader)
+{
+    initHeader(header, serial, time);
+    dayFileBlock_t block;
+    for (uint32_t index = 0; index < blocks && reader(index, block); index++) {
+        if (!isBlock(block)) {
+            continue;
+        }
+        for (uint16_t i = 0; i < block.count; i++) {
+            uint32_t hour = block.records[i].offset / 3600;
+            if (hour < DAYFILE_HOURS && header.hours[hour] == DAYFILE_NO_RECORD) {
+                header.hours[hour] = index * DAYFILE_BLOCK_RECORDS + i;
+            }
+        }
+    }
+    seal(header);
+}
+
+bool DayFile::isHeader(const dayFileHeader_t& header)
+{
+    dayFileHeader_t copy = header;
+    return memcmp(copy.magic, DAYFILE_MAGIC, sizeof(copy.magic)) == 0
+        && copy.version == DAYFILE_VERSION
+        && copy.recordsPerBlock == DAYFILE_BLOCK_RECORDS
+        && copy.crc == static_cast<uint16_t>(Crc16::Calc(reinterpret_cast<uint8_t*>(&copy), offsetof(dayFileHeader_t, crc)));
+}
+
+bool DayFile::isBlock(const dayFileBlock_t& block)
+{
+    dayFileBlock_t copy = block;
+    return copy.count <= DAYFILE_BLOCK_RECORDS
+        && copy.crc == static_cast<uint16_t>(Crc16::Calc(reinterpret_cast<uint8_t*>(&copy), offsetof(dayFileBlock_t, crc)));
+}
+
+void DayFile::seal(dayFileHeader_t& header)
+{
+    header.crc = Crc16::Calc(reinterpret_cast<uint8_t*>(&header), offsetof(dayFileHeader_t, crc));
+}
+
+void DayFile::seal(dayFileBlock_t& block)
+{
+    block.crc = Crc16::Calc(reinterpret_cast<uint8_t*>(&block), offsetof(dayFileBlock_t, crc));
+}
+
+uint32_t DayFile::findRecord(const dayFileHeader_t& header, time_t time)
+{
+    uint32_t hour = time > static_cast<time_t>(header.start) ? (time - header.start) / 3600 : 0;
+    for (; hour < DAYFILE_HOURS; hour++) {
+        if (header.hours[hour] != DAYFILE_NO_RECORD) {
+            return header.hours[hour];
+        }
+    }
+    return DAYFILE_NO_RECORD;
+}
+
+size_t DayFile::formatLine(const dayFileHeader_t& header, const dayFileRecord_t& record, char* line)
+{
+    int len = snprintf(line, DAYFILE_MAX_LINE, "%ld;%.2f\n", static_cast<long>(header.start + record.offset), record.value / 100.0);
+    return len > 0 ? min(static_cast<size_t>(len), static_cast<size_t>(DAYFILE_MAX_LINE - 1)) : 0;
+}
+
+bool DayFile::parseLine(const char* line, time_t& time, float& value)
+{
+    char* end;
+    long t = strtol(line, &end, 10);
+    if (end == line || *end != ';') {
+        return false;
+    }
+    const char* start = end + 1;
+    value = strtof(start, &end);
+    if (end == start) {
+        return false;
+    }
+    time = t;
+    return true;
+}
+
+////////////////////////
+
+void DayFileWriter::begin(uint16_t serial, time_t time)
+{
+    DayFile::initHeader(_header, serial, time);
+    memset(&_block, 0, sizeof(_block));
+    _blockIndex = 0;
+    _headerChanged = true;
+}
+
+bool DayFileWriter::resume(const dayFileHeader_t& header, uint32_t blocks, const dayFileBlock_t* last)
+{
+    if (!DayFile::isHeader(header) || header.serial != _header.serial || header.start != _header.start) {
+        return false;
+    }
+
+    // nothing written since begin: all records are in the first block
+    dayFileBlock_t pending = _block;
+    _header = header;
+    if (last != nullptr && blocks > 0 && last->count + pending.count <= DAYFILE_BLOCK_RECORDS) {
+        _block = *last;
+        _blockIndex = blocks - 1;
+    } else {
+        memset(&_block, 0, sizeof(_block));
+        _blockIndex = blocks;
+    }
+    _headerChanged = false;
+
+    for (uint16_t i = 0; i < pending.count; i++) {
+        add(_header.start + pending.records[i].offset, pending.records[i].value / 100.0f);
+    }
+    return true;
+}
+
+void DayFileWriter::rebuild(uint32_t blocks, const DayFileBlockReader& reader, const dayFileBlock_t* last)
+{
+    dayFileHeader_t header;
+    DayFile::rebuildHeader(header, _header.serial, _header.start, blocks, reader);
+    resume(header, blocks, last);
+    _headerChanged = true;
+}
+
+bool DayFileWriter::add(time_t time, float value)
+{
+    if (full() || isnan(value) || time < static_cast<time_t>(_header.start) || time - _header.start >= DAYFILE_HOURS * 3600) {
+        return false;
+    }
+    uint32_t record = _blockIndex * DAYFILE_BLOCK_RECORDS + _block.count;
+    if (record >= DAYFILE_NO_RECORD) {
+        return false;
+    }
+
+    dayFileRecord_t& entry = _block.records[_block.count++];
+    entry.offset = time - _header.start;
+    entry.value = constrain(lroundf(value * 100), -32768L, 32767L);
+
+    uint32_t hour = entry.offset / 3600;
+    if (_header.hours[hour] == DAYFILE_NO_RECORD) {
+        _header.hours[hour] = record;
+        _headerChanged = true;
+    }
+    return true;
+}
+
+void DayFileWriter::written()
+{
+    _headerChanged = false;
+    if (full()) {
+        memset(&_block, 0, sizeof(_block));
+        _blockIndex++;
+    }
+}
+
+const dayFileHeader_t& DayFileWriter::header()
+{
+    DayFile::seal(_header);
+    return _header;
+}
+
+const dayFileBlock_t& DayFileWriter::block()
+{
+    DayFile::seal(_block);
+    return _block;
+}
+
+////////////////////////
+
+DayFileReader::DayFileReader(const dayFileHeader_t& header, time_t start, BlockReader reader)
+    : _header(header)
+    , _start(start)
+    , _reader(reader)
+{
+    uint32_t record = DayFile::findRecord(header, start);
+    _end = record == DAYFILE_NO_RECORD;
+    _blockIndex = _end ? 0 : record / DAYFILE_BLOCK_RECORDS;
+    _recordIndex = _end ? 0 : record % DAYFILE_BLOCK_RECORDS;
+}
+
+bool DayFileReader::nextRecord(dayFileRecord_t& record)
+{
+    while (!_end) {
+        if (!_loaded) {
+            if (!_reader(_blockIndex, _block)) {
+                _end = true;
+                break;
+            }
+            if (!DayFile::isBlock(_block)) {
+                _skipped++;
+                _blockIndex++;
+                _recordIndex = 0;
+                continue;
+            }
+            _loaded = true;
+        }
+        if (_recordIndex >= _block.count) {
+            _loaded = false;
+            _blockIndex++;
+            _recordIndex = 0;
+            continue;
+        }
+        record = _block.records[_recordIndex++];
+        return true;
+    }
+    return false;
+}
+
+size_t DayFileReader::read(uint8_t* buffer, size_t maxLen)
+{
+    size_t pos = 0;
+    while (pos < maxLen) {
+        if (_linePos < _lineLen) {
+            size_t len = min(static_cast<size_t>(_lineLen - _linePos), maxLen - pos);
+            memcpy(&buffer[pos], &_line[_linePos], len);
+            _linePos += len;
+            pos += len;
+            continue;
+        }
+
+        dayFileRecord_t record;
+        if (!nextRecord(record)) {
+            break;
+        }
+        if (!_started) {
+            if (static_cast<time_t>(_header.start + record.offset) < _start) {
+                continue; // in the hour of start
+            }
+            _started = true;
+        }
+        _lineLen = DayFile::formatLine(_header, record, _line);
+        _linePos = 0;
+    }
+    return pos;
+}
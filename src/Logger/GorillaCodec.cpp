@@ -0,0 +1,229 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/GorillaCodec.h"
+
+typedef struct {
+    uint32_t value;
+    uint8_t bits;
+} field_t;
+
+static void writeBits(uint8_t* data, uint16_t& pos, uint32_t value, uint8_t count)
+{
+    // msb first, the stream behind pos is zero
+    for (int i = count - 1; i >= 0; i--) {
+        if ((value >> i) & 1) {
+            data[pos >> 3] |= 0x80 >> (pos & 7);
+        }
+        pos++;
+    }
+}
+
+static bool readBits(const uint8_t* data, uint16_t bits, uint16_t& pos, uint8_t count, uint32_t& value)
+{
+    if (static_cast<uint32_t>(pos) + count > bits) {
+        return false;
+    }
+    value = 0;
+    for (uint8_t i = 0; i < count; i++) {
+        value = (value << 1) | ((data[pos >> 3] >> (7 - (pos & 7))) & 1);
+        pos++;
+    }
+    return true;
+}
+
+void GorillaCodec::reset()
+{
+    _slotCount = 0;
+    _lastTime = 0;
+    _lastValue = 0;
+}
+
+void GorillaCodec::initSlot(slot_t& slot, uint16_t serial) const
+{
+    slot.serial = serial;
+    slot.time = _lastTime;
+    slot.delta = 0;
+    slot.value = _lastValue;
+    slot.leading = 0xFF;
+    slot.trailing = 0;
+}
+
+bool GorillaCodec::encode(uint8_t* data, uint16_t maxBits, uint16_t& bits, uint16_t serial, time_t time, float value)
+{
+    field_t fields[8];
+    uint8_t count = 0;
+    uint32_t total = 0;
+    auto add = [&](uint32_t value, uint8_t bits) {
+        fields[count++] = { value, bits };
+        total += bits;
+    };
+
+    // slot
+    uint8_t index = 0;
+    while (index < _slotCount && _slots[index].serial != serial) {
+        index++;
+    }
+    slot_t slot;
+    if (index < _slotCount) {
+        slot = _slots[index];
+        add(index, GORILLA_SLOT_BITS);
+    } else {
+        if (_slotCount >= GORILLA_MAX_SLOTS) {
+            return false;
+        }
+        initSlot(slot, serial);
+        add(GORILLA_NEW_SLOT, GORILLA_SLOT_BITS);
+        add(serial, 16);
+    }
+
+    // time: delta of delta (modulo 2^32)
+    uint32_t delta = static_cast<uint32_t>(time) - slot.time;
+    int32_t dod = static_cast<int32_t>(delta - slot.delta);
+    if (dod == 0) {
+        add(0b0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        add(0b10, 2);
+        add(dod + 63, 7);
+    } else if (dod >= -255 && dod <= 256) {
+        add(0b110, 3);
+        add(dod + 255, 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        add(0b1110, 4);
+        add(dod + 2047, 12);
+    } else {
+        add(0b1111, 4);
+        add(static_cast<uint32_t>(dod), 32);
+    }
+    slot.time = static_cast<uint32_t>(time);
+    slot.delta = delta;
+
+    // value: xor to the last value, only the meaningful bits are stored
+    uint32_t actValue;
+    memcpy(&actValue, &value, sizeof(actValue));
+    uint32_t xorValue = actValue ^ slot.value;
+    if (xorValue == 0) {
+        add(0b0, 1);
+    } else {
+        uint8_t leading = __builtin_clz(xorValue);
+        uint8_t trailing = __builtin_ctz(xorValue);
+        if (slot.leading < 32 && leading >= slot.leading && trailing >= slot.trailing) {
+            // fits into the window of the last value
+            add(0b10, 2);
+            add(xorValue >> slot.trailing, 32 - slot.leading - slot.trailing);
+        } else {
+            uint8_t length = 32 - leading - trailing;
+            add(0b11, 2);
+            add(leading, 5);
+            add(length - 1, 5);
+            add(xorValue >> trailing, length);
+            slot.leading = leading;
+            slot.trailing = trailing;
+        }
+    }
+    slot.value = actValue;
+
+    if (bits + total > maxBits) {
+        return false;
+    }
+    for (uint8_t i = 0; i < count; i++) {
+        writeBits(data, bits, fields[i].value, fields[i].bits);
+    }
+
+    if (index == _slotCount) {
+        _slotCount++;
+    }
+    _slots[index] = slot;
+    _lastTime = slot.time;
+    _lastValue = slot.value;
+    return true;
+}
+
+bool GorillaCodec::decode(const uint8_t* data, uint16_t bits, uint16_t& pos, dataEntry_t& entry)
+{
+    uint32_t value;
+
+    // slot
+    if (!readBits(data, bits, pos, GORILLA_SLOT_BITS, value)) {
+        return false;
+    }
+    uint8_t index = value;
+    slot_t slot;
+    if (index == GORILLA_NEW_SLOT) {
+        if (_slotCount >= GORILLA_MAX_SLOTS || !readBits(data, bits, pos, 16, value)) {
+            return false;
+        }
+        index = _slotCount;
+        initSlot(slot, value);
+    } else if (index < _slotCount) {
+        slot = _slots[index];
+    } else {
+        return false;
+    }
+
+    // time
+    uint8_t ones = 0;
+    while (ones < 4) {
+        if (!readBits(data, bits, pos, 1, value)) {
+            return false;
+        }
+        if (value == 0) {
+            break;
+        }
+        ones++;
+    }
+    static const uint8_t dodBits[] = { 0, 7, 9, 12, 32 };
+    static const int32_t dodOffset[] = { 0, 63, 255, 2047, 0 };
+    uint32_t dod = 0;
+    if (ones > 0) {
+        if (!readBits(data, bits, pos, dodBits[ones], value)) {
+            return false;
+        }
+        dod = value - dodOffset[ones];
+    }
+    slot.delta += dod;
+    slot.time += slot.delta;
+
+    // value
+    if (!readBits(data, bits, pos, 1, value)) {
+        return false;
+    }
+    if (value != 0) {
+        if (!readBits(data, bits, pos, 1, value)) {
+            return false;
+        }
+        if (value == 1) {
+            // new window
+            uint32_t leading, length;
+            if (!readBits(data, bits, pos, 5, leading) || !readBits(data, bits, pos, 5, length)) {
+                return false;
+            }
+            length++;
+            if (leading + length > 32) {
+                return false;
+            }
+            slot.leading = leading;
+            slot.trailing = 32 - leading - length;
+        } else if (slot.leading >= 32) {
+            return false;
+        }
+        if (!readBits(data, bits, pos, 32 - slot.leading - slot.trailing, value)) {
+            return false;
+        }
+        slot.value ^= value << slot.trailing;
+    }
+
+    if (index == _slotCount) {
+        _slotCount++;
+    }
+    _slots[index] = slot;
+    _lastTime = slot.time;
+    _lastValue = slot.value;
+
+    entry.serial = slot.serial;
+    entry.time = static_cast<int32_t>(slot.time);
+    memcpy(&entry.value, &slot.value, sizeof(entry.value));
+    return true;
+}
@@ -0,0 +1,222 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/GraphData.h"
+#include <memory>
+
+GraphDataWriter::GraphDataWriter(time_t baseTime, uint8_t valueCount, bool tagged)
+    : _valueCount(constrain(valueCount, 1, GRAPHDATA_MAX_VALUES))
+    , _tagged(tagged)
+    , _lastTime(static_cast<uint32_t>(baseTime))
+{
+    // the header is sent with the first buffer
+    graphDataHeader_t header;
+    memcpy(header.magic, GRAPHDATA_MAGIC, sizeof(header.magic));
+    header.version = _tagged ? GRAPHDATA_VERSION_TAGGED : GRAPHDATA_VERSION;
+    header.recordSize = (_tagged ? 1 : 0) + sizeof(uint32_t) + _valueCount * sizeof(int16_t);
+    header.baseTime = _lastTime;
+    memcpy(_pending, &header, sizeof(header));
+    _pendingLen = sizeof(header);
+}
+
+void GraphDataWriter::begin(uint8_t* buffer, size_t maxLen)
+{
+    _buffer = buffer;
+    _maxLen = maxLen;
+    _pos = 0;
+
+    uint8_t pending[sizeof(_pending)];
+    uint8_t len = _pendingLen;
+    memcpy(pending, _pending, len);
+    _pendingLen = 0;
+    write(pending, len);
+}
+
+void GraphDataWriter::add(time_t time, const float* values, uint8_t index)
+{
+    uint8_t record[5 + GRAPHDATA_MAX_VALUES * 2];
+    uint8_t len = 0;
+
+    if (_tagged) {
+        record[len++] = index;
+    }
+
+    uint32_t delta = static_cast<uint32_t>(time) - _lastTime;
+    _lastTime = static_cast<uint32_t>(time);
+    for (uint8_t i = 0; i < 4; i++) {
+        record[len++] = delta >> (8 * i);
+    }
+
+    for (uint8_t i = 0; i < _valueCount; i++) {
+        int16_t value = GRAPHDATA_NAN;
+        if (!isnan(values[i])) {
+            value = constrain(lroundf(values[i] * 100.0f), INT16_MIN + 1, INT16_MAX);
+        }
+        record[len++] = value & 0xFF;
+        record[len++] = (value >> 8) & 0xFF;
+    }
+    write(record, len);
+}
+
+void GraphDataWriter::write(const uint8_t* data, size_t len)
+{
+    size_t count = min(len, _maxLen - _pos);
+    memcpy(&_buffer[_pos], data, count);
+    _pos += count;
+
+    // rest for the next buffer
+    memcpy(&_pending[_pendingLen], &data[count], len - count);
+    _pendingLen += len - count;
+}
+
+GraphDecimator::GraphDecimator(time_t start, uint32_t length, uint32_t maxPoints, size_t sensors)
+    : _start(start)
+    , _width(0)
+    , _buckets(sensors)
+{
+    if (maxPoints > 0) {
+        uint32_t buckets = max<uint32_t>(maxPoints / 2, 1);
+        _width = max<uint32_t>((length + buckets - 1) / buckets, 1);
+        _lastBucket = buckets - 1;
+    }
+}
+
+void GraphDecimator::add(uint8_t index, time_t time, float value)
+{
+    if (_width == 0 || index >= _buckets.size()) {
+        _output.push_back({ index, { time, value } });
+        return;
+    }
+    if (isnan(value)) {
+        return; // no value, not shown anyway
+    }
+
+    uint32_t bucket = time >= _start ? min<uint32_t>((time - _start) / _width, _lastBucket) : 0;
+    bucket_t& act = _buckets[index];
+    if (act.count > 0 && act.bucket != bucket) {
+        flush(index);
+    }
+    if (act.count == 0) {
+        act.bucket = bucket;
+        act.min = { time, value };
+        act.max = { time, value };
+    } else if (value < act.min.value) {
+        act.min = { time, value };
+    } else if (value > act.max.value) {
+        act.max = { time, value };
+    }
+    act.count++;
+}
+
+void GraphDecimator::finish()
+{
+    for (size_t i = 0; i < _buckets.size(); i++) {
+        if (_buckets[i].count > 0) {
+            flush(i);
+        }
+    }
+}
+
+bool GraphDecimator::next(uint8_t& index, time_t& time, float& value)
+{
+    if (_outputPos == _output.size()) {
+        _output.clear();
+        _outputPos = 0;
+        return false;
+    }
+    const output_t& act = _output[_outputPos++];
+    index = act.index;
+    time = act.point.time;
+    value = act.point.value;
+    return true;
+}
+
+void GraphDecimator::flush(uint8_t index)
+{
+    bucket_t& act = _buckets[index];
+    const point_t& first = act.min.time <= act.max.time ? act.min : act.max;
+    const point_t& second = act.min.time <= act.max.time ? act.max : act.min;
+    _output.push_back({ index, first });
+    if (act.count > 1 && second.time != first.time) {
+        _output.push_back({ index, second });
+    }
+    act.count = 0;
+}
+
+ResponseFiller graphDataFromText(ResponseFiller textFiller, time_t start, uint32_t length, uint32_t maxPoints)
+{
+    struct state_t {
+        GraphDataWriter writer;
+        GraphDecimator decimator;
+        char line[64];
+        uint8_t lineLen = 0;
+        uint8_t text[512];
+        size_t textLen = 0;
+        size_t textPos = 0;
+        size_t textSent = 0;
+        bool textEnd = false;
+        state_t(time_t start, uint32_t length, uint32_t maxPoints)
+            : writer(start, 1)
+            , decimator(start, length, maxPoints, 1)
+        {
+        }
+
+        void parseLine()
+        {
+            // time;value, lines without value (e.g. padding) are ignored
+            line[lineLen] = '\0';
+            lineLen = 0;
+            char* act;
+            time_t time = strtol(line, &act, 10);
+            if (act != line && *act == ';') {
+                decimator.add(0, time, strtof(act + 1, nullptr));
+            }
+        }
+    };
+    auto state = std::make_shared<state_t>(start, length, maxPoints);
+
+    return [textFiller, state](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+        GraphDataWriter& writer = state->writer;
+        writer.begin(buffer, maxLen);
+
+        uint8_t index;
+        time_t time;
+        float value;
+        while (!writer.full()) {
+            if (state->decimator.next(index, time, value)) {
+                writer.add(time, &value);
+                continue;
+            }
+            if (state->textEnd) {
+                break;
+            }
+
+            if (state->textPos == state->textLen) {
+                state->textLen = textFiller(state->text, sizeof(state->text), state->textSent);
+                state->textSent += state->textLen;
+                state->textPos = 0;
+                if (state->textLen == 0) {
+                    // last line without line end
+                    if (state->lineLen > 0) {
+                        state->parseLine();
+                    }
+                    state->textEnd = true;
+                    state->decimator.finish();
+                }
+                continue;
+            }
+
+            char c = state->text[state->textPos++];
+            if (c != '\n' && c != '\r') {
+                if (state->lineLen < sizeof(state->line) - 1) {
+                    state->line[state->lineLen++] = c;
+                }
+            } else if (state->lineLen > 0) {
+                state->parseLine();
+            }
+        }
+        return writer.end();
+    };
+}
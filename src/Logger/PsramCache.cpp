@@ -0,0 +1,103 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/PsramCache.h"
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+#include <esp32s3/rom/cache.h>
+static portMUX_TYPE cacheLock = portMUX_INITIALIZER_UNLOCKED;
+#endif
+
+uint32_t PsramCache::_flushAllTotal = 0;
+uint64_t PsramCache::_bytesAdded = 0;
+
+PsramCache::PsramCache(uint8_t* cache, size_t cacheSize)
+    : _cache(cache)
+    , _cacheSize(cacheSize)
+{
+}
+
+void PsramCache::add(const void* addr, size_t size)
+{
+    if (_cache == nullptr || size == 0) {
+        return;
+    }
+    _bytesAdded += size;
+    _flushAllCount = _flushAllTotal;
+    if (_overflow) {
+        return;
+    }
+
+    // whole cache lines
+    uintptr_t begin = reinterpret_cast<uintptr_t>(addr) & ~(PSRAM_CACHE_LINE - 1);
+    uintptr_t end = (reinterpret_cast<uintptr_t>(addr) + size + PSRAM_CACHE_LINE - 1) & ~(PSRAM_CACHE_LINE - 1);
+
+    // merge with an overlapping or adjacent range
+    for (uint8_t i = 0; i < _rangeCount; i++) {
+        range_t& range = _ranges[i];
+        if (begin <= range.end && end >= range.begin) {
+            range.begin = min(range.begin, begin);
+            range.end = max(range.end, end);
+            return;
+        }
+    }
+
+    if (_rangeCount == PSRAM_CACHE_RANGES) {
+        _overflow = true;
+        return;
+    }
+    _ranges[_rangeCount++] = { begin, end };
+}
+
+void PsramCache::flush()
+{
+    if ((_rangeCount > 0 || _overflow) && _flushAllCount != _flushAllTotal) {
+        // already written back by a full write back
+        _rangeCount = 0;
+        _overflow = false;
+        return;
+    }
+    if (_overflow) {
+        flushAll();
+        return;
+    }
+    if (_rangeCount == 0) {
+        return;
+    }
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+    portENTER_CRITICAL(&cacheLock);
+    for (uint8_t i = 0; i < _rangeCount; i++) {
+        Cache_WriteBack_Addr(_ranges[i].begin, _ranges[i].end - _ranges[i].begin);
+    }
+    portEXIT_CRITICAL(&cacheLock);
+    _rangeCount = 0;
+#else
+    flushAll();
+#endif
+}
+
+void PsramCache::flushAll()
+{
+    _rangeCount = 0;
+    _overflow = false;
+    if (_cache == nullptr) {
+        return;
+    }
+    _flushAllTotal++;
+
+#ifdef CONFIG_IDF_TARGET_ESP32S3
+    portENTER_CRITICAL(&cacheLock);
+    Cache_WriteBack_All();
+    portEXIT_CRITICAL(&cacheLock);
+#else
+    // Here _cache is used to read from another PSRAM area and thus trigger a flush of the PSRAM-cache to the PSRAM.
+    // One read per cache line is enough to replace the line.
+    volatile uint32_t sum = 0;
+    for (size_t i = 0; i < _cacheSize; i += PSRAM_CACHE_LINE) {
+        sum += *reinterpret_cast<volatile uint32_t*>(&_cache[i]);
+    }
+#endif
+}
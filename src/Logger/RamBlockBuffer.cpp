@@ -0,0 +1,678 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/Crc16.h"
+#include "MessageOutput.h"
+#include <algorithm>
+#include <memory>
+
+static_assert(offsetof(dataBlock_t, ecc) == BLOCK_DATA_LENGTH, "code words must be followed by the ecc");
+
+RamBlockBuffer::RamBlockBuffer(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize, RamBufferFormat format)
+    : _header((dataBlockHeader_t*)buffer)
+    , _blocks((size - sizeof(dataBlockHeader_t)) / sizeof(dataBlock_t))
+    , _format(format)
+    , _cache(cache, cacheSize)
+{
+    // Same as RamBuffer: the values in PSRAM survive a reset, PowerOnInitialize is only called if beginIntegrityCheck fails.
+}
+
+void RamBlockBuffer::PowerOnInitialize()
+{
+    _header->format = static_cast<uint32_t>(_format);
+    _header->start = (dataBlock_t*)(&_header[1]);
+    _header->first = _header->start;
+    _header->last = _header->start;
+    _header->end = &_header->start[_blocks];
+    _header->rebootCount = 0;
+    _header->errorCount = 0;
+    _verifyBlock = nullptr;
+    _wraps++; // positions of old snapshots are not reached again
+
+    initBlock(_header->last);
+    _rsHeader.EncodeBlock(_header, _header->ecc);
+
+    // PSRAM uses cache which is cleared after reset -> trigger a flush of the PSRAM-cache to the PSRAM.
+    _cache.flushAll();
+}
+
+bool RamBlockBuffer::beginIntegrityCheck(bool decode)
+{
+    MessageOutput.println("IntegrityCheck ...");
+
+    if (_rsHeader.Decode(_header, _header) > 0) {
+        MessageOutput.println("RamBlockBuffer header ecc failed");
+        return false;
+    }
+    if (_header->format != static_cast<uint32_t>(_format) || _header->start != (dataBlock_t*)(&_header[1]) || _header->end != &_header->start[_blocks]) {
+        MessageOutput.println("RamBlockBuffer layout changed");
+        return false;
+    }
+    if (!isBlock(_header->first) || !isBlock(_header->last)) {
+        MessageOutput.println("RamBlockBuffer invalid header");
+        return false;
+    }
+    _header->rebootCount++;
+
+    _oldErrors = 0;
+    _newErrors = 0;
+
+    // open block
+    if (!checkCrc(_header->last)) {
+        MessageOutput.println("RamBlockBuffer open block crc failed");
+        initBlock(_header->last);
+        _newErrors++;
+    }
+    restoreCodec();
+
+    _rsHeader.EncodeBlock(_header, _header->ecc);
+    _cache.flushAll();
+
+    // the sealed blocks are verified from last to first, new entries are appended meanwhile
+    _verifyBlock = _header->last;
+    _verifyDecode = decode;
+    _verifyCount = 0;
+    _verifyTotal = getUsedBlocks() - 1;
+    return true;
+}
+
+IntegrityState RamBlockBuffer::continueIntegrityCheck(size_t count)
+{
+    if (_verifyBlock == nullptr) {
+        return IntegrityState::Verified;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        // reached first or first has overtaken the verified blocks
+        if (_verifyBlock == _header->first || !isUsed(_verifyBlock)) {
+            return finishIntegrityCheck();
+        }
+
+        dataBlock_t* act = (_verifyBlock == _header->start ? _header->end : _verifyBlock) - 1;
+        if (act->info.time == 0) {
+            _oldErrors++;
+        } else if (_verifyDecode && !decodeBlock(act)) {
+            // mark block as invalid, so it is ignored in getEntry
+            act->info.time = 0;
+            act->info.count = 0;
+            act->info.length = 0;
+            _cache.add(&act->info, sizeof(dataBlockInfo_t));
+            _newErrors++;
+        }
+        _verifyBlock = act;
+        _verifyCount++;
+    }
+    return IntegrityState::Verifying;
+}
+
+IntegrityState RamBlockBuffer::finishIntegrityCheck()
+{
+    _verifyBlock = nullptr;
+
+    float errorRate = (float)(_oldErrors + _newErrors) / (_verifyCount + 1) * 100.0f;
+    MessageOutput.printf("Old errors: %d, New errors: %d, Total errors: %.2f%%\r\n", _oldErrors, _newErrors, errorRate);
+
+    if (errorRate > 10.0f) {
+        MessageOutput.println("IntegrityCheck failed: Too many errors");
+        return IntegrityState::Failed;
+    }
+    _header->errorCount = _oldErrors + _newErrors;
+    _rsHeader.EncodeBlock(_header, _header->ecc);
+    _cache.flushAll();
+
+    MessageOutput.println("IntegrityCheck done");
+    return IntegrityState::Verified;
+}
+
+uint8_t RamBlockBuffer::getVerifyProgress() const
+{
+    if (_verifyBlock == nullptr || _verifyTotal == 0) {
+        return 100;
+    }
+    return min<size_t>(_verifyCount * 100 / _verifyTotal, 99);
+}
+
+bool RamBlockBuffer::isBlock(const dataBlock_t* block) const
+{
+    // a pointer read back from PSRAM: in the ring and on the start of a block
+    const uintptr_t pos = reinterpret_cast<uintptr_t>(block);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(_header->start);
+    return block >= _header->start && block < _header->end && (pos - start) % sizeof(dataBlock_t) == 0;
+}
+
+bool RamBlockBuffer::isUsed(const dataBlock_t* block) const
+{
+    if (_header->last >= _header->first) {
+        return block >= _header->first && block <= _header->last;
+    }
+    return block >= _header->first || block <= _header->last;
+}
+
+void RamBlockBuffer::writeValue(uint16_t serial, time_t time, float value)
+{
+    append(serial, time, value);
+    flushCache();
+}
+
+void RamBlockBuffer::writeBatch(const dataEntry_t* entries, size_t count)
+{
+    for (size_t i = 0; i < count; i++) {
+        append(entries[i].serial, entries[i].time, entries[i].value);
+    }
+    flushCache();
+}
+
+void RamBlockBuffer::append(uint16_t serial, time_t time, float value)
+{
+    if (appendEntry(_header->last, serial, time, value)) {
+        return;
+    }
+
+    startBlock();
+    appendEntry(_header->last, serial, time, value);
+}
+
+void RamBlockBuffer::startBlock()
+{
+    dataBlock_t* block = _header->last;
+    sealBlock(block);
+    _cache.add(block, sizeof(dataBlock_t));
+
+    // last overwrites first -> increase first
+    block = nextBlock(block);
+    if (block == _header->first) {
+        // IntegrityCheck: all blocks before _verifyBlock are overwritten, it must not pass first
+        bool verified = _verifyBlock == _header->first;
+        _header->first = nextBlock(_header->first);
+        if (verified) {
+            _verifyBlock = _header->first;
+        }
+    }
+    if (block == _header->start) {
+        _wraps++;
+    }
+    _header->last = block;
+    initBlock(block);
+
+    // the header changes only if a block is sealed
+    _rsHeader.EncodeBlock(_header, _header->ecc);
+    _cache.add(_header, sizeof(dataBlockHeader_t));
+    _cache.add(block, sizeof(dataBlock_t));
+}
+
+bool RamBlockBuffer::appendEntry(dataBlock_t* block, uint16_t serial, time_t time, float value)
+{
+    // changed payload bytes
+    size_t from, to;
+
+    if (_format == RamBufferFormat::Compressed) {
+        uint16_t bits = block->info.length;
+        if (!_codec.encode(block->payload, BLOCK_PAYLOAD_LENGTH * 8, bits, serial, time, value)) {
+            return false;
+        }
+        from = block->info.length / 8;
+        to = (bits - 1) / 8;
+        block->info.length = bits;
+    } else if (_format == RamBufferFormat::Compact) {
+        uint16_t length = block->info.length;
+        time_t baseTime = block->info.count == 0 ? time : block->info.time;
+        if (!_compactCodec.encode(block->payload, BLOCK_PAYLOAD_LENGTH, length, baseTime, serial, time, value)) {
+            return false;
+        }
+        from = block->info.length;
+        to = length - 1;
+        block->info.length = length;
+    } else {
+        if (block->info.length + sizeof(dataEntry_t) > BLOCK_PAYLOAD_LENGTH) {
+            return false;
+        }
+        dataEntry_t entry;
+        entry.serial = serial;
+        entry.time = time;
+        entry.value = value;
+
+        memcpy(&block->payload[block->info.length], &entry, sizeof(entry));
+        from = block->info.length;
+        to = from + sizeof(entry) - 1;
+        block->info.length += sizeof(entry);
+    }
+
+    if (block->info.count == 0) {
+        block->info.time = time;
+    }
+    block->info.count++;
+
+    // CRC of the code word with the block info and the code words of the entry
+    updateCrc(block, 0);
+    for (size_t word = (sizeof(dataBlockInfo_t) + from) / BLOCK_WORD_LENGTH; word <= (sizeof(dataBlockInfo_t) + to) / BLOCK_WORD_LENGTH; word++) {
+        if (word != 0) {
+            updateCrc(block, word);
+        }
+    }
+
+    _cache.add(&block->info, sizeof(dataBlockInfo_t));
+    _cache.add(&block->payload[from], to - from + 1);
+    _cache.add(block->ecc, sizeof(block->ecc));
+    return true;
+}
+
+bool RamBlockBuffer::beginMerge(const dataEntry_t*, size_t)
+{
+    // the blocks are sealed with their ecc (and compressed), entries can not be inserted
+    return false;
+}
+
+bool RamBlockBuffer::continueMerge(size_t, size_t& merged)
+{
+    merged = 0;
+    return true;
+}
+
+bool RamBlockBuffer::getEntry(uint16_t serial, time_t time, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(&serial, 1, time, time + 24 * 60 * 60, cursor, entry);
+}
+
+bool RamBlockBuffer::getEntry(const std::vector<uint16_t>& serials, time_t time, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(serials.data(), serials.size(), time, time + 24 * 60 * 60, cursor, entry);
+}
+
+bool RamBlockBuffer::getEntry(const std::vector<uint16_t>& serials, time_t from, time_t to, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(serials.data(), serials.size(), from, to, cursor, entry);
+}
+
+void RamBlockBuffer::saveCursor(const RamBufferCursor& cursor, uint32_t& position, uint32_t& index) const
+{
+    const dataBlock_t* block = static_cast<const dataBlock_t*>(cursor.pos);
+    position = block == nullptr ? 0 : getLastPosition() - (toIndex(_header->last) - toIndex(block) + _blocks) % _blocks;
+    index = cursor.index;
+}
+
+bool RamBlockBuffer::restoreCursor(uint32_t position, uint32_t index, const std::vector<uint16_t>& serials, RamBufferCursor& cursor) const
+{
+    uint32_t last = getLastPosition();
+    if (position < last - (getUsedBlocks() - 1) || position > last) {
+        return false;
+    }
+    loadEntries(_header->start + position % _blocks, serials.data(), serials.size(), cursor);
+    if (index > cursor.entries.size()) {
+        return false;
+    }
+    cursor.index = index;
+    return true;
+}
+
+bool RamBlockBuffer::getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    dataBlock_t* block = static_cast<dataBlock_t*>(cursor.pos);
+    if (block == nullptr) {
+        block = findStart(time);
+        loadEntries(block, serials, count, cursor);
+    }
+
+    while (true) {
+        while (cursor.index < cursor.entries.size()) {
+            const dataEntry_t& act = cursor.entries[cursor.index];
+
+            // end check
+            if (act.time >= to) {
+                return false;
+            }
+            cursor.index++;
+
+            if (act.time >= time) {
+                entry = act;
+                return true;
+            }
+        }
+
+        if (block == _header->last) {
+            return false;
+        }
+        block = nextBlock(block);
+        loadEntries(block, serials, count, cursor);
+    }
+}
+
+void RamBlockBuffer::loadEntries(const dataBlock_t* block, const uint16_t* serials, size_t count, RamBufferCursor& cursor) const
+{
+    // serials == nullptr: all entries
+    cursor.pos = const_cast<dataBlock_t*>(block);
+    cursor.index = 0;
+    cursor.entries.clear();
+
+    dataEntry_t entry;
+    if (_format == RamBufferFormat::Compressed) {
+        GorillaCodec codec;
+        uint16_t bits = min<size_t>(block->info.length, BLOCK_PAYLOAD_LENGTH * 8);
+        uint16_t pos = 0;
+        while (codec.decode(block->payload, bits, pos, entry)) {
+            if (serials == nullptr || std::find(serials, serials + count, entry.serial) != serials + count) {
+                cursor.entries.push_back(entry);
+            }
+        }
+        return;
+    }
+    if (_format == RamBufferFormat::Compact) {
+        CompactCodec codec;
+        uint16_t length = min<size_t>(block->info.length, BLOCK_PAYLOAD_LENGTH);
+        uint16_t pos = 0;
+        while (codec.decode(block->payload, length, pos, block->info.time, entry)) {
+            if (serials == nullptr || std::find(serials, serials + count, entry.serial) != serials + count) {
+                cursor.entries.push_back(entry);
+            }
+        }
+        return;
+    }
+
+    uint16_t entries = min<size_t>(block->info.count, BLOCK_PAYLOAD_LENGTH / sizeof(dataEntry_t));
+    for (uint16_t i = 0; i < entries; i++) {
+        memcpy(&entry, &block->payload[i * sizeof(dataEntry_t)], sizeof(entry));
+        if (serials == nullptr || std::find(serials, serials + count, entry.serial) != serials + count) {
+            cursor.entries.push_back(entry);
+        }
+    }
+}
+
+void RamBlockBuffer::restoreCodec()
+{
+    _codec.reset();
+    _compactCodec.reset();
+    if (_format != RamBufferFormat::Compressed && _format != RamBufferFormat::Compact) {
+        return;
+    }
+
+    // decode the open block to continue its stream
+    dataBlock_t* block = _header->last;
+    uint16_t length = min<size_t>(block->info.length, _format == RamBufferFormat::Compressed ? BLOCK_PAYLOAD_LENGTH * 8 : BLOCK_PAYLOAD_LENGTH);
+    uint16_t pos = 0;
+    uint16_t count = 0;
+    dataEntry_t entry;
+    while (pos < length
+        && (_format == RamBufferFormat::Compressed ? _codec.decode(block->payload, length, pos, entry)
+                                                   : _compactCodec.decode(block->payload, length, pos, block->info.time, entry))) {
+        count++;
+    }
+    if (count != block->info.count || pos != block->info.length) {
+        MessageOutput.printf("RamBlockBuffer open block invalid stream %d/%d entries\r\n", count, block->info.count);
+        initBlock(block);
+    }
+}
+
+dataBlock_t* RamBlockBuffer::findStart(time_t time)
+{
+    size_t count = getUsedBlocks();
+    size_t lo = 0, hi = count;
+
+    // an empty open block (e.g. after getSnapshot) has no time, the entries are in the blocks before
+    if (_header->last->info.count == 0 && hi > 1) {
+        hi--;
+    }
+
+    // only the verified blocks from _verifyBlock to last while IntegrityCheck is running
+    if (_verifyBlock != nullptr && isUsed(_verifyBlock)) {
+        lo = _verifyBlock >= _header->first ? _verifyBlock - _header->first : _blocks - (_header->first - _verifyBlock);
+    }
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+
+        // index to pointer
+        dataBlock_t* p = _header->first + mid;
+        if (p >= _header->end) {
+            p -= _blocks;
+        }
+
+        if (p->info.time == 0 || p->info.time < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    // the block before the first block starting after time can contain the first entries
+    if (lo > 0) {
+        lo--;
+    }
+
+    dataBlock_t* result = _header->first + lo;
+    if (result >= _header->end) {
+        result -= _blocks;
+    }
+    return result;
+}
+
+time_t RamBlockBuffer::getOldestTime() const
+{
+    for (dataBlock_t* act = _header->first;; act = nextBlock(act)) {
+        if (act->info.time != 0 && act->info.count > 0) {
+            return act->info.time;
+        }
+        if (act == _header->last) {
+            return 0;
+        }
+    }
+}
+
+void RamBlockBuffer::initBlock(dataBlock_t* block)
+{
+    _codec.reset();
+    _compactCodec.reset();
+    memset(block, 0, BLOCK_DATA_LENGTH);
+    for (size_t word = 0; word < BLOCK_WORDS; word++) {
+        updateCrc(block, word);
+    }
+}
+
+void RamBlockBuffer::sealBlock(dataBlock_t* block)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(block);
+    for (size_t word = 0; word < BLOCK_WORDS; word++) {
+        _rsBlock.EncodeBlock(&data[word * BLOCK_WORD_LENGTH], block->ecc[word]);
+    }
+}
+
+bool RamBlockBuffer::decodeBlock(dataBlock_t* block)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(block);
+    uint8_t code[BLOCK_WORD_LENGTH + BLOCK_ECC_LENGTH];
+
+    for (size_t word = 0; word < BLOCK_WORDS; word++) {
+        memcpy(code, &data[word * BLOCK_WORD_LENGTH], BLOCK_WORD_LENGTH);
+        memcpy(&code[BLOCK_WORD_LENGTH], block->ecc[word], BLOCK_ECC_LENGTH);
+        if (_rsBlock.Decode(code, code) > 0) {
+            return false;
+        }
+        memcpy(&data[word * BLOCK_WORD_LENGTH], code, BLOCK_WORD_LENGTH);
+    }
+    return true;
+}
+
+void RamBlockBuffer::updateCrc(dataBlock_t* block, size_t word)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(block);
+    uint16_t crc = Crc16::Update(0, &data[word * BLOCK_WORD_LENGTH], BLOCK_WORD_LENGTH);
+    memcpy(block->ecc[word], &crc, sizeof(crc));
+}
+
+bool RamBlockBuffer::checkCrc(dataBlock_t* block)
+{
+    uint8_t* data = reinterpret_cast<uint8_t*>(block);
+    for (size_t word = 0; word < BLOCK_WORDS; word++) {
+        uint16_t crc = Crc16::Update(0, &data[word * BLOCK_WORD_LENGTH], BLOCK_WORD_LENGTH);
+        if (memcmp(block->ecc[word], &crc, sizeof(crc)) != 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+RamBufferSnapshot RamBlockBuffer::getSnapshot()
+{
+    // only sealed blocks, the open block changes with every entry
+    if (_header->last->info.count > 0) {
+        startBlock();
+        flushCache();
+    }
+    uint32_t last = getLastPosition();
+    return { static_cast<uint32_t>(last - (getUsedBlocks() - 1)), last };
+}
+
+bool RamBlockBuffer::isSnapshotValid(const RamBufferSnapshot& snapshot) const
+{
+    uint32_t last = getLastPosition();
+    uint32_t first = last - (getUsedBlocks() - 1);
+    return first <= snapshot.first && snapshot.first <= snapshot.last && snapshot.last <= last;
+}
+
+size_t RamBlockBuffer::getBackupSize(const RamBufferSnapshot& snapshot) const
+{
+    return sizeof(dataBlockBackup_t) + (snapshot.last - snapshot.first) * sizeof(dataBlock_t);
+}
+
+size_t RamBlockBuffer::readBackup(const RamBufferSnapshot& snapshot, size_t offset, uint8_t* buffer, size_t len) const
+{
+    dataBlockBackup_t backup;
+    memcpy(backup.magic, RAMBUFFER_BACKUP_MAGIC, sizeof(backup.magic));
+    backup.format = static_cast<uint16_t>(_format);
+    backup.blockSize = sizeof(dataBlock_t);
+
+    const size_t total = getBackupSize(snapshot);
+    const size_t ringSize = _blocks * sizeof(dataBlock_t);
+    size_t ret = 0;
+    len = offset < total ? min(len, total - offset) : 0;
+
+    while (ret < len) {
+        size_t pos = offset + ret;
+        const uint8_t* src;
+        size_t count;
+
+        if (pos < sizeof(backup)) {
+            src = reinterpret_cast<const uint8_t*>(&backup) + pos;
+            count = sizeof(backup) - pos;
+        } else {
+            // the blocks from first to last, the ring wraps from end to start
+            size_t ringPos = ((snapshot.first % _blocks) * sizeof(dataBlock_t) + pos - sizeof(backup)) % ringSize;
+            src = reinterpret_cast<const uint8_t*>(_header->start) + ringPos;
+            count = ringSize - ringPos;
+        }
+        count = min(count, len - ret);
+        memcpy(&buffer[ret], src, count);
+        ret += count;
+    }
+    return ret;
+}
+
+bool RamBlockBuffer::getSnapshotEntry(const RamBufferSnapshot& snapshot, RamBufferCursor& cursor, dataEntry_t& entry) const
+{
+    while (cursor.index >= cursor.entries.size()) {
+        if (cursor.position >= snapshot.last - snapshot.first) {
+            return false;
+        }
+        loadEntries(_header->start + (snapshot.first + cursor.position) % _blocks, nullptr, 0, cursor);
+        cursor.position++;
+    }
+    entry = cursor.entries[cursor.index++];
+    return true;
+}
+
+bool RamBlockBuffer::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
+{
+    if (alreadyWritten == 0) {
+        PowerOnInitialize();
+        _restoreOffset = 0;
+        _restoreCarryLen = 0;
+
+        dataBlockBackup_t backup;
+        if (len >= sizeof(backup) && memcmp(data, RAMBUFFER_BACKUP_MAGIC, sizeof(RAMBUFFER_BACKUP_MAGIC)) == 0) {
+            memcpy(&backup, data, sizeof(backup));
+            if (backup.format != static_cast<uint16_t>(_format) || backup.blockSize != sizeof(dataBlock_t)) {
+                MessageOutput.printf("RamBlockBuffer::restoreBackup format %d, block size %d not supported\r\n", backup.format, backup.blockSize);
+                _restoreMode = RestoreMode::None;
+                return false;
+            }
+            _restoreMode = RestoreMode::Blocks;
+            data += sizeof(backup);
+            len -= sizeof(backup);
+        } else {
+            // backup of RamBuffer (entries with ecc)
+            _restoreMode = RestoreMode::Entries;
+        }
+    }
+
+    switch (_restoreMode) {
+    case RestoreMode::Blocks: {
+        const size_t ringSize = _blocks * sizeof(dataBlock_t);
+        if (_restoreOffset + len > ringSize) {
+            MessageOutput.printf("RamBlockBuffer::restoreBackup overflow alreadyWritten=%d, len=%d, max=%d\r\n", alreadyWritten, len, ringSize);
+            len = _restoreOffset < ringSize ? ringSize - _restoreOffset : 0;
+        }
+        if (len > 0) {
+            memcpy(reinterpret_cast<uint8_t*>(_header->start) + _restoreOffset, data, len);
+            _restoreOffset += len;
+        }
+        break;
+    }
+    case RestoreMode::Entries:
+        restoreEntries(data, len);
+        break;
+    default:
+        return false;
+    }
+
+    if (final) {
+        if (_restoreMode == RestoreMode::Blocks) {
+            size_t blocks = _restoreOffset / sizeof(dataBlock_t);
+            if (blocks > 0) {
+                _header->last = _header->start + blocks - 1;
+            }
+            if (!checkCrc(_header->last)) {
+                if (blocks > 0 && decodeBlock(_header->last)) {
+                    startBlock(); // backups of snapshots end with a sealed block
+                } else {
+                    initBlock(_header->last);
+                }
+            }
+            restoreCodec();
+        }
+        _rsHeader.EncodeBlock(_header, _header->ecc);
+        MessageOutput.printf("RamBlockBuffer::restoreBackup final blocks=%d, first=%d, last=%d\r\n", getUsedBlocks(), toIndex(_header->first), toIndex(_header->last));
+
+        _cache.flushAll();
+        _restoreMode = RestoreMode::None;
+    }
+
+    return true;
+}
+
+void RamBlockBuffer::restoreEntries(const uint8_t* data, size_t len)
+{
+    while (len > 0) {
+        size_t n = min(len, sizeof(dataEntryFEC_t) - _restoreCarryLen);
+        memcpy(&_restoreCarry[_restoreCarryLen], data, n);
+        _restoreCarryLen += n;
+        data += n;
+        len -= n;
+
+        if (_restoreCarryLen < sizeof(dataEntryFEC_t)) {
+            break;
+        }
+        _restoreCarryLen = 0;
+
+        dataEntryFEC_t fec;
+        memcpy(&fec, _restoreCarry, sizeof(fec));
+        if (fec.entry.time != 0 && _rsData.Decode(&fec, &fec) == 0) {
+            append(fec.entry.serial, fec.entry.time, fec.entry.value);
+        }
+    }
+}
+
+void RamBlockBuffer::flushCache()
+{
+    _cache.flush();
+}
@@ -4,14 +4,16 @@
  */
 
 #include "Logger/RamBuffer.h"
+#include "Logger/Crc16.h"
 #include "MessageOutput.h"
+#include <algorithm>
 #include <memory>
 
 RamBuffer::RamBuffer(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize)
     : _header((dataEntryHeader_t*)buffer)
-    , _elements((size - sizeof(dataEntryHeader_t)) / sizeof(dataEntryFEC_t))
-    , _cache(cache)
-    , _cacheSize(cacheSize)
+    , _elements((size - sizeof(dataEntryHeader_t)) / (sizeof(dataEntryFEC_t) + sizeof(dataEntryLink_t)))
+    , _links(reinterpret_cast<dataEntryLink_t*>(buffer + sizeof(dataEntryHeader_t) + _elements * sizeof(dataEntryFEC_t)))
+    , _cache(cache, cacheSize)
 {
     // On reset: _header, _cache and _cacheSize is set. The values in PSRAM are not changes/deleted.
     // On power on: do additional initialisation
@@ -26,18 +28,22 @@ void RamBuffer::PowerOnInitialize()
     _header->end = &_header->start[_elements];
     _header->rebootCount = 0;
     _header->errorCount = 0;
+    memset(_header->commit, 0, sizeof(_header->commit));
 
-    _rsHeader.EncodeBlock(_header, _header->ecc);
+    _seq = 0;
+    commitHeader(true);
 
     _header->first->entry.time = 0;
+    _tail.clear();
+    _verifyPos = nullptr;
+    _mergeState = MergeState::Idle;
+    _wraps++; // positions of old snapshots are not reached again
 
     // PSRAM uses cache which is cleared after reset -> trigger a flush of the PSRAM-cache to the PSRAM.
-    if (_cache != nullptr) {
-        memset(_cache, 0, _cacheSize);
-    }
+    _cache.flushAll();
 }
 
-bool RamBuffer::IntegrityCheck()
+bool RamBuffer::beginIntegrityCheck(bool decode)
 {
     MessageOutput.println("IntegrityCheck ...");
 
@@ -46,99 +52,383 @@ bool RamBuffer::IntegrityCheck()
         MessageOutput.println("RamBuffer header ecc failed");
         return false;
     }
+    if (_header->start != (dataEntryFEC_t*)(&_header[1]) || _header->end != &_header->start[_elements]) {
+        MessageOutput.println("RamBuffer layout changed");
+        return false;
+    }
+
+    // first and last of the newest valid commit
+    const dataEntryCommit_t* newest = &_header->base;
+    for (const dataEntryCommit_t& commit : _header->commit) {
+        if (isValidCommit(commit) && static_cast<int32_t>(commit.seq - newest->seq) > 0) {
+            newest = &commit;
+        }
+    }
+    if (!isValidCommit(*newest)) {
+        MessageOutput.println("RamBuffer invalid header");
+        return false;
+    }
+    _header->first = newest->first;
+    _header->last = newest->last;
+    _seq = newest->seq;
     _header->rebootCount++;
+    commitHeader(true);
+    _cache.flushAll();
+
+    // the entries are verified from last to first, new entries are appended meanwhile
+    _tail.clear();
+    _head.clear();
+    _verifyPos = _header->last;
+    _verifyDecode = decode;
+    _verifyCount = 0;
+    _verifyTotal = getUsedElements();
+    _oldErrors = 0;
+    _newErrors = 0;
+    return true;
+}
 
-    dataEntryFEC_t* act = _header->first;
-    size_t oldErrors = 0;
-    size_t newErrors = 0;
+IntegrityState RamBuffer::continueIntegrityCheck(size_t count)
+{
+    if (_verifyPos == nullptr) {
+        return IntegrityState::Verified;
+    }
 
-    for (int i = 0; i < 2; i++) {
-        while (act < _header->end) {
-            if (act == _header->last) {
-                size_t usedElements = getUsedElements();
-                float errorRate = usedElements == 0 ? 0.0f : (float)(oldErrors + newErrors) / usedElements * 100.0f;
-                MessageOutput.printf("Old errors: %d, New errors: %d, Total errors: %.2f%%\r\n", oldErrors, newErrors, errorRate);
-
-                if(errorRate > 10.0f) {
-                    MessageOutput.println("IntegrityCheck failed: Too many errors");
-                    return false;
-                }
-                _header->errorCount = oldErrors + newErrors;
-                _rsHeader.EncodeBlock(_header, _header->ecc);
-                flushCache();
-
-                MessageOutput.println("IntegrityCheck done");
-                return true;
-            }
+    for (size_t i = 0; i < count; i++) {
+        // reached first or first has overtaken the verified entries
+        if (_verifyPos == _header->first || (_verifyPos != _header->last && !isUsed(_verifyPos))) {
+            return finishIntegrityCheck();
+        }
 
-            if(act->entry.time == 0)
-            {
-                oldErrors++;
-            }
-            else if (_rsData.Decode(act, act) > 0)
-            {
-                act->entry.time = 0; // set time to 0 on ecc error, so it is ignored in getEntry
-                newErrors++;
-            }
+        dataEntryFEC_t* act = (_verifyPos == _header->start ? _header->end : _verifyPos) - 1;
+        if (act->entry.time == 0) {
+            _oldErrors++;
+        } else if (_verifyDecode && _rsData.Decode(act, act) > 0) {
+            act->entry.time = 0; // set time to 0 on ecc error, so it is ignored in getEntry
+            _cache.add(act, sizeof(dataEntryFEC_t));
+            _newErrors++;
+        }
+        linkEntryBackward(act);
+
+        //MessageOutput.printf("%x, %ld, %05.2f\r\n", act->entry.serial, act->entry.time, act->entry.value);
+        _verifyPos = act;
+        _verifyCount++;
+    }
+    return IntegrityState::Verifying;
+}
+
+IntegrityState RamBuffer::finishIntegrityCheck()
+{
+    _verifyPos = nullptr;
+    _head.clear();
 
-            //MessageOutput.printf("%x, %ld, %05.2f\r\n", act->entry.serial, act->entry.time, act->entry.value);
-            act++;
+    float errorRate = _verifyCount == 0 ? 0.0f : (float)(_oldErrors + _newErrors) / _verifyCount * 100.0f;
+    MessageOutput.printf("Old errors: %d, New errors: %d, Total errors: %.2f%%\r\n", _oldErrors, _newErrors, errorRate);
+
+    if (errorRate > 10.0f) {
+        MessageOutput.println("IntegrityCheck failed: Too many errors");
+        return IntegrityState::Failed;
+    }
+    _header->errorCount = _oldErrors + _newErrors;
+    commitHeader(true);
+    _cache.flushAll();
+
+    MessageOutput.println("IntegrityCheck done");
+    return IntegrityState::Verified;
+}
+
+uint8_t RamBuffer::getVerifyProgress() const
+{
+    if (_verifyPos == nullptr || _verifyTotal == 0) {
+        return 100;
+    }
+    return min<size_t>(_verifyCount * 100 / _verifyTotal, 99);
+}
+
+void RamBuffer::writeValue(uint16_t serial, time_t time, float value)
+{
+    dataEntry_t entry = { serial, time, value };
+    writeBatch(&entry, 1);
+}
+
+void RamBuffer::writeBatch(const dataEntry_t* entries, size_t count)
+{
+    if (count == 0) {
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        append(entries[i]);
+    }
+    commitHeader(false);
+    flushCache();
+}
+
+bool RamBuffer::beginMerge(const dataEntry_t* entries, size_t count)
+{
+    if (_verifyPos != nullptr) {
+        return false; // the entries are not verified yet
+    }
+
+    _mergeBatch.assign(entries, entries + count);
+    std::vector<dataEntry_t>& batch = _mergeBatch;
+    std::stable_sort(batch.begin(), batch.end(), [](const dataEntry_t& a, const dataEntry_t& b) { return a.time < b.time; });
+
+    // skip identical entries, already stored or repeated in the batch
+    size_t unique = 0;
+    for (size_t i = 0; i < batch.size(); i++) {
+        const dataEntry_t& entry = batch[i];
+        bool repeated = false;
+        for (size_t j = unique; j > 0 && batch[j - 1].time == entry.time && !repeated; j--) {
+            repeated = memcmp(&batch[j - 1], &entry, sizeof(entry)) == 0;
+        }
+        if (entry.time != 0 && !repeated && !isStored(entry)) {
+            batch[unique++] = entry;
+        }
+    }
+    batch.resize(unique);
+
+    // the oldest entries of both are dropped if the result does not fit
+    const size_t used = getUsedElements();
+    const size_t added = batch.size();
+    size_t liveFirst = 0, batchFirst = 0;
+    for (size_t drop = used + added > getTotalElements() ? used + added - getTotalElements() : 0; drop > 0; drop--) {
+        if (liveFirst < used && (batchFirst == added || at(liveFirst)->entry.time <= batch[batchFirst].time)) {
+            liveFirst++;
+        } else {
+            batchFirst++;
+        }
+    }
+
+    _mergeUsed = used;
+    _mergeLiveFirst = liveFirst;
+    _mergeBatchFirst = batchFirst;
+    _mergeWrite = used + added - batchFirst;
+    _mergeRead = used;
+    _mergeNext = added;
+    // nothing to insert (e.g. all older than the kept entries) -> the stored entries are not touched
+    _mergeState = batchFirst < added ? MergeState::Move : MergeState::Idle;
+    return true;
+}
+
+bool RamBuffer::continueMerge(size_t count, size_t& merged)
+{
+    merged = 0;
+
+    // Merge from the newest end: the stored entries newer than a new one are moved behind it. The write position
+    // stays ahead of the read position, positions behind the capacity wrap onto dropped entries.
+    for (; count > 0 && _mergeState == MergeState::Move; count--) {
+        dataEntryFEC_t* dest = at(--_mergeWrite);
+        if (_mergeRead > _mergeLiveFirst && at(_mergeRead - 1)->entry.time > _mergeBatch[_mergeNext - 1].time) {
+            memcpy(dest, at(--_mergeRead), sizeof(dataEntryFEC_t));
+        } else {
+            dest->entry = _mergeBatch[--_mergeNext];
+            _rsData.EncodeBlock(dest, dest->ecc);
+        }
+        _cache.add(dest, sizeof(dataEntryFEC_t));
+        if (_mergeNext == _mergeBatchFirst) {
+            finishMergeMove();
+        }
+    }
+
+    // Only the links from the oldest touched entry change. Scan backward for the newest entry per serial before it,
+    // usually a few entries, they are linked to the moved ones then.
+    while (count > 0 && _mergeState == MergeState::Scan) {
+        if (_mergePos == 0 || _mergeFound == _tail.size()) {
+            _tail.swap(_mergeTail);
+            _mergeTail.clear();
+            _mergePos = _mergeTouched;
+            _mergeState = MergeState::Link;
+            break;
         }
-        act = _header->start;
+        dataEntryFEC_t* act = at(--_mergePos);
+        if (act->entry.time != 0 && _mergeTail.emplace(act->entry.serial, act).second && _tail.count(act->entry.serial) > 0) {
+            _mergeFound++;
+        }
+        count--;
+    }
+
+    for (; count > 0 && _mergeState == MergeState::Link; count--) {
+        if (_mergePos == getUsedElements()) {
+            _mergeState = MergeState::Idle;
+            break;
+        }
+        linkEntry(at(_mergePos++));
+    }
+    flushCache();
+
+    if (_mergeState != MergeState::Idle) {
+        return false;
     }
+    merged = _mergeBatch.size() - _mergeBatchFirst;
+    std::vector<dataEntry_t>().swap(_mergeBatch);
+    return true;
+}
 
-    MessageOutput.println("RamBuffer ecc error");
+void RamBuffer::finishMergeMove()
+{
+    const size_t end = _mergeUsed + _mergeBatch.size() - _mergeBatchFirst;
+    _mergeTouched = _mergeWrite - _mergeLiveFirst;
+
+    dataEntryFEC_t* first = at(_mergeLiveFirst);
+    _header->last = at(end);
+    _header->first = first;
+    _wraps += 2; // the positions of old snapshots have other entries now
+    commitHeader(true);
+
+    _mergePos = _mergeTouched;
+    _mergeFound = 0;
+    _mergeTail.clear();
+    _mergeState = MergeState::Scan;
+}
+
+bool RamBuffer::isStored(const dataEntry_t& entry)
+{
+    for (dataEntry_t* act = findStart(entry.time); act != toEntry(_header->last) && act->time == entry.time;) {
+        if (memcmp(act, &entry, sizeof(entry)) == 0) {
+            return true;
+        }
+        dataEntryFEC_t* next = toFec(act) + 1;
+        act = toEntry(next == _header->end ? _header->start : next);
+    }
     return false;
 }
 
-void RamBuffer::writeValue(uint16_t serial, time_t time, float value)
+void RamBuffer::append(const dataEntry_t& entry)
 {
-    _header->last->entry.serial = serial;
-    _header->last->entry.time = time;
-    _header->last->entry.value = value;
+    _header->last->entry = entry;
      //MessageOutput.printf("writeValue: ## %d: 0x%x, (%ld, %05.2f)\r\n", toIndex(_header->last), _header->last->serial, _header->last->time, _header->last->value);
 
     _rsData.EncodeBlock(_header->last, _header->last->ecc);
 
+    dataEntryFEC_t* act = _header->last;
     _header->last++;
 
     // last on end -> begin with start
     if (_header->last == _header->end) {
         _header->last = _header->start;
+        _wraps++;
     }
 
     // last overwrites first -> increase first
     if (_header->last == _header->first) {
+        // IntegrityCheck: all entries before _verifyPos are overwritten, it must not pass first
+        bool verified = _verifyPos == _header->first;
         _header->first++;
         if (_header->first == _header->end) {
             _header->first = _header->start;
         }
+        if (verified) {
+            _verifyPos = _header->first;
+        }
     }
-    _rsHeader.EncodeBlock(_header, _header->ecc);
-    flushCache();
+    linkEntry(act);
+
+    // only the entry and the header have to survive a reset, the links are rebuilt by IntegrityCheck
+    _cache.add(act, sizeof(dataEntryFEC_t));
+}
+
+void RamBuffer::commitHeader(bool full)
+{
+    // The header ecc is expensive -> write first and last with a CRC into the older slot
+    // and update the header ecc only periodically.
+    _seq++;
+    dataEntryCommit_t& commit = _header->commit[_seq & 1];
+    commit.seq = _seq;
+    commit.first = _header->first;
+    commit.last = _header->last;
+    commit.crc = Crc16::Calc(reinterpret_cast<uint8_t*>(&commit), offsetof(dataEntryCommit_t, crc));
+    _cache.add(&commit, sizeof(commit));
+
+    if (full || _seq - _header->base.seq >= HEADER_COMMIT_INTERVAL) {
+        _header->base = commit;
+        _rsHeader.EncodeBlock(_header, _header->ecc);
+        _cache.add(_header, offsetof(dataEntryHeader_t, first));
+    }
+}
+
+bool RamBuffer::isValidCommit(const dataEntryCommit_t& commit) const
+{
+    dataEntryCommit_t copy = commit;
+    if (copy.crc != static_cast<uint16_t>(Crc16::Calc(reinterpret_cast<uint8_t*>(&copy), offsetof(dataEntryCommit_t, crc)))) {
+        return false;
+    }
+    return isEntry(copy.first) && isEntry(copy.last);
+}
+
+bool RamBuffer::getEntry(uint16_t serial, time_t time, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(&serial, 1, time, time + 24 * 60 * 60, cursor, entry);
+}
+
+bool RamBuffer::getEntry(const std::vector<uint16_t>& serials, time_t time, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(serials.data(), serials.size(), time, time + 24 * 60 * 60, cursor, entry);
 }
 
-bool RamBuffer::getEntry(uint16_t serial, time_t time, dataEntry_t*& act)
+bool RamBuffer::getEntry(const std::vector<uint16_t>& serials, time_t from, time_t to, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    return getEntry(serials.data(), serials.size(), from, to, cursor, entry);
+}
+
+void RamBuffer::saveCursor(const RamBufferCursor& cursor, uint32_t& position, uint32_t& index) const
+{
+    // cursor.pos is the last returned entry
+    const dataEntryFEC_t* act = toFec(static_cast<dataEntry_t*>(cursor.pos));
+    position = act == nullptr ? 0 : getLastPosition() - (toIndex(_header->last) - toIndex(act) + _elements) % _elements;
+    index = 0;
+}
+
+bool RamBuffer::restoreCursor(uint32_t position, uint32_t index, const std::vector<uint16_t>& serials, RamBufferCursor& cursor) const
+{
+    uint32_t last = getLastPosition();
+    if (index != 0 || position < last - getUsedElements() || position >= last) {
+        return false;
+    }
+    // the last entry of the page: one of the serials of the query
+    dataEntryFEC_t* act = _header->start + position % _elements;
+    if (!isUsed(act) || std::find(serials.begin(), serials.end(), act->entry.serial) == serials.end()) {
+        return false;
+    }
+    cursor = RamBufferCursor();
+    cursor.pos = toEntry(act);
+    return true;
+}
+
+bool RamBuffer::getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, RamBufferCursor& cursor, dataEntry_t& entry)
+{
+    dataEntry_t* act = static_cast<dataEntry_t*>(cursor.pos);
+    bool found = getEntry(serials, count, time, to, act);
+    cursor.pos = act;
+    if (found) {
+        entry = *act;
+    }
+    return found;
+}
+
+bool RamBuffer::getEntry(const uint16_t* serials, size_t count, time_t time, time_t to, dataEntry_t*& act)
 {
     // start with _header->first, then increment
     if (act == nullptr) {
         act = findStart(time);
     } else if (act == toEntry(_header->last)) {
         return false;
+    } else if (count == 1) {
+        act = nextEntry(serials[0], act);
     } else {
-        act = toEntry(toFec(act) + 1);
+        // several serials: the links do not help, linear search
+        dataEntryFEC_t* next = toFec(act) + 1;
+        act = toEntry(next == _header->end ? _header->start : next);
     }
 
     for (int i = 0; i < 2; i++) {
         while (act < toEntry(_header->end)) {
 
             // end check
-            if (act->time >= time + 24 * 60 * 60 || act == toEntry(_header->last)) {
+            if (act->time >= to || act == toEntry(_header->last)) {
                 return false;
             }
 
             // ecc && serial && time check
-            if (act->time == 0 || serial != act->serial || act->time < time) {
+            if (act->time == 0 || std::find(serials, serials + count, act->serial) == serials + count || act->time < time) {
                 act = toEntry(toFec(act) + 1);
                 continue;
             }
@@ -150,6 +440,108 @@ bool RamBuffer::getEntry(uint16_t serial, time_t time, dataEntry_t*& act)
     return false;
 }
 
+dataEntry_t* RamBuffer::nextEntry(uint16_t serial, dataEntry_t* act)
+{
+    // Follow the link to the next entry with the same serial. If the link is unknown or does not fit (e.g. bit flip in
+    // the unprotected link array) continue with the following entry -> linear search in getEntry.
+    // Readers run without lock (see RamDriveClass), so only the entries and links are used here, not _tail.
+    dataEntryFEC_t* fec = toFec(act);
+    dataEntryFEC_t* next = fec + 1;
+
+    if (act->serial == serial && act->time != 0) {
+        dataEntryLink_t link = _links[toIndex(fec)];
+
+        // not behind _header->last: a link over last ends in the oldest entries, the walk would not end
+        dataEntryFEC_t* last = _header->last;
+        size_t toLast = last >= fec ? last - fec : (_header->end - fec) + (last - _header->start);
+        if (link != LINK_NONE && link < toLast) {
+            dataEntryFEC_t* target = fec + link;
+            if (target >= _header->end) {
+                target -= _header->end - _header->start;
+            }
+            if (isUsed(target) && (link == LINK_FAR || (target->entry.serial == serial && target->entry.time >= act->time))) {
+                next = target;
+            }
+        }
+    }
+
+    if (next == _header->end) {
+        next = _header->start;
+    }
+    return toEntry(next);
+}
+
+bool RamBuffer::isEntry(const dataEntryFEC_t* entry) const
+{
+    // a pointer read back from PSRAM: in the ring and on the start of an entry, otherwise the walks never reach it
+    const uintptr_t pos = reinterpret_cast<uintptr_t>(entry);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(_header->start);
+    return entry >= _header->start && entry < _header->end && (pos - start) % sizeof(dataEntryFEC_t) == 0;
+}
+
+bool RamBuffer::isUsed(const dataEntryFEC_t* entry) const
+{
+    if (_header->last >= _header->first) {
+        return entry >= _header->first && entry < _header->last;
+    }
+    return (entry >= _header->first && entry < _header->end) || (entry >= _header->start && entry < _header->last);
+}
+
+void RamBuffer::linkEntry(dataEntryFEC_t* entry)
+{
+    // entry is the newest one of its serial -> link the previous one to it
+    _links[toIndex(entry)] = LINK_NONE;
+    if (entry->entry.time == 0) {
+        return; // ecc error, serial is not reliable
+    }
+
+    auto it = _tail.find(entry->entry.serial);
+    if (it != _tail.end()) {
+        dataEntryFEC_t* prev = it->second;
+        if (prev != entry && isUsed(prev) && prev->entry.serial == entry->entry.serial) {
+            size_t distance = entry >= prev ? entry - prev : (_header->end - prev) + (entry - _header->start);
+            _links[toIndex(prev)] = distance >= LINK_FAR ? LINK_FAR : static_cast<dataEntryLink_t>(distance);
+        }
+        it->second = entry;
+    } else {
+        _tail.emplace(entry->entry.serial, entry);
+    }
+}
+
+void RamBuffer::linkEntryBackward(dataEntryFEC_t* entry)
+{
+    // entry is the oldest verified one of its serial -> link it to the previous oldest one
+    _links[toIndex(entry)] = LINK_NONE;
+    if (entry->entry.time == 0) {
+        return;
+    }
+
+    auto it = _head.find(entry->entry.serial);
+    if (it != _head.end()) {
+        dataEntryFEC_t* next = it->second;
+        if (next != entry && isUsed(next) && next->entry.serial == entry->entry.serial) {
+            size_t distance = next >= entry ? next - entry : (_header->end - entry) + (next - _header->start);
+            _links[toIndex(entry)] = distance >= LINK_FAR ? LINK_FAR : static_cast<dataEntryLink_t>(distance);
+        }
+        it->second = entry;
+    } else {
+        // newest entry of this serial, unless a new one was written meanwhile
+        _head.emplace(entry->entry.serial, entry);
+        _tail.emplace(entry->entry.serial, entry);
+    }
+}
+
+void RamBuffer::rebuildLinks()
+{
+    _tail.clear();
+    for (dataEntryFEC_t* act = _header->first; act != _header->last;) {
+        linkEntry(act);
+        if (++act == _header->end) {
+            act = _header->start;
+        }
+    }
+}
+
 dataEntry_t* RamBuffer::findStart(time_t time)
 {
     size_t count = getUsedElements();
@@ -160,6 +552,11 @@ dataEntry_t* RamBuffer::findStart(time_t time)
     size_t capacity = _header->end - _header->start;
     size_t lo = 0, hi = count;
 
+    // only the verified entries from _verifyPos to last while IntegrityCheck is running
+    if (_verifyPos != nullptr && isUsed(_verifyPos)) {
+        lo = _verifyPos >= _header->first ? _verifyPos - _header->first : (_header->end - _header->first) + (_verifyPos - _header->start);
+    }
+
     while (lo < hi) {
         size_t mid = lo + (hi - lo) / 2;
 
@@ -185,55 +582,73 @@ dataEntry_t* RamBuffer::findStart(time_t time)
     return (lo >= count) ? toEntry(_header->last) : toEntry(result);
 }
 
-bool RamBuffer::getBackup(ResponseFiller& responseFiller)
+RamBufferSnapshot RamBuffer::getSnapshot()
 {
-    auto act = std::make_shared<uint8_t*>(nullptr);
+    uint32_t last = getLastPosition();
+    return { static_cast<uint32_t>(last - getUsedElements()), last };
+}
 
-    responseFiller = [this, act](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
-        size_t ret = 0;
-        if(alreadySent == 0) {
-            *act = reinterpret_cast<uint8_t*>(_header->first);
-        }
+bool RamBuffer::isSnapshotValid(const RamBufferSnapshot& snapshot) const
+{
+    uint32_t last = getLastPosition();
+    uint32_t first = last - getUsedElements();
+    return first <= snapshot.first && snapshot.first <= snapshot.last && snapshot.last <= last;
+}
 
-        size_t actLen = 0;
+size_t RamBuffer::getBackupSize(const RamBufferSnapshot& snapshot) const
+{
+    return (snapshot.last - snapshot.first) * sizeof(dataEntryFEC_t);
+}
 
-        // copy from first to end
-        if (*act < reinterpret_cast<uint8_t*>(_header->end)) {
-            actLen = min(maxLen, static_cast<size_t>(reinterpret_cast<uint8_t*>(_header->end) - *act));
+size_t RamBuffer::readBackup(const RamBufferSnapshot& snapshot, size_t offset, uint8_t* buffer, size_t len) const
+{
+    // the entries from first to last, the ring wraps from end to start
+    const size_t total = getBackupSize(snapshot);
+    const size_t ringSize = _elements * sizeof(dataEntryFEC_t);
+    size_t ret = 0;
+    len = offset < total ? min(len, total - offset) : 0;
+    while (ret < len) {
+        size_t pos = ((snapshot.first % _elements) * sizeof(dataEntryFEC_t) + offset + ret) % ringSize;
+        size_t count = min(len - ret, ringSize - pos);
+        memcpy(&buffer[ret], reinterpret_cast<const uint8_t*>(_header->start) + pos, count);
+        ret += count;
+    }
+    return ret;
+}
 
-            memcpy(buffer, *act, actLen);
-            ret += actLen;
-            *act += actLen;
-            buffer += actLen;
-            if(*act == reinterpret_cast<uint8_t*>(_header->end)) {
-                *act = reinterpret_cast<uint8_t*>(_header->start);
-            }
-        }
-        // copy from start to last
-        actLen = maxLen - actLen;
-        if(actLen > 0) {
-            actLen = min(actLen, static_cast<size_t>(reinterpret_cast<uint8_t*>(_header->last) - *act));
-
-            memcpy(buffer, *act, actLen);
-            ret += actLen;
-            *act += actLen;
+bool RamBuffer::getSnapshotEntry(const RamBufferSnapshot& snapshot, RamBufferCursor& cursor, dataEntry_t& entry) const
+{
+    while (cursor.position < snapshot.last - snapshot.first) {
+        const dataEntryFEC_t* act = _header->start + (snapshot.first + cursor.position) % _elements;
+        cursor.position++;
+        if (act->entry.time != 0) {
+            entry = act->entry;
+            return true;
         }
-        return ret;
-    };
-    return true;
+    }
+    return false;
 }
 
 bool RamBuffer::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
 {
     if(alreadyWritten == 0) {
+        if (len >= sizeof(RAMBUFFER_BACKUP_MAGIC) && memcmp(data, RAMBUFFER_BACKUP_MAGIC, sizeof(RAMBUFFER_BACKUP_MAGIC)) == 0) {
+            MessageOutput.println("RamBuffer::restoreBackup backup of a block format is not supported");
+            return false;
+        }
         PowerOnInitialize();
         _restorePos = reinterpret_cast<uint8_t*>(_header->first);
     }
+    if (_restorePos == nullptr) {
+        return false; // the restore was not started
+    }
 
     if(alreadyWritten <= getTotalElements() * sizeof(dataEntryFEC_t)) {
         len = min(len, getTotalElements() * sizeof(dataEntryFEC_t) - alreadyWritten);
-        memcpy(_restorePos, data, len);
-        _restorePos += len;
+        if (len > 0) {
+            memcpy(_restorePos, data, len);
+            _restorePos += len;
+        }
     }
     else
     {
@@ -244,10 +659,11 @@ bool RamBuffer::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t
         // adjust _header->last
         size_t entries = (_restorePos - reinterpret_cast<uint8_t*>(_header->first)) / sizeof(dataEntryFEC_t);
         _header->last = _header->first + entries;
-        _rsHeader.EncodeBlock(_header, _header->ecc);
+        commitHeader(true);
+        rebuildLinks();
         MessageOutput.printf("RamBuffer::restoreBackup final entries=%d, first=%d, last=%d\r\n", entries, toIndex(_header->first), toIndex(_header->last));
 
-        flushCache();
+        _cache.flushAll();
         _restorePos = nullptr;
     }
 
@@ -256,11 +672,5 @@ bool RamBuffer::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t
 
 void RamBuffer::flushCache()
 {
-    if (_cache != nullptr) {
-        // Here _cache is used to read from another PSRAM area and thus trigger a flush of the PSRAM-cache to the PSRAM.
-        volatile uint32_t sum = 0;
-        for (uint32_t i = 0; i < 64 * 1024 / sizeof(uint32_t); i++) {
-            sum += ((volatile uint32_t*)_cache)[i];
-        }
-    }
+    _cache.flush();
 }
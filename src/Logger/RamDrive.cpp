@@ -4,8 +4,13 @@
  */
 
 #include "Logger/RamDrive.h"
+#include "Logger/GraphData.h"
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/RamBuffer.h"
 #include "MessageOutput.h"
 #include "PinMapping.h"
+#include <algorithm>
+#include <limits>
 #include <memory>
 
 RamDriveClass* pRamDrive = nullptr;
@@ -15,12 +20,41 @@ size_t RamDriveClass::_ramDriveSize = 0;
 uint8_t* RamDriveClass::_cache = nullptr;
 size_t RamDriveClass::_cacheSize = 0;
 
-RamDriveClass::RamDriveClass()
+RamDriveClass::RamDriveClass(RamBufferFormat format)
+    : _verifyTask(10 * TASK_MILLISECOND, TASK_FOREVER, std::bind(&RamDriveClass::verify, this))
+    , _drainTask(TASK_SECOND, TASK_FOREVER, std::bind(&RamDriveClass::drain, this))
+    , _rebuildTask(10 * TASK_MILLISECOND, TASK_FOREVER, std::bind(&RamDriveClass::rebuildTiles, this))
+    , _countTask(TASK_MILLISECOND, TASK_FOREVER, std::bind(&RamDriveClass::countBackupStream, this))
+    , _backupEpoch(esp_random())
 {
-    _ramBuffer = new RamBuffer(_ramDrive, _ramDriveSize, _cache, _cacheSize);
+    // the tiles are placed behind the RamBuffer, only if PSRAM is available
+    size_t tileSize = _cache != nullptr ? (_ramDriveSize / RAMDRIVE_TILE_DIVISOR) & ~7 : 0;
+    size_t bufferSize = _ramDriveSize - tileSize;
+
+    if (format == RamBufferFormat::Entry) {
+        _ramBuffer = new RamBuffer(_ramDrive, bufferSize, _cache, _cacheSize);
+        _verifyCount = RAMDRIVE_VERIFY_ENTRIES;
+    } else {
+        _ramBuffer = new RamBlockBuffer(_ramDrive, bufferSize, _cache, _cacheSize, format);
+        _verifyCount = RAMDRIVE_VERIFY_BLOCKS;
+    }
+    _tiles = new TileIndex(_ramDrive + bufferSize, tileSize, _cache, _cacheSize);
     startupCheck();
 }
 
+void RamDriveClass::init(Scheduler& scheduler)
+{
+    scheduler.addTask(_verifyTask);
+    _verifyTask.enable();
+    scheduler.addTask(_drainTask);
+    _drainTask.enable();
+    scheduler.addTask(_rebuildTask);
+    scheduler.addTask(_countTask);
+    if (_tilesRebuild) {
+        _rebuildTask.enable(); // a task is enabled once it has a scheduler
+    }
+}
+
 void RamDriveClass::AllocateRamDrive()
 {
     if (ESP.getPsramSize() > 0) // PSRAM available
@@ -58,47 +92,462 @@ void RamDriveClass::FreeRamDrive()
 
 void RamDriveClass::writeValue(uint16_t serial, time_t time, float value)
 {
-    if(_restoreInProgress) {
-        return;
+    dataEntry_t entry = { serial, time, value };
+    writeBatch(&entry, 1);
+}
+
+void RamDriveClass::writeBatch(const dataEntry_t* entries, size_t count)
+{
+    // Always staged first, so the order is kept if the RamDrive is busy. The rest is written by _drainTask.
+    for (size_t i = 0; i < count; i++) {
+        _staging.push(entries[i]);
     }
-    if(_mutexRamDrive.TryLock(0, 100))
+    drain();
+}
+
+void RamDriveClass::drain()
+{
+    while (!_restoreInProgress && !_mergeInProgress && !_staging.empty()) {
+        if (!_mutexRamDrive.TryLock(0, 100)) {
+            return;
+        }
+
+        dataEntry_t batch[RAMDRIVE_DRAIN_BATCH];
+        size_t count = 0;
+        while (count < RAMDRIVE_DRAIN_BATCH && _staging.pop(batch[count])) {
+            count++;
+        }
+
+        _seqLock.writeBegin();
+        for (size_t i = 0; i < count && !_tilesRebuild; i++) {
+            _tiles->writeValue(batch[i].serial, batch[i].time, batch[i].value);
+        }
+        _ramBuffer->writeBatch(batch, count);
+        _seqLock.writeEnd();
+        _tiles->flushCache();
+        _mutexRamDrive.unlock();
+    }
+}
+
+// Read state of getFile and getTileFile. It is copied before every chunk, so a chunk can be read again if the
+// writer changed the RamDrive meanwhile.
+struct RamDriveQuery {
+    RamDriveQuery(const std::vector<uint16_t>& serials, time_t start, uint32_t length, int level, uint32_t maxPoints, GraphDataFormat format)
+        : serials(serials)
+        , start(start)
+        , length(length)
+        , to(getEnd(start, length))
+        , level(level)
+        , format(format)
+        , decimator(start, length, maxPoints, serials.size())
+        , writer(start, level < 0 ? 1 : 3, serials.size() > 1)
+    {
+    }
+
+    // behind start + length, without overflow of time_t
+    static time_t getEnd(time_t start, uint32_t length)
+    {
+        int64_t end = static_cast<int64_t>(start) + length + 1;
+        return end > std::numeric_limits<time_t>::max() ? std::numeric_limits<time_t>::max() : end;
+    }
+
+    // next value to send, with max_points only the min/max of the buckets
+    bool next(IRamBuffer* ramBuffer, dataEntry_t& entry, uint8_t& index)
     {
-        _ramBuffer->writeValue(serial, time, value);
+        time_t time;
+        float value;
+        while (!decimator.next(index, time, value)) {
+            if (end) {
+                return false;
+            }
+            if ((limit > 0 && count == limit) || !ramBuffer->getEntry(serials, start, to, cursor, entry)) {
+                end = true;
+                decimator.finish();
+                continue;
+            }
+            count++;
+            decimator.add(std::find(serials.begin(), serials.end(), entry.serial) - serials.begin(), entry.time, entry.value);
+        }
+        entry.serial = serials[index];
+        entry.time = time;
+        entry.value = value;
+        return true;
+    }
+
+    size_t fill(IRamBuffer* ramBuffer, TileIndex* tiles, uint8_t* buffer, size_t maxLen);
+
+    std::vector<uint16_t> serials;
+    time_t start;
+    uint32_t length;
+    time_t to;
+    int level; // tile level, -1 for the raw values
+    GraphDataFormat format;
+    RamBufferCursor cursor;
+    TileCursor tileCursor;
+    GraphDecimator decimator;
+    GraphDataWriter writer;
+    uint32_t limit = 0; // raw values read at most, 0: all
+    uint32_t count = 0;
+    bool end = false;
+};
+
+size_t RamDriveQuery::fill(IRamBuffer* ramBuffer, TileIndex* tiles, uint8_t* buffer, size_t maxLen)
+{
+    dataEntry_t entry;
+    dataTile_t tile;
+    uint8_t index;
+    bool tagged = serials.size() > 1;
+
+    if (format == GraphDataFormat::Binary) {
+        // no padding needed, the writer fills every buffer until the end of the data
+        writer.begin(buffer, maxLen);
+        while (!writer.full()) {
+            if (level < 0) {
+                if (!next(ramBuffer, entry, index)) {
+                    break;
+                }
+                float value = entry.value; // entry is packed
+                writer.add(entry.time, &value, index);
+            } else {
+                if (!tiles->getTile(serials, start, length, level, tileCursor, tile)) {
+                    break;
+                }
+                float values[] = { tile.sum / tile.count, tile.min, tile.max };
+                writer.add(tile.time, values, std::find(serials.begin(), serials.end(), tile.serial) - serials.begin());
+            }
+        }
+        return writer.end();
+    }
+
+    size_t ret = 0;
+    const int LineSize = 46; // typically 17, with serial 22, tiles up to 40
+    while (maxLen - ret > LineSize) {
+        // e.g. 1766675463;19.12\n, several sensors 3f2a;1766675463;19.12\n
+        // tiles time;avg;min;max e.g. 1766675460;19.12;18.94;19.31\n
+        int written = 0;
+        if (level < 0) {
+            if (!next(ramBuffer, entry, index)) {
+                break;
+            }
+            if (tagged) {
+                written = snprintf((char*)&buffer[ret], LineSize, "%x;", entry.serial);
+            }
+            written += snprintf((char*)&buffer[ret + written], LineSize - written, "%ld;%.2f\n", entry.time, entry.value);
+        } else {
+            if (!tiles->getTile(serials, start, length, level, tileCursor, tile)) {
+                break;
+            }
+            if (tagged) {
+                written = snprintf((char*)&buffer[ret], LineSize, "%x;", tile.serial);
+            }
+            written += snprintf((char*)&buffer[ret + written], LineSize - written, "%ld;%.2f;%.2f;%.2f\n", tile.time, tile.sum / tile.count, tile.min, tile.max);
+        }
+        ret += written;
+    }
+
+    if (ret > 0) { // important to fill the buffer completely, otherwise chunked response ends too early
+        for(; ret < maxLen; ret++) {
+            buffer[ret] = (ret == maxLen - 1) ? '\n' : ' ';
+        }
+    }
+    return ret;
+}
+
+bool RamDriveClass::getFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller)
+{
+    if (serials.empty() || serials.size() > UINT8_MAX) {
+        return false;
+    }
+    return getQueryFile(std::make_shared<RamDriveQuery>(serials, start, length, -1, maxPoints, format), responseFiller);
+}
+
+bool RamDriveClass::getTileFile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, uint32_t resolution, GraphDataFormat format, ResponseFiller& responseFiller)
+{
+    int level = _tiles->getLevel(resolution);
+    if (level < 0 || _tilesRebuild || serials.empty() || serials.size() > UINT8_MAX) {
+        return false;
+    }
+    // dropped tiles: the entries with max_points instead of a shortened result
+    bool covered = false;
+    if (!readConsistent([&]() { covered = _tiles->covers(serials, start, level); }) || !covered) {
+        return false;
+    }
+    return getQueryFile(std::make_shared<RamDriveQuery>(serials, start, length, level, 0, format), responseFiller);
+}
+
+bool RamDriveClass::getRange(RangeQuery& range, GraphDataFormat format, ResponseFiller& responseFiller)
+{
+    if (_restoreInProgress || range.serials.empty() || range.serials.size() > UINT8_MAX || range.to <= range.from) {
+        return false;
+    }
+
+    // cursor: epoch of this start, position and index of the last entry sent (see IRamBuffer::saveCursor), its time
+    bool resume = false;
+    time_t from = range.from;
+    uint32_t position = 0, index = 0;
+    if (!range.cursor.isEmpty()) {
+        unsigned epoch, pos, idx, time;
+        if (sscanf(range.cursor.c_str(), "%8x-%x-%x-%x", &epoch, &pos, &idx, &time) != 4) {
+            return false;
+        }
+        resume = epoch == _backupEpoch;
+        position = pos;
+        index = idx;
+        from = max<time_t>(from, time);
+    }
+
+    // Dry run of the page for the cursor of the next one, the response needs it before the data. If the position is
+    // overwritten (or after a reboot) the page starts again at the time of the cursor, values of this second can be
+    // sent twice.
+    std::shared_ptr<RamDriveQuery> query;
+    bool more = false;
+    uint32_t nextPosition = 0, nextIndex = 0;
+    time_t nextTime = 0;
+    if (!readConsistent([&]() {
+            RamBufferCursor cursor;
+            time_t start = from;
+            if (resume && _ramBuffer->restoreCursor(position, index, range.serials, cursor)) {
+                start = range.from;
+            }
+            query = std::make_shared<RamDriveQuery>(range.serials, start, range.to - start - 1, -1, 0, format);
+            query->cursor = cursor;
+            query->limit = range.limit;
+            more = false;
+            if (range.limit == 0) {
+                return;
+            }
+
+            dataEntry_t entry;
+            uint32_t count = 0;
+            while (count < range.limit && _ramBuffer->getEntry(range.serials, start, range.to, cursor, entry)) {
+                count++;
+            }
+            if (count == range.limit) {
+                _ramBuffer->saveCursor(cursor, nextPosition, nextIndex);
+                nextTime = entry.time;
+                more = _ramBuffer->getEntry(range.serials, start, range.to, cursor, entry);
+            }
+        })) {
+        return false;
+    }
+
+    range.cursor = "";
+    if (more) {
+        char cursor[48];
+        snprintf(cursor, sizeof(cursor), "%08x-%x-%x-%x", static_cast<unsigned>(_backupEpoch), static_cast<unsigned>(nextPosition), static_cast<unsigned>(nextIndex), static_cast<unsigned>(nextTime));
+        range.cursor = cursor;
+    }
+    return getQueryFile(query, responseFiller);
+}
+
+bool RamDriveClass::getQueryFile(std::shared_ptr<RamDriveQuery> query, ResponseFiller& responseFiller)
+{
+    if (_restoreInProgress) {
+        return false;
+    }
+
+    responseFiller = [this, query](uint8_t* buffer, size_t maxLen, size_t) -> size_t {
+        if (_restoreInProgress) {
+            return 0;
+        }
+        size_t ret = 0;
+        RamDriveQuery saved = *query;
+        if (!readConsistent([&]() {
+                *query = saved;
+                ret = query->fill(_ramBuffer, _tiles, buffer, maxLen);
+            })) {
+            return 0;
+        }
+        return ret;
+    };
+    return true;
+}
+
+bool RamDriveClass::readConsistent(const std::function<void()>& read)
+{
+    // No lock for the readers: the read is valid if no write happened meanwhile, otherwise it is repeated at once.
+    // A write takes a batch of values, a reader meeting it yields. If the writer is busy (or has a lower priority,
+    // yield does not run it), the writers are locked out for one read: the lock waits for the running write.
+    for (uint8_t retry = 0; retry < RAMDRIVE_READ_RETRIES; retry++) {
+        uint32_t seq = _seqLock.readBegin();
+        if (_mergeInProgress) {
+            return false;
+        }
+        if ((seq & 1) != 0) {
+            yield();
+            continue;
+        }
+        read();
+        if (_seqLock.readValid(seq)) {
+            return true;
+        }
+        _readRetries++;
+    }
+
+    if (!_mutexRamDrive.TryLock(100, 1500)) {
+        MessageOutput.println("RamDrive: read aborted, writer busy");
+        return false;
+    }
+    if (_mergeInProgress) {
         _mutexRamDrive.unlock();
+        return false;
     }
+    read();
+    _mutexRamDrive.unlock();
+    return true;
 }
 
-bool RamDriveClass::getFile(uint16_t serial, time_t start, uint32_t length, ResponseFiller& responseFiller)
+bool RamDriveClass::getBackup(BackupRange& range, ResponseFiller& responseFiller)
 {
-    if(!_mutexRamDrive.TryLock(100, 1500))
-    {
+    if (_restoreInProgress || _mergeInProgress) {
         return false;
     }
 
-    auto act = std::make_shared<dataEntry_t*>(nullptr);
+    // id: epoch of this start, first and last position
+    RamBufferSnapshot snapshot;
+    if (range.snapshot.isEmpty()) {
+        if (!_mutexRamDrive.TryLock(100, 1000)) {
+            return false;
+        }
+        _seqLock.writeBegin();
+        snapshot = _ramBuffer->getSnapshot(); // can seal a block
+        _seqLock.writeEnd();
+        _mutexRamDrive.unlock();
+
+        char id[32];
+        snprintf(id, sizeof(id), "%08x-%x-%x", static_cast<unsigned>(_backupEpoch), static_cast<unsigned>(snapshot.first), static_cast<unsigned>(snapshot.last));
+        range.snapshot = id;
+    } else {
+        unsigned epoch, first, last;
+        if (sscanf(range.snapshot.c_str(), "%8x-%x-%x", &epoch, &first, &last) != 3 || epoch != _backupEpoch) {
+            return false;
+        }
+        snapshot = { first, last };
+    }
+
+    if (range.compressed) {
+        return getBackupStream(range, snapshot, responseFiller);
+    }
+
+    bool valid = false;
+    if (!readConsistent([&]() {
+            valid = _ramBuffer->isSnapshotValid(snapshot);
+            range.total = valid ? _ramBuffer->getBackupSize(snapshot) : 0;
+        })
+        || !valid) {
+        return false;
+    }
+    range.offset = min(range.offset, range.total);
+    range.length = min(range.length, range.total - range.offset);
 
-    responseFiller = [this, act, serial, start, length](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+    // no lock until the end of the response, a restore or overwritten data ends it early
+    size_t offset = range.offset;
+    size_t length = range.length;
+    responseFiller = [this, snapshot, offset, length](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+        if (_restoreInProgress || alreadySent >= length) {
+            return 0;
+        }
+        bool valid = false;
         size_t ret = 0;
+        if (!readConsistent([&]() {
+                valid = _ramBuffer->isSnapshotValid(snapshot);
+                ret = valid ? _ramBuffer->readBackup(snapshot, offset + alreadySent, buffer, min(maxLen, length - alreadySent)) : 0;
+            })) {
+            return 0;
+        }
+        if (!valid) {
+            MessageOutput.println("RamDrive: backup snapshot overwritten");
+        }
+        return ret;
+    };
+    return true;
+}
 
-        //MessageOutput.printf("responseFiller 0x%X, maxLen:%d, alreadySent:%d, start:%ld, length:%d\r\n", serial, maxLen, alreadySent, start, length);
-        const int EntrySize = 20; // typically entry count 17
-        while (maxLen - ret > EntrySize) {
-            if (!_ramBuffer->getEntry(serial, start, *act)) {
-                break;
+// Encoder state of a compressed backup. The entries of a snapshot do not change, they are read without lock and
+// the snapshot is checked afterwards.
+struct RamDriveBackupStream {
+    RamDriveBackupStream(const RamBufferSnapshot& snapshot)
+        : snapshot(snapshot)
+    {
+    }
+
+    // buffer == nullptr: only count (skip) maxLen bytes
+    size_t fill(IRamBuffer* ramBuffer, uint8_t* buffer, size_t maxLen)
+    {
+        encoder.begin(buffer, maxLen);
+        dataEntry_t entry;
+        while (!encoder.full() && !finished) {
+            if (ramBuffer->getSnapshotEntry(snapshot, cursor, entry)) {
+                encoder.add(entry);
+            } else {
+                encoder.finish();
+                finished = true;
             }
-            if ((*act)->time > start + length) {
-                break;
+        }
+        return encoder.end();
+    }
+
+    RamBufferSnapshot snapshot;
+    RamBufferCursor cursor;
+    BackupStreamEncoder encoder;
+    bool finished = false;
+};
+
+bool RamDriveClass::isSnapshotValid(const RamBufferSnapshot& snapshot)
+{
+    bool valid = false;
+    return readConsistent([&]() { valid = _ramBuffer->isSnapshotValid(snapshot); }) && valid;
+}
+
+bool RamDriveClass::getBackupStream(BackupRange& range, const RamBufferSnapshot& snapshot, ResponseFiller& responseFiller)
+{
+    // The size is known after the snapshot was encoded once, it is kept for the following parts. It is counted by
+    // _countTask, until then the request is answered with pending (one snapshot at a time). A part continues the
+    // state at the end of the previous part, otherwise it is encoded from the start up to its offset.
+    if (!isSnapshotValid(snapshot)) {
+        return false;
+    }
+
+    std::shared_ptr<RamDriveBackupStream> stream;
+    {
+        std::lock_guard<std::mutex> lock(_mutexBackupStream);
+        if (_backupStreamId != range.snapshot) {
+            if (!_backupStreamCounter) {
+                _backupStreamCountId = range.snapshot;
+                _backupStreamCounter = std::make_shared<RamDriveBackupStream>(snapshot);
+                _countTask.enable();
             }
-            // e.g. 1766675463;19.12\n
-            int written = snprintf((char*)&buffer[ret], EntrySize, "%ld;%.2f\n", (*act)->time, (*act)->value);
-            ret += written;
+            range.pending = true;
+            return false;
         }
+        range.total = _backupStreamTotal;
+        range.offset = min(range.offset, range.total);
+        range.length = min(range.length, range.total - range.offset);
+
+        if (_backupStreamCheckpoint && _backupStreamCheckpoint->encoder.getPosition() <= range.offset) {
+            stream = std::make_shared<RamDriveBackupStream>(*_backupStreamCheckpoint);
+        }
+    }
+    if (!stream) {
+        stream = std::make_shared<RamDriveBackupStream>(snapshot);
+    }
+    stream->fill(_ramBuffer, nullptr, range.offset - stream->encoder.getPosition());
 
-        if (ret == 0) {
-            _mutexRamDrive.unlock();
-        } else { // important to fill the buffer completely, otherwise chunked response ends too early
-            for(; ret < maxLen; ret++) {
-                buffer[ret] = (ret == maxLen - 1) ? '\n' : ' ';
+    String id = range.snapshot;
+    size_t length = range.length;
+    responseFiller = [this, stream, id, length](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+        if (_restoreInProgress || alreadySent >= length) {
+            return 0;
+        }
+        size_t ret = stream->fill(_ramBuffer, buffer, min(maxLen, length - alreadySent));
+        if (!isSnapshotValid(stream->snapshot)) {
+            MessageOutput.println("RamDrive: backup snapshot overwritten");
+            return 0;
+        }
+        if (alreadySent + ret == length) {
+            std::lock_guard<std::mutex> lock(_mutexBackupStream);
+            if (_backupStreamId == id) {
+                _backupStreamCheckpoint = std::make_shared<RamDriveBackupStream>(*stream);
             }
         }
         return ret;
@@ -106,19 +555,43 @@ bool RamDriveClass::getFile(uint16_t serial, time_t start, uint32_t length, Resp
     return true;
 }
 
-bool RamDriveClass::getBackup(ResponseFiller& responseFiller)
+void RamDriveClass::countBackupStream()
 {
-    if(_mutexRamDrive.TryLock(100, 20000))
+    // the entries are read without lock like a part of the backup, the snapshot is checked afterwards
+    std::shared_ptr<RamDriveBackupStream> counter;
     {
-        return _ramBuffer->getBackup(responseFiller);
+        std::lock_guard<std::mutex> lock(_mutexBackupStream);
+        counter = _backupStreamCounter;
     }
-    return false;
+    bool valid = counter && !_restoreInProgress;
+    if (valid) {
+        counter->fill(_ramBuffer, nullptr, RAMDRIVE_COUNT_BYTES);
+        valid = isSnapshotValid(counter->snapshot);
+    }
+    if (valid && !counter->finished) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutexBackupStream);
+    if (valid) {
+        counter->fill(_ramBuffer, nullptr, SIZE_MAX); // the part of the trailer behind the last step
+        _backupStreamId = _backupStreamCountId;
+        _backupStreamTotal = counter->encoder.getPosition();
+        _backupStreamCheckpoint.reset();
+    } // else overwritten while counting, the next request of the snapshot fails
+    _backupStreamCounter.reset();
+    _backupStreamCountId = "";
+    _countTask.disable();
 }
 
 bool RamDriveClass::restoreBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
 {
     if(alreadyWritten == 0)
     {
+        if(_mergeInProgress)
+        {
+            return false;
+        }
         _restoreInProgress = true;
         if(!_mutexRamDrive.TryLock(100, 20000))
         {
@@ -127,23 +600,216 @@ bool RamDriveClass::restoreBackup(size_t alreadyWritten, const uint8_t* data, si
         }
     }
 
-    bool rc = _ramBuffer->restoreBackup(alreadyWritten, data, len, final);
+    if(!_restoreInProgress)
+    {
+        return false;
+    }
+
+    _seqLock.writeBegin();
+    if (alreadyWritten == 0) {
+        // the compressed format can be restored into every format
+        _restoreDecoder.reset();
+        if (len >= sizeof(BACKUPSTREAM_MAGIC) && memcmp(data, BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC)) == 0) {
+            _restoreDecoder = std::make_unique<BackupStreamDecoder>();
+            _ramBuffer->PowerOnInitialize();
+        }
+    }
+    bool rc = _restoreDecoder ? restoreBackupStream(data, len, final) : _ramBuffer->restoreBackup(alreadyWritten, data, len, final);
+    if (final || !rc) {
+        resetTiles(); // of the restored entries, or of the initialized RamDrive
+    }
+    _seqLock.writeEnd();
 
-    if(final)
+    if(final || !rc)
     {
         _mutexRamDrive.unlock();
         _restoreInProgress = false;
+        drain(); // values staged during the restore
+    }
+    return rc;
+}
+
+bool RamDriveClass::restoreBackupStream(const uint8_t* data, size_t len, bool final)
+{
+    std::vector<dataEntry_t> entries;
+    bool rc = _restoreDecoder->write(data, len, entries);
+    if (!entries.empty()) {
+        _ramBuffer->writeBatch(entries.data(), entries.size());
     }
+
+    if (rc && final && !_restoreDecoder->finished()) {
+        rc = false; // trailer missing
+    }
+    if (!rc) {
+        // no partial restore of a corrupt backup
+        MessageOutput.printf("RamDrive: compressed backup corrupt after %u entries\r\n", static_cast<unsigned>(_restoreDecoder->getCount()));
+        _ramBuffer->PowerOnInitialize();
+    } else if (final) {
+        MessageOutput.printf("RamDrive: compressed backup restored, %u entries\r\n", static_cast<unsigned>(_restoreDecoder->getCount()));
+    }
+    if (final || !rc) {
+        _restoreDecoder.reset();
+    }
+    return rc;
+}
+
+bool RamDriveClass::mergeBackup(size_t alreadyWritten, const uint8_t* data, size_t len, bool final)
+{
+    // The entries of a compressed backup are inserted in batches, see mergeEntries.
+    if (alreadyWritten == 0) {
+        _mergeDecoder.reset();
+        _mergeEntries.clear();
+        _mergeCount = 0;
+        if (_restoreInProgress || _ramBuffer->getFormat() != RamBufferFormat::Entry || getVerifyProgress() < 100) {
+            MessageOutput.println("RamDrive: merge needs the entry format and a verified RamDrive");
+            return false;
+        }
+        if (len < sizeof(BACKUPSTREAM_MAGIC) || memcmp(data, BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC)) != 0) {
+            MessageOutput.println("RamDrive: merge needs a compressed backup");
+            return false;
+        }
+        _mergeDecoder = std::make_unique<BackupStreamDecoder>();
+    }
+    if (!_mergeDecoder) {
+        return false;
+    }
+
+    bool rc = _mergeDecoder->write(data, len, _mergeEntries);
+    if (rc && final && !_mergeDecoder->finished()) {
+        rc = false; // trailer missing
+    }
+    if (rc && (final || _mergeEntries.size() >= RAMDRIVE_MERGE_BATCH)) {
+        rc = mergeEntries();
+    }
+
+    if (!rc) {
+        // the batches merged until now are kept
+        MessageOutput.printf("RamDrive: merge aborted after %u entries\r\n", static_cast<unsigned>(_mergeCount));
+    } else if (final) {
+        MessageOutput.printf("RamDrive: merged %u of %u entries\r\n", static_cast<unsigned>(_mergeCount), static_cast<unsigned>(_mergeDecoder->getCount()));
+    }
+    if (_mergeCount > 0 && (final || !rc)) {
+        // the tiles are ordered by time, the merged entries can be older than the newest ones
+        _rebuildPosition = 0;
+        _tilesRebuild = true;
+        _rebuildTask.enable();
+    }
+    if (final || !rc) {
+        _mergeDecoder.reset();
+        std::vector<dataEntry_t>().swap(_mergeEntries);
+    }
+    return rc;
+}
+
+bool RamDriveClass::mergeEntries()
+{
+    // A batch moves up to all stored entries. It is merged in steps of RAMDRIVE_MERGE_STEP entries, the lock is
+    // released in between. Until the last step the entries are not consistent: drain keeps the values staged and
+    // the readers fail.
+    if (_mergeEntries.empty()) {
+        return true;
+    }
+    if (!_mutexRamDrive.TryLock(1000, RAMDRIVE_MERGE_LOCK_MS)) {
+        return false;
+    }
+    _mergeInProgress = true;
+    _seqLock.writeBegin();
+    bool rc = _ramBuffer->beginMerge(_mergeEntries.data(), _mergeEntries.size());
+    _seqLock.writeEnd();
+    _mutexRamDrive.unlock();
+
+    size_t merged = 0;
+    for (bool finished = !rc; !finished;) {
+        yield();
+        if (!_mutexRamDrive.TryLock(1000, RAMDRIVE_MERGE_LOCK_MS)) {
+            continue; // the merge can not be left half done, the lock is forced after the maxUse of its holder
+        }
+        _seqLock.writeBegin();
+        finished = _ramBuffer->continueMerge(RAMDRIVE_MERGE_STEP, merged);
+        _seqLock.writeEnd();
+        _mutexRamDrive.unlock();
+    }
+    _mergeInProgress = false;
+
+    _mergeCount += merged;
+    _mergeEntries.clear();
+    drain(); // values staged during the merge
     return rc;
 }
 
+void RamDriveClass::rebuildTiles()
+{
+    // In steps from the oldest entry, until it has reached the newest one. Meanwhile drain does not write the tiles
+    // and getTileFile falls back to the entries.
+    if (_mergeInProgress || !_mutexRamDrive.TryLock(0, 100)) {
+        return;
+    }
+
+    _seqLock.writeBegin();
+    if (_rebuildPosition == 0) {
+        _tiles->PowerOnInitialize();
+    }
+    RamBufferSnapshot snapshot = _ramBuffer->getSnapshot();
+    snapshot.first = max(snapshot.first, _rebuildPosition);
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    for (size_t i = 0; i < RAMDRIVE_REBUILD_ENTRIES && _ramBuffer->getSnapshotEntry(snapshot, cursor, entry); i++) {
+        _tiles->writeValue(entry.serial, entry.time, entry.value);
+    }
+    _rebuildPosition = snapshot.first + cursor.position;
+    if (_rebuildPosition == snapshot.last) {
+        _tilesRebuild = false;
+        _rebuildTask.disable();
+    }
+    _seqLock.writeEnd();
+    _tiles->flushCache();
+    _mutexRamDrive.unlock();
+}
+
+void RamDriveClass::resetTiles()
+{
+    _tiles->PowerOnInitialize();
+    _rebuildPosition = 0;
+    _tilesRebuild = true;
+    _rebuildTask.enable();
+}
+
 void RamDriveClass::startupCheck()
 {
-    if (!_ramBuffer->IntegrityCheck()) {
-        MessageOutput.printf("Initialize empty RamDrive with %d entries. ", _ramBuffer->getTotalElements());
+    // The entries are verified in the background by _verifyTask. After a software reset the PSRAM was in use
+    // until now -> only the header is checked.
+    bool warmReset = esp_reset_reason() == ESP_RST_SW;
+    bool found = _ramBuffer->beginIntegrityCheck(!warmReset);
+    if (!found) {
+        MessageOutput.printf("Initialize empty RamDrive with %d bytes. ", _ramBuffer->getTotalBytes());
         _ramBuffer->PowerOnInitialize();
     } else {
-        MessageOutput.printf("Initialize RamDrive. %d entries found. %.2f percent used. ", _ramBuffer->getUsedElements(), _ramBuffer->getUsedElements() * 100.0f / _ramBuffer->getTotalElements());
+        MessageOutput.printf("Initialize RamDrive. %d bytes found. %.2f percent used. ", _ramBuffer->getUsedBytes(), _ramBuffer->getUsedBytes() * 100.0f / _ramBuffer->getTotalBytes());
+    }
+    // tiles of other entries are not valid, the task is enabled by init
+    if (!found || !_tiles->IntegrityCheck()) {
+        resetTiles();
+    }
+}
+
+void RamDriveClass::verify()
+{
+    if (!_mutexRamDrive.TryLock(0, 100)) {
+        return;
+    }
+
+    _seqLock.writeBegin();
+    IntegrityState state = _ramBuffer->continueIntegrityCheck(_verifyCount);
+    if (state == IntegrityState::Failed) {
+        MessageOutput.printf("Initialize empty RamDrive with %d bytes.\r\n", _ramBuffer->getTotalBytes());
+        _ramBuffer->PowerOnInitialize();
+        resetTiles();
+    }
+    _seqLock.writeEnd();
+    _mutexRamDrive.unlock();
+
+    if (state != IntegrityState::Verifying) {
+        _verifyTask.disable();
     }
 }
 
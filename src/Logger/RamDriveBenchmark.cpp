@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#ifdef RAMDRIVE_BENCHMARK
+
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/RamBuffer.h"
+#include "Logger/RamDrive.h"
+#include "MessageOutput.h"
+#include <memory>
+#include <new>
+
+// Samples per second of writeBatch for the batch sizes of a DS18B20 poll. The buffer is a scratch area, the
+// RamDrive itself is not touched, but the same cache is used for the write back.
+void RamDriveClass::Benchmark()
+{
+    const size_t Samples = 3000;
+    const size_t Sensors = 30;
+    const size_t BatchSizes[] = { 1, 8, 30 };
+    const RamBufferFormat Formats[] = { RamBufferFormat::Entry, RamBufferFormat::Block, RamBufferFormat::Compact };
+    const char* FormatNames[] = { "Entry", "Block", "Compact" };
+
+    size_t size = ESP.getPsramSize() > 0 ? 128 * 1024 : 8 * 1024;
+    std::unique_ptr<uint8_t[]> scratch(new (std::nothrow) uint8_t[size]);
+    if (!scratch) {
+        MessageOutput.println("RamDrive benchmark: no memory");
+        return;
+    }
+
+    for (uint8_t f = 0; f < sizeof(Formats) / sizeof(Formats[0]); f++) {
+        for (size_t batchSize : BatchSizes) {
+            std::unique_ptr<IRamBuffer> buffer;
+            if (Formats[f] == RamBufferFormat::Entry) {
+                buffer.reset(new RamBuffer(scratch.get(), size, _cache, _cacheSize));
+            } else {
+                buffer.reset(new RamBlockBuffer(scratch.get(), size, _cache, _cacheSize, Formats[f]));
+            }
+            buffer->PowerOnInitialize();
+
+            dataEntry_t batch[30];
+            time_t time = 1735686000;
+            uint32_t start = micros();
+            for (size_t i = 0; i < Samples;) {
+                size_t count = 0;
+                for (; count < batchSize && i < Samples; count++, i++) {
+                    batch[count] = { static_cast<uint16_t>(0x1000 + i % Sensors), time, 20.0f + (i % 97) * 0.01f };
+                    if (i % Sensors == Sensors - 1) {
+                        time += 60;
+                    }
+                }
+                buffer->writeBatch(batch, count);
+            }
+            uint32_t duration = max<uint32_t>(micros() - start, 1);
+
+            MessageOutput.printf("RamDrive benchmark: %s batch %u: %u samples/s (%.2f us per sample)\r\n", FormatNames[f],
+                static_cast<uint32_t>(batchSize), static_cast<uint32_t>(Samples * 1000000ull / duration), duration / static_cast<float>(Samples));
+        }
+    }
+}
+
+#endif
@@ -5,14 +5,17 @@
 
 #include "Logger/SDCard.h"
 #include "Datastore.h"
+#include "Logger/GraphData.h"
 #include "MessageOutput.h"
 #include "PinMapping.h"
+#include <memory>
 
 SDCardClass* pSDCard = nullptr;
 
-SDCardClass::SDCardClass()
+SDCardClass::SDCardClass(SDCardFormat format)
     : _loopTask(TASK_IMMEDIATE, TASK_FOREVER, std::bind(&SDCardClass::loop, this))
     , _state(SDCardState_t::Init)
+    , _format(format)
 {
 }
 
@@ -36,6 +39,18 @@ void SDCardClass::loop()
             _lastActionTime = millis();
         }
         break;
+    case SDCardState_t::InitOk:
+        // buffered lines older than SDCARD_FLUSH_INTERVAL, skipped while a file is read
+        if (millis() - _lastActionTime > 1000 && _mutex.try_lock()) {
+            for (auto& it : _sensors) {
+                if (it.second.length > 0 && millis() - it.second.since >= SDCARD_FLUSH_INTERVAL) {
+                    flushSensor(it.first, it.second);
+                }
+            }
+            _mutex.unlock();
+            _lastActionTime = millis();
+        }
+        break;
     default:
         return;
     }
@@ -50,7 +65,7 @@ void SDCardClass::scanCard()
     }
 
     const PinMapping_t& pin = PinMapping.get();
-    if (SD.begin(pin.sd_cs, SPI)) {
+    if (SD.begin(pin.sd_cs, SPI, 4000000, "/sd", SDCARD_OPEN_FILES + 1)) { // + getFile
         if (CARD_NONE == SD.cardType()) {
             _state = SDCardState_t::InitFailure;
             MessageOutput.println("No SD card attached");
@@ -70,20 +85,191 @@ void SDCardClass::writeValue(uint16_t serial, time_t time, float value)
         return;
     }
 
-    File file;
-    if (!openFile(serial, time, FILE_APPEND, file)) {
+    bufferLine(serial, time, value);
+}
+
+void SDCardClass::writeBatch(const dataEntry_t* entries, size_t count)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_state != SDCardState_t::InitOk) {
+        MessageOutput.printf("SD card: writeBatch invalid state. %d\r\n", _state);
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        bufferLine(entries[i].serial, entries[i].time, entries[i].value);
+    }
+}
+
+void SDCardClass::flush()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& it : _sensors) {
+        flushSensor(it.first, it.second);
+    }
+}
+
+void SDCardClass::bufferLine(uint16_t serial, time_t time, float value)
+{
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    int day = timeinfo.tm_year * 366 + timeinfo.tm_yday;
+
+    Sensor& sensor = _sensors[serial];
+    if (sensor.day != day) {
+        // day rollover: the next lines go into a new file
+        flushSensor(serial, sensor);
+        sensor.file.close();
+        sensor.day = day;
+        sensor.time = time;
+        if (_format == SDCardFormat::Binary) {
+            sensor.writer.begin(serial, time);
+            sensor.resumed = false;
+        }
+    }
+
+    if (_format == SDCardFormat::Binary) {
+        if (sensor.writer.full()) {
+            flushSensor(serial, sensor);
+        }
+        if (!sensor.writer.add(time, value)) {
+            return;
+        }
+        if (sensor.length++ == 0) {
+            sensor.since = millis();
+        }
         return;
     }
 
-    // write "time_t;Temperature"
-    if (!file.printf("%ld;%.2f\n", time, value)) {
+    // "time_t;Temperature"
+    char line[32];
+    size_t length = snprintf(line, sizeof(line), "%ld;%.2f\n", time, value);
+    if (sensor.length + length > sizeof(sensor.lines)) {
+        flushSensor(serial, sensor);
+    }
+    if (sensor.length == 0) {
+        sensor.since = millis();
+    }
+    memcpy(&sensor.lines[sensor.length], line, length);
+    sensor.length += length;
+}
+
+void SDCardClass::flushSensor(uint16_t serial, Sensor& sensor)
+{
+    if (sensor.length == 0) {
+        return;
+    }
+    if (_format == SDCardFormat::Binary) {
+        flushBlock(serial, sensor);
+        return;
+    }
+    if (!sensor.file) {
+        closeLeastRecent();
+        if (!openFile(serial, sensor.time, FILE_APPEND, sensor.file, SDCardFormat::Text)) {
+            sensor.length = 0; // lost, as without the buffer
+            return;
+        }
+    }
+    if (sensor.file.write(reinterpret_cast<const uint8_t*>(sensor.lines), sensor.length) != sensor.length) {
         MessageOutput.println("SD card: Append failed");
     }
-    file.close();
+    sensor.file.flush(); // the directory entry, the file stays open
+    sensor.length = 0;
+    sensor.lastWrite = millis();
 }
 
-bool SDCardClass::getFile(uint16_t serial, time_t time_start, uint32_t length, ResponseFiller& responseFiller)
+void SDCardClass::flushBlock(uint16_t serial, Sensor& sensor)
 {
+    bool created = false;
+    if (!sensor.file) {
+        closeLeastRecent();
+        if (!openDayFile(serial, sensor, created)) {
+            // the records stay unwritten: again with the next full block or after SDCARD_FLUSH_INTERVAL
+            sensor.since = millis();
+            return;
+        }
+    }
+
+    // the header only if an hour got its first record, the open block is rewritten until it is full
+    bool ok = true;
+    if (created || sensor.writer.headerChanged()) {
+        ok = sensor.file.seek(0) && sensor.file.write(reinterpret_cast<const uint8_t*>(&sensor.writer.header()), sizeof(dayFileHeader_t)) == sizeof(dayFileHeader_t);
+    }
+    ok = ok && sensor.file.seek(sensor.writer.blockOffset())
+        && sensor.file.write(reinterpret_cast<const uint8_t*>(&sensor.writer.block()), sizeof(dayFileBlock_t)) == sizeof(dayFileBlock_t);
+    if (!ok) {
+        MessageOutput.println("SD card: Block write failed");
+    }
+    sensor.file.flush();
+    sensor.writer.written();
+    sensor.length = 0;
+    sensor.lastWrite = millis();
+}
+
+bool SDCardClass::openDayFile(uint16_t serial, Sensor& sensor, bool& created)
+{
+    char path[50];
+    getFileName(serial, sensor.time, SDCardFormat::Binary, path, sizeof(path));
+    if (SD.exists(path)) {
+        // e.g. an SPI error or no free handle: retried by the caller, an existing file is never truncated
+        if (!openFile(serial, sensor.time, "r+", sensor.file, SDCardFormat::Binary)) {
+            return false;
+        }
+        if (sensor.resumed) {
+            return true;
+        }
+        // first write of the day since the start: behind the records of the file
+        sensor.resumed = true;
+        dayFileHeader_t header;
+        dayFileBlock_t last;
+        size_t size = sensor.file.size();
+        uint32_t blocks = size > sizeof(header) ? (size - sizeof(header)) / sizeof(last) : 0;
+        bool lastValid = blocks > 0 && sensor.file.seek(DayFile::blockOffset(blocks - 1))
+            && sensor.file.read(reinterpret_cast<uint8_t*>(&last), sizeof(last)) == sizeof(last) && DayFile::isBlock(last);
+        if (sensor.file.seek(0) && sensor.file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) == sizeof(header)
+            && sensor.writer.resume(header, blocks, lastValid ? &last : nullptr)) {
+            return true;
+        }
+
+        // e.g. a torn header write: the blocks are kept, the hours are taken from their records
+        MessageOutput.printf("SD card: Invalid header of the day file of %04X, rebuilt\r\n", serial);
+        sensor.writer.rebuild(blocks, [&sensor](uint32_t index, dayFileBlock_t& block) {
+            return sensor.file.seek(DayFile::blockOffset(index)) && sensor.file.read(reinterpret_cast<uint8_t*>(&block), sizeof(block)) == sizeof(block);
+        }, lastValid ? &last : nullptr);
+        return true;
+    }
+
+    created = openFile(serial, sensor.time, FILE_WRITE, sensor.file, SDCardFormat::Binary);
+    sensor.resumed = sensor.resumed || created;
+    return created;
+}
+
+void SDCardClass::closeLeastRecent()
+{
+    Sensor* oldest = nullptr;
+    uint8_t open = 0;
+    for (auto& it : _sensors) {
+        if (it.second.file) {
+            open++;
+            if (oldest == nullptr || millis() - it.second.lastWrite > millis() - oldest->lastWrite) {
+                oldest = &it.second;
+            }
+        }
+    }
+    if (open >= SDCARD_OPEN_FILES) {
+        oldest->file.close();
+    }
+}
+
+bool SDCardClass::getFile(const std::vector<uint16_t>& serials, time_t time_start, uint32_t length, uint32_t maxPoints, GraphDataFormat format, ResponseFiller& responseFiller)
+{
+    // one file per sensor and day
+    if (serials.size() != 1) {
+        return false;
+    }
+    uint16_t serial = serials.front();
+
     responseFiller = [this, serial, time_start](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
 
         //MessageOutput.printf("responseFiller 0x%X maxLen:%d, alreadySent:%d, start:%ld\r\n", serial, maxLen, alreadySent, time_start);
@@ -122,6 +308,11 @@ bool SDCardClass::getFile(uint16_t serial, time_t time_start, uint32_t length, R
         long ret = 0;
         if(alreadySent == 0)
         {
+            // binary search for a line shortly before time_start, the loop reads the rest
+            size_t position = _textIndex.find(TextFileIndex::fileKey(serial, time_start), _file.size(), time_start,
+                [this](size_t pos, uint8_t* data, size_t len) -> size_t { return _file.seek(pos) ? _file.read(data, len) : 0; });
+            _file.seek(position);
+
             while (true)
             {
                 ret = _file.readBytes((char*)buffer, maxLen);
@@ -169,37 +360,85 @@ bool SDCardClass::getFile(uint16_t serial, time_t time_start, uint32_t length, R
         return ret;
     };
 
-    // ignore length here (max 24h)
+    // ignore length here (max 24h), maxPoints only for the binary format
     // restriction on start & length: start is beginning of a day, length is not longer that 24h
     if (_state != SDCardState_t::InitOk) {
         MessageOutput.println("SD card: getFile invalid state.");
         return false;
     }
 
-    if (!openFile(serial, time_start, FILE_READ, _file)) {
+    // one reader at a time (_file), graph requests do not wait for each other
+    if (!_mutex.try_lock()) {
         return false;
     }
+    auto sensor = _sensors.find(serial);
+    if (sensor != _sensors.end()) {
+        // the buffered lines first, the file is read with another handle
+        flushSensor(serial, sensor->second);
+        sensor->second.file.close();
+    }
+    if (_format == SDCardFormat::Binary && openFile(serial, time_start, FILE_READ, _file, SDCardFormat::Binary)) {
+        DayFileBlockReader readBlock = [this](uint32_t index, dayFileBlock_t& block) {
+            return _file.seek(DayFile::blockOffset(index)) && _file.read(reinterpret_cast<uint8_t*>(&block), sizeof(block)) == sizeof(block);
+        };
+        dayFileHeader_t header;
+        if (_file.read(reinterpret_cast<uint8_t*>(&header), sizeof(header)) != sizeof(header) || !DayFile::isHeader(header)) {
+            MessageOutput.println("SD card: Invalid header of the day file, rebuilt for the query");
+            size_t size = _file.size();
+            uint32_t blocks = size > sizeof(header) ? (size - sizeof(header)) / sizeof(dayFileBlock_t) : 0;
+            DayFile::rebuildHeader(header, serial, time_start, blocks, readBlock);
+        }
 
-    _mutex.lock();
+        // the same lines as from the text file, from the block of the hour of time_start
+        auto reader = std::make_shared<DayFileReader>(header, time_start, readBlock);
+        responseFiller = [this, reader](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+            size_t ret = reader->read(buffer, maxLen);
+            if (ret < maxLen && _fileOpen) {
+                _fileOpen = false;
+                _file.close();
+                _mutex.unlock();
+            }
+            return ret;
+        };
+    } else if (!openFile(serial, time_start, FILE_READ, _file, SDCardFormat::Text)) {
+        _mutex.unlock();
+        return false;
+    }
     _fileOpen = true;
 
+    if (format == GraphDataFormat::Binary) {
+        responseFiller = graphDataFromText(responseFiller, time_start, length, maxPoints);
+    }
     return true;
 }
 
-bool SDCardClass::openFile(uint16_t serial, const time_t time, const char* mode, File& file)
+void SDCardClass::getFileName(uint16_t serial, const time_t time, SDCardFormat format, char* buffer, size_t len)
 {
     struct tm timeinfo;
     Datastore.getTmTime(&timeinfo, time, 5);
 
+    snprintf(buffer, len, "/%04d/%02d", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1);
+    int month = timeinfo.tm_year * 12 + timeinfo.tm_mon;
+    if (_directories.count(month) == 0) {
+        if (!SD.exists(buffer)) {
+            snprintf(buffer, len, "/%04d", timeinfo.tm_year + 1900);
+            SD.mkdir(buffer);
+            snprintf(buffer, len, "/%04d/%02d", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1);
+            SD.mkdir(buffer);
+        }
+        _directories.insert(month);
+    }
+    snprintf(&buffer[strlen(buffer)], len - strlen(buffer), "/%02d_%04X.%s", timeinfo.tm_mday, serial,
+        format == SDCardFormat::Binary ? "bin" : "txt");
+}
+
+bool SDCardClass::openFile(uint16_t serial, const time_t time, const char* mode, File& file, SDCardFormat format)
+{
     char buffer[50];
-    snprintf(buffer, sizeof(buffer), "/%04d/%02d", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1);
-    if (!SD.exists(buffer)) {
-        snprintf(buffer, sizeof(buffer), "/%04d", timeinfo.tm_year + 1900);
-        SD.mkdir(buffer);
-        snprintf(buffer, sizeof(buffer), "/%04d/%02d", timeinfo.tm_year + 1900, timeinfo.tm_mon + 1);
-        SD.mkdir(buffer);
-    }
-    snprintf(&buffer[strlen(buffer)], sizeof(buffer) - strlen(buffer), "/%02d_%04X.txt", timeinfo.tm_mday, serial);
+    getFileName(serial, time, format, buffer, sizeof(buffer));
+    if (format == SDCardFormat::Binary && mode[0] == 'r' && !SD.exists(buffer)) {
+        return false; // a new file, or a text file of a day before the switch
+    }
 
     file = SD.open(buffer, mode);
     if (!file) {
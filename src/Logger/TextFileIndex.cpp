@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/TextFileIndex.h"
+
+uint32_t TextFileIndex::fileKey(uint16_t serial, time_t time)
+{
+    struct tm timeinfo;
+    localtime_r(&time, &timeinfo);
+    return static_cast<uint32_t>(timeinfo.tm_year * 366 + timeinfo.tm_yday) << 16 | serial;
+}
+
+size_t TextFileIndex::find(uint32_t file, size_t size, time_t start, Reader reader)
+{
+    Entry& entry = getEntry(file);
+    if (!entry.points.empty() && entry.points.back().position >= size) {
+        entry.points.clear(); // not the file of the positions
+    }
+    if (entry.points.empty() || entry.points.front().position != 0) {
+        Point first;
+        if (!probe(0, size, reader, first)) {
+            return 0;
+        }
+        addPoint(entry, first);
+    }
+
+    // between the nearest known lines
+    size_t low = 0;
+    size_t high = size;
+    for (const Point& point : entry.points) {
+        if (point.time >= start) {
+            high = point.position;
+            break;
+        }
+        low = point.position;
+    }
+
+    while (high - low > TEXTFILE_SCAN) {
+        size_t middle = low + (high - low) / 2;
+        Point point;
+        if (!probe(middle, size, reader, point)) {
+            break; // a line longer than a probe: the scan from low finds the start
+        }
+        if (point.position >= high) {
+            high = middle; // no line starts between middle and high
+            continue;
+        }
+        addPoint(entry, point);
+        if (point.time < start) {
+            low = point.position;
+        } else {
+            high = point.position;
+        }
+    }
+    return low;
+}
+
+bool TextFileIndex::probe(size_t position, size_t size, Reader& reader, Point& point)
+{
+    // from the byte before position: position may be a line start
+    size_t from = position > 0 ? position - 1 : 0;
+    char buffer[TEXTFILE_PROBE + 1];
+    size_t len = reader(from, reinterpret_cast<uint8_t*>(buffer), TEXTFILE_PROBE);
+    _probes++;
+
+    size_t pos = 0;
+    if (position > 0) {
+        while (pos < len && buffer[pos] != '\n') {
+            pos++;
+        }
+        pos++;
+    }
+    if (pos >= len || from + pos >= size) {
+        return false;
+    }
+    buffer[len] = '\0';
+    char* end;
+    long time = strtol(&buffer[pos], &end, 10);
+    if (end == &buffer[pos] || *end != ';') {
+        return false; // incomplete line
+    }
+    point.position = from + pos;
+    point.time = time;
+    return true;
+}
+
+void TextFileIndex::addPoint(Entry& entry, const Point& point)
+{
+    auto it = std::lower_bound(entry.points.begin(), entry.points.end(), point.position,
+        [](const Point& p, uint32_t position) { return p.position < position; });
+    if ((it != entry.points.end() && it->position == point.position) || entry.points.size() >= TEXTFILE_INDEX_POINTS) {
+        return; // the first points of the search divide the file best
+    }
+    entry.points.insert(it, point);
+}
+
+TextFileIndex::Entry& TextFileIndex::getEntry(uint32_t key)
+{
+    _used++;
+    for (Entry& entry : _files) {
+        if (entry.key == key) {
+            entry.used = _used;
+            return entry;
+        }
+    }
+    if (_files.size() >= TEXTFILE_INDEX_FILES) {
+        auto oldest = std::min_element(_files.begin(), _files.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        _files.erase(oldest);
+    }
+    _files.push_back({ key, _used, {} });
+    return _files.back();
+}
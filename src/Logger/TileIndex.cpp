@@ -0,0 +1,317 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/TileIndex.h"
+#include "Logger/Crc16.h"
+#include "MessageOutput.h"
+#include <algorithm>
+
+TileIndex::TileIndex(uint8_t* buffer, size_t size, uint8_t* cache, size_t cacheSize)
+    : _header(reinterpret_cast<dataTileHeader_t*>(buffer))
+    , _tiles(reinterpret_cast<dataTile_t*>(buffer + sizeof(dataTileHeader_t)))
+    , _size(size)
+    , _tileCount(size > sizeof(dataTileHeader_t) ? (size - sizeof(dataTileHeader_t)) / sizeof(dataTile_t) : 0)
+    , _cache(cache, cacheSize)
+{
+    // Same as RamBuffer: the tiles in PSRAM survive a reset, PowerOnInitialize is only called if IntegrityCheck fails.
+    if (_tileCount < TILE_SENSORS_MIN * TILE_LEVELS) {
+        _tileCount = 0;
+    }
+}
+
+void TileIndex::PowerOnInitialize()
+{
+    if (_tileCount == 0) {
+        return;
+    }
+
+    // as many slots of TILE_CAPACITY as fit, at least TILE_SENSORS_MIN with less tiles
+    uint32_t perSensor = 0;
+    for (uint8_t level = 0; level < TILE_LEVELS; level++) {
+        perSensor += TILE_CAPACITY[level];
+    }
+    _header->size = _size;
+    _header->slotCount = min<uint32_t>(max<uint32_t>(_tileCount / perSensor, TILE_SENSORS_MIN), TILE_SENSORS);
+    uint32_t perSlot = _tileCount / _header->slotCount;
+    uint32_t offset = 0;
+    for (uint16_t i = 0; i < TILE_SENSORS; i++) {
+        dataTileSlot_t& slot = _header->slots[i];
+        memset(&slot, 0, sizeof(slot));
+        for (uint8_t level = 0; i < _header->slotCount && level < TILE_LEVELS; level++) {
+            dataTileRing_t& ring = slot.rings[level];
+            ring.offset = offset;
+            ring.capacity = max<uint32_t>(perSlot * TILE_CAPACITY[level] / perSensor, 1);
+            offset += ring.capacity;
+        }
+        commitSlot(&slot);
+    }
+    commitHeader();
+    _cache.flushAll();
+}
+
+bool TileIndex::IntegrityCheck()
+{
+    if (_tileCount == 0) {
+        return true;
+    }
+
+    uint16_t crc = Crc16::Calc(reinterpret_cast<uint8_t*>(_header), offsetof(dataTileHeader_t, crc));
+    if (_header->size != _size || _header->crc != crc || _header->slotCount == 0 || _header->slotCount > TILE_SENSORS) {
+        MessageOutput.println("TileIndex header invalid");
+        return false;
+    }
+    for (uint16_t i = 0; i < _header->slotCount; i++) {
+        dataTileSlot_t& slot = _header->slots[i];
+        if (slot.crc != static_cast<uint16_t>(Crc16::Calc(reinterpret_cast<uint8_t*>(&slot), offsetof(dataTileSlot_t, crc)))) {
+            MessageOutput.println("TileIndex slot invalid");
+            return false;
+        }
+        for (uint8_t level = 0; level < TILE_LEVELS; level++) {
+            const dataTileRing_t& ring = slot.rings[level];
+            if (ring.capacity == 0 || ring.offset + ring.capacity > _tileCount || ring.first >= ring.capacity || ring.count > ring.capacity) {
+                MessageOutput.println("TileIndex layout changed");
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+void TileIndex::flushCache()
+{
+    _cache.flush();
+}
+
+void TileIndex::writeValue(uint16_t serial, time_t time, float value)
+{
+    if (_tileCount == 0 || isnan(value)) {
+        return;
+    }
+    dataTileSlot_t* slot = assignSlot(serial, time);
+    if (slot == nullptr) {
+        return;
+    }
+
+    bool changed = false;
+    for (uint8_t level = 0; level < TILE_LEVELS; level++) {
+        dataTileRing_t& ring = slot->rings[level];
+        time_t start = time - time % TILE_PERIODS[level];
+        dataTile_t* tile = ring.count > 0 ? getTile(ring, ring.count - 1) : nullptr;
+        bool valid = tile != nullptr && checkCrc(tile);
+        if (valid && tile->time > start) {
+            continue; // older than the newest tile (clock set back), the ring stays ordered by time
+        }
+        if (valid && tile->time == start) {
+            tile->count++;
+            tile->min = min(tile->min, value);
+            tile->max = max(tile->max, value);
+            tile->sum += value;
+        } else {
+            // new tile, the oldest one is overwritten if the ring is full
+            if (ring.count < ring.capacity) {
+                ring.count++;
+            } else {
+                ring.first = (ring.first + 1) % ring.capacity;
+            }
+            changed = true;
+
+            tile = getTile(ring, ring.count - 1);
+            tile->serial = serial;
+            tile->count = 1;
+            tile->time = start;
+            tile->min = value;
+            tile->max = value;
+            tile->sum = value;
+        }
+        updateCrc(tile);
+        _cache.add(tile, sizeof(dataTile_t));
+    }
+    if (changed) {
+        commitSlot(slot);
+    }
+}
+
+dataTileSlot_t* TileIndex::findSlot(uint16_t serial) const
+{
+    // no map, the readers do not lock out the writer
+    for (uint16_t i = 0; i < _header->slotCount; i++) {
+        if (_header->slots[i].used && _header->slots[i].serial == serial) {
+            return &_header->slots[i];
+        }
+    }
+    return nullptr;
+}
+
+dataTileSlot_t* TileIndex::assignSlot(uint16_t serial, time_t time)
+{
+    dataTileSlot_t* slot = findSlot(serial);
+    if (slot != nullptr) {
+        return slot;
+    }
+
+    // a free slot, otherwise the one idle for the longest time
+    time_t oldest = time - TILE_SLOT_IDLE;
+    for (uint16_t i = 0; i < _header->slotCount; i++) {
+        dataTileSlot_t& act = _header->slots[i];
+        if (!act.used) {
+            slot = &act;
+            break;
+        }
+        const dataTileRing_t& ring = act.rings[0];
+        time_t newest = ring.count > 0 ? getTile(ring, ring.count - 1)->time : 0;
+        if (newest < oldest) {
+            oldest = newest;
+            slot = &act;
+        }
+    }
+    if (slot == nullptr) {
+        return nullptr;
+    }
+
+    slot->used = 1;
+    slot->serial = serial;
+    for (uint8_t level = 0; level < TILE_LEVELS; level++) {
+        slot->rings[level].first = 0;
+        slot->rings[level].count = 0;
+    }
+    commitSlot(slot);
+    return slot;
+}
+
+int TileIndex::getLevel(uint32_t resolution) const
+{
+    if (_tileCount == 0) {
+        return -1;
+    }
+    int level = TILE_LEVELS - 1;
+    while (level >= 0 && TILE_PERIODS[level] > resolution) {
+        level--;
+    }
+    return level;
+}
+
+bool TileIndex::covers(const std::vector<uint16_t>& serials, time_t start, int level) const
+{
+    if (level < 0 || level >= TILE_LEVELS) {
+        return false;
+    }
+
+    // a serial without a slot has no values as long as a slot is free
+    bool free = false;
+    for (uint16_t i = 0; i < _header->slotCount && !free; i++) {
+        free = !_header->slots[i].used;
+    }
+    for (uint16_t serial : serials) {
+        const dataTileSlot_t* slot = findSlot(serial);
+        if (slot == nullptr) {
+            if (!free) {
+                return false;
+            }
+            continue;
+        }
+        // a full ring has dropped tiles, they must be older than start
+        const dataTileRing_t& ring = slot->rings[level];
+        if (ring.count == ring.capacity && getTile(ring, 0)->time > start - start % static_cast<time_t>(TILE_PERIODS[level])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+uint32_t TileIndex::findStart(const dataTileRing_t& ring, time_t time) const
+{
+    uint32_t lo = 0, hi = ring.count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (getTile(ring, mid)->time < time) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+bool TileIndex::getTile(const std::vector<uint16_t>& serials, time_t start, uint32_t length, int level, TileCursor& cursor, dataTile_t& tile) const
+{
+    if (level < 0 || level >= TILE_LEVELS) {
+        return false;
+    }
+
+    if (!cursor.started) {
+        // the tile containing start, per serial
+        cursor.started = true;
+        cursor.index.assign(serials.size(), 0);
+        cursor.first.assign(serials.size(), 0);
+        for (size_t i = 0; i < serials.size(); i++) {
+            const dataTileSlot_t* slot = findSlot(serials[i]);
+            if (slot != nullptr) {
+                const dataTileRing_t& ring = slot->rings[level];
+                cursor.index[i] = findStart(ring, start - start % TILE_PERIODS[level]);
+                cursor.first[i] = ring.first;
+            }
+        }
+    }
+
+    // the oldest next tile of all serials
+    const dataTileRing_t* next = nullptr;
+    size_t nextIndex = 0;
+    time_t nextTime = 0;
+    for (size_t i = 0; i < serials.size(); i++) {
+        const dataTileSlot_t* slot = findSlot(serials[i]);
+        if (slot == nullptr) {
+            continue;
+        }
+        // tiles overwritten since the last call
+        const dataTileRing_t& ring = slot->rings[level];
+        uint32_t removed = (ring.first + ring.capacity - cursor.first[i]) % ring.capacity;
+        cursor.index[i] = cursor.index[i] > removed ? cursor.index[i] - removed : 0;
+        cursor.first[i] = ring.first;
+
+        for (; cursor.index[i] < ring.count; cursor.index[i]++) {
+            const dataTile_t* act = getTile(ring, cursor.index[i]);
+            if (act->time > start + static_cast<time_t>(length)) {
+                cursor.index[i] = ring.count;
+                break;
+            }
+            if (act->serial == serials[i] && act->count > 0 && checkCrc(act)) {
+                if (next == nullptr || act->time < nextTime) {
+                    next = &ring;
+                    nextIndex = i;
+                    nextTime = act->time;
+                }
+                break;
+            }
+        }
+    }
+    if (next == nullptr) {
+        return false;
+    }
+    tile = *getTile(*next, cursor.index[nextIndex]++);
+    return true;
+}
+
+void TileIndex::updateCrc(dataTile_t* tile)
+{
+    tile->crc = Crc16::Calc(reinterpret_cast<uint8_t*>(tile), offsetof(dataTile_t, crc));
+}
+
+bool TileIndex::checkCrc(const dataTile_t* tile) const
+{
+    dataTile_t copy = *tile;
+    return copy.crc == static_cast<uint16_t>(Crc16::Calc(reinterpret_cast<uint8_t*>(&copy), offsetof(dataTile_t, crc)));
+}
+
+void TileIndex::commitSlot(dataTileSlot_t* slot)
+{
+    slot->crc = Crc16::Calc(reinterpret_cast<uint8_t*>(slot), offsetof(dataTileSlot_t, crc));
+    _cache.add(slot, sizeof(dataTileSlot_t));
+}
+
+void TileIndex::commitHeader()
+{
+    _header->crc = Crc16::Calc(reinterpret_cast<uint8_t*>(_header), offsetof(dataTileHeader_t, crc));
+    _cache.add(_header, offsetof(dataTileHeader_t, slots));
+}
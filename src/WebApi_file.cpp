@@ -58,7 +58,7 @@ void WebApiFileClass::onFileListGet(AsyncWebServerRequest* request)
     if (pRamDrive != nullptr) {
         JsonObject obj = data.add<JsonObject>();
         obj["name"] = String(RAMDRIVE_FILENAME);
-        obj["size"] = pRamDrive->getUsedBytes();
+        obj["size"] = pRamDrive->getBackupSize();
         obj["data_backup"] = true;
     }
 
@@ -112,7 +112,7 @@ void WebApiIotSensorData::onFile(AsyncWebServerRequest* request)
         timeinfo.tm_sec = 0;
 
         auto responseFiller = std::make_shared<ResponseFiller>();
-        if (!Datastore.getTemperatureFile(serial, mktime(&timeinfo), 24*60*60, *responseFiller)) {
+        if (!Datastore.getTemperatureFile({ serial }, mktime(&timeinfo), 24*60*60, 0, 0, GraphDataFormat::Text, *responseFiller)) {
             MessageOutput.print("WebApiIotSensorData: Can not get file.\r\n");
             _mutex.unlock();
             request->send(404);
@@ -53,6 +53,11 @@ void WebApiSysstatusClass::onSystemStatus(AsyncWebServerRequest* request)
     root["ramdrive_oldest"] = pRamDrive != nullptr ? pRamDrive->getOldestTime() : 0;
     root["ramdrive_reboot"] = pRamDrive != nullptr ? pRamDrive->getRebootCount() : 0;
     root["ramdrive_error"] = pRamDrive != nullptr ? pRamDrive->getErrorCount() : 0;
+    root["ramdrive_verify"] = pRamDrive != nullptr ? pRamDrive->getVerifyProgress() : 100;
+    root["ramdrive_read_retries"] = pRamDrive != nullptr ? pRamDrive->getReadRetries() : 0;
+    root["ramdrive_staged"] = pRamDrive != nullptr ? pRamDrive->getStagedCount() : 0;
+    root["ramdrive_drained"] = pRamDrive != nullptr ? pRamDrive->getDrainedCount() : 0;
+    root["ramdrive_overflow"] = pRamDrive != nullptr ? pRamDrive->getOverflowCount() : 0;
 
     root["chiprevision"] = ESP.getChipRevision();
     root["chipmodel"] = ESP.getChipModel();
@@ -187,6 +187,17 @@ void WebApiWsLiveClass::onLivedataStatus(AsyncWebServerRequest* request)
     }
 }
 
+// counts the running requests of one kind as long as it exists
+struct ReaderSlot {
+    std::atomic<uint8_t>& count;
+    ReaderSlot(std::atomic<uint8_t>& count)
+        : count(count)
+    {
+        count++;
+    }
+    ~ReaderSlot() { count--; }
+};
+
 void WebApiWsLiveClass::onGraphData(AsyncWebServerRequest* request)
 {
     if (!WebApi.checkCredentialsReadonly(request)) {
@@ -204,28 +215,65 @@ void WebApiWsLiveClass::onGraphData(AsyncWebServerRequest* request)
     AsyncWebServerResponse* response = nullptr;
 
     try {
-        if (request->hasParam("id") && request->hasParam("start") && request->hasParam("length") &&
-            _mutexFileReponse.TryLock(0, 1500)) {
-
-            uint16_t serial = strtol(request->getParam("id")->value().c_str(), 0, 16);
-            time_t start = request->getParam("start")->value().toInt();
-            uint32_t length = request->getParam("length")->value().toInt();
+        // the slot is released with the response, also if the connection is closed early
+        auto slot = std::make_shared<ReaderSlot>(_graphReaders);
+        bool ranged = request->hasParam("from") && request->hasParam("to");
+        if ((request->hasParam("id") || request->hasParam("ids")) && ((request->hasParam("start") && request->hasParam("length")) || ranged) &&
+            _graphReaders <= GRAPHDATA_MAX_READERS) {
+
+            // id=3f2a or ids=3f2a,12b0,... (one pass, the lines or records are tagged with the serial)
+            std::vector<uint16_t> serials;
+            const char* act = request->hasParam("ids") ? request->getParam("ids")->value().c_str() : request->getParam("id")->value().c_str();
+            char* end;
+            do {
+                uint16_t serial = strtol(act, &end, 16);
+                if (end == act) {
+                    break;
+                }
+                serials.push_back(serial);
+                act = end + 1;
+            } while (*end == ',');
+            GraphDataFormat format = GraphDataFormat::Text;
+            if (request->hasParam("format") && request->getParam("format")->value() == "bin") {
+                format = GraphDataFormat::Binary;
+            }
 
-            if (!Datastore.getTemperatureFile(serial, start, length, *responseFiller)) {
-                MessageOutput.print("WebApi_ws_live: Can not get file.\r\n");
-                request->send(200);
-                _mutexFileReponse.unlock();
-                return;
+            // from=...&to=... (to excluded) in pages of limit values, the next page with cursor=<X-Next-Cursor>
+            String nextCursor;
+            if (ranged) {
+                RangeQuery range;
+                range.serials = serials;
+                range.from = request->getParam("from")->value().toInt();
+                range.to = request->getParam("to")->value().toInt();
+                range.limit = request->hasParam("limit") ? request->getParam("limit")->value().toInt() : 0;
+                range.cursor = request->hasParam("cursor") ? request->getParam("cursor")->value() : "";
+                if (!Datastore.getTemperatureRange(range, format, *responseFiller)) {
+                    MessageOutput.print("WebApi_ws_live: Can not get range.\r\n");
+                    request->send(200);
+                    return;
+                }
+                nextCursor = range.cursor;
+            } else {
+                time_t start = request->getParam("start")->value().toInt();
+                uint32_t length = request->getParam("length")->value().toInt();
+                uint32_t resolution = request->hasParam("resolution") ? request->getParam("resolution")->value().toInt() : 0;
+                uint32_t maxPoints = request->hasParam("max_points") ? request->getParam("max_points")->value().toInt() : 0;
+                if (!Datastore.getTemperatureFile(serials, start, length, resolution, maxPoints, format, *responseFiller)) {
+                    MessageOutput.print("WebApi_ws_live: Can not get file.\r\n");
+                    request->send(200);
+                    return;
+                }
             }
 
-            response = request->beginChunkedResponse("text/plain", [this, responseFiller](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+            const char* contentType = format == GraphDataFormat::Binary ? "application/octet-stream" : "text/plain";
+            response = request->beginChunkedResponse(contentType, [responseFiller, slot](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
                 int send = (*responseFiller)(buffer, maxLen, alreadySent);
                 //MessageOutput.printf("WebApi_ws_live: responseFiller returned %d bytes\r\n", send);
-                if(send == 0) {
-                    _mutexFileReponse.unlock();
-                }
                 return send;
             });
+            if (!nextCursor.isEmpty()) {
+                response->addHeader("X-Next-Cursor", nextCursor);
+            }
         }
         else{
             MessageOutput.printf("WebApiIotSensorData: Parameter id, start or length or busy\r\n");
@@ -238,11 +286,9 @@ void WebApiWsLiveClass::onGraphData(AsyncWebServerRequest* request)
     } catch (const std::bad_alloc& bad_alloc) {
         MessageOutput.printf("Call to /api/livedata/graph temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
         WebApi.sendTooManyRequests(request);
-        _mutexFileReponse.unlock();
     } catch (const std::exception& exc) {
         MessageOutput.printf("Unknown exception in /api/livedata/graph. Reason: \"%s\".\r\n", exc.what());
         WebApi.sendTooManyRequests(request);
-        _mutexFileReponse.unlock();
     }
 }
 
@@ -269,39 +315,102 @@ void WebApiWsLiveClass::onBackup(AsyncWebServerRequest* request)
     AsyncWebServerResponse* response = nullptr;
 
     try {
-
-        if(!_mutexFileReponse.TryLock(0, 15000)) {
-            request->send(200);
+        // the slot is released with the response, also if the connection is closed early
+        auto slot = std::make_shared<ReaderSlot>(_backupReaders);
+        if (_backupReaders > BACKUP_MAX_READERS) {
+            WebApi.sendTooManyRequests(request);
             return;
         }
 
-        size_t usedBytes = pRamDrive->getUsedBytes();
-        if (!Datastore.getBackup(*responseFiller)) {
-            MessageOutput.print("WebApi_ws_live: Can not get backup.\r\n");
-            request->send(200);
-            _mutexFileReponse.unlock();
-            return;
+        // Parts of the backup: Range: bytes=from-[to] with the snapshot (ETag) of the first request, either as
+        // parameter snapshot=id (412 if not available anymore) or If-Range: "id" (whole new backup if not).
+        BackupRange range;
+        bool ifRange = false;
+        if (request->hasParam("snapshot")) {
+            range.snapshot = request->getParam("snapshot")->value();
+        } else if (request->hasHeader("If-Range")) {
+            range.snapshot = request->header("If-Range");
+            range.snapshot.replace("\"", "");
+            ifRange = true;
+        }
+        if (request->hasParam("format") && request->getParam("format")->value() == "compressed") {
+            range.compressed = true; // see BackupStream.h, restored by the same upload
+        }
+        bool partial = false;
+        if (request->hasHeader("Range")) {
+            unsigned long from, to;
+            String value = request->header("Range");
+            int fields = sscanf(value.c_str(), "bytes=%lu-%lu", &from, &to);
+            if (fields >= 1 && (fields == 1 || to >= from)) {
+                range.offset = from;
+                range.length = fields == 2 ? to - from + 1 : SIZE_MAX;
+                partial = true;
+            }
         }
 
-        response = request->beginResponse("text/plain", usedBytes, [this, responseFiller, usedBytes](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
-            int send = (*responseFiller)(buffer, maxLen, alreadySent);
-
-            if(alreadySent + send >= usedBytes) {
-                _mutexFileReponse.unlock();
+        // the size of a compressed backup is counted in the background: the same snapshot again after Retry-After
+        auto sendPending = [request, &range]() {
+            AsyncWebServerResponse* pending = request->beginResponse(503, "text/plain", "Backup size pending");
+            pending->addHeader("Retry-After", "1");
+            pending->addHeader("ETag", String("\"") + range.snapshot + "\"");
+            request->send(pending);
+        };
+
+        if (!Datastore.getBackup(range, *responseFiller)) {
+            if (range.pending) {
+                sendPending();
+                return;
+            }
+            if (ifRange) {
+                bool compressed = range.compressed;
+                range = BackupRange();
+                range.compressed = compressed;
+                partial = false;
+            }
+            if (!range.snapshot.isEmpty()) {
+                request->send(412); // snapshot overwritten or from before a reboot
+                return;
+            }
+            if (!Datastore.getBackup(range, *responseFiller)) {
+                if (range.pending) {
+                    sendPending();
+                    return;
+                }
+                MessageOutput.print("WebApi_ws_live: Can not get backup.\r\n");
+                request->send(200);
+                return;
             }
-            return send;
+        }
+
+        if (partial && range.length == 0) {
+            response = request->beginResponse(416);
+            response->addHeader("Content-Range", String("bytes */") + String(range.total));
+            request->send(response);
+            return;
+        }
+
+        const char* contentType = range.compressed ? "application/octet-stream" : "text/plain";
+        response = request->beginResponse(contentType, range.length, [responseFiller, slot](uint8_t* buffer, size_t maxLen, size_t alreadySent) -> size_t {
+            return (*responseFiller)(buffer, maxLen, alreadySent);
         });
 
         response->addHeader("Server", "ESP Async Web Server");
+        response->addHeader("Accept-Ranges", "bytes");
+        response->addHeader("ETag", String("\"") + range.snapshot + "\"");
+        if (partial) {
+            char contentRange[48];
+            snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", static_cast<unsigned>(range.offset),
+                static_cast<unsigned>(range.offset + range.length - 1), static_cast<unsigned>(range.total));
+            response->setCode(206);
+            response->addHeader("Content-Range", contentRange);
+        }
         request->send(response);
     } catch (const std::bad_alloc& bad_alloc) {
         MessageOutput.printf("Call to /api/livedata/backup temporarely out of resources. Reason: \"%s\".\r\n", bad_alloc.what());
         WebApi.sendTooManyRequests(request);
-        _mutexFileReponse.unlock();
     } catch (const std::exception& exc) {
         MessageOutput.printf("Unknown exception in /api/livedata/backup. Reason: \"%s\".\r\n", exc.what());
         WebApi.sendTooManyRequests(request);
-        _mutexFileReponse.unlock();
     }
 }
 
@@ -324,7 +433,9 @@ void WebApiWsLiveClass::onBackupUpload(AsyncWebServerRequest* request, String fi
             return;
         }
     }
-    if (!Datastore.restoreBackup(index, data, len, final)) {
+    // merge=1: insert into the actual data, no restart
+    bool merge = request->hasParam("merge");
+    if (!(merge ? Datastore.mergeBackup(index, data, len, final) : Datastore.restoreBackup(index, data, len, final))) {
         MessageOutput.print("WebApi_ws_live: Can not restore backup. No valid backup file.\r\n");
         request->send(404);
         _mutexFileReponse.unlock();
@@ -349,5 +460,7 @@ void WebApiWsLiveClass::onBackupUploadFinish(AsyncWebServerRequest* request)
     response->addHeader("Connection", "close");
     response->addHeader("Access-Control-Allow-Origin", "*");
     request->send(response);
-    RestartHelper.triggerRestart();
+    if (!request->hasParam("merge")) {
+        RestartHelper.triggerRestart();
+    }
 }
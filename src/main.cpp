@@ -148,7 +148,7 @@ void setup()
 
     if (pin.sd_enabled) {
         MessageOutput.print("Initialize SD card ... ");
-        pSDCard = new SDCardClass();
+        pSDCard = new SDCardClass(SDCardFormat::SDCARD_FORMAT);
         pSDCard->init(scheduler);
         Datastore.init(static_cast<IDataStoreDevice*>(pSDCard));
         MessageOutput.println("done");
@@ -158,7 +158,11 @@ void setup()
         // PSRAM contains data also after reset
         MessageOutput.print("Initialize Ram drive ... ");
 
-        pRamDrive = new RamDriveClass();
+#ifdef RAMDRIVE_BENCHMARK
+        RamDriveClass::Benchmark();
+#endif
+        pRamDrive = new RamDriveClass(RamBufferFormat::RAMDRIVE_FORMAT);
+        pRamDrive->init(scheduler);
         Datastore.init(static_cast<IDataStoreDevice*>(pRamDrive));
         MessageOutput.println("done");
     }
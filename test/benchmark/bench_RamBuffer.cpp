@@ -0,0 +1,348 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Host benchmarks of the RamBuffer formats on rings of 1 and 6 MB: 30 sensors polled every 60 seconds, the rings are
+// filled until they wrap. With LOGGER_BENCH_BACKUP=<file> the queries also run on a downloaded backup (any format).
+// Besides the time per operation the counters are:
+//   written/op: bytes marked for the PSRAM write back (PsramCache)
+//   allocs/op:  heap allocations
+//   bytes_per_second, items_per_second: entries (bytes) covered by scans and the IntegrityCheck
+//
+//   cmake --build build/host --target benchmark_json   (results in build/host/benchmark_results.json)
+
+#include "Logger/BackupStream.h"
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/RamBuffer.h"
+#include <atomic>
+#include <benchmark/benchmark.h>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <vector>
+
+static std::atomic<uint64_t> allocations { 0 };
+
+// all forms of new and delete on malloc and free. Not inlined: gcc would pair the inlined free with the new of the
+// call site and warn about a mismatch (-Wmismatched-new-delete).
+__attribute__((noinline)) void* operator new(size_t size)
+{
+    allocations++;
+    if (void* p = malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+__attribute__((noinline)) void* operator new[](size_t size) { return operator new(size); }
+__attribute__((noinline)) void operator delete(void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p) noexcept { free(p); }
+__attribute__((noinline)) void operator delete(void* p, size_t) noexcept { free(p); }
+__attribute__((noinline)) void operator delete[](void* p, size_t) noexcept { free(p); }
+
+namespace {
+
+const size_t SENSORS = 30;
+const uint32_t POLL_INTERVAL = 60;
+const time_t START = 1735686000;
+const size_t CACHE_SIZE = 64 * 1024; // as RamDriveClass::AllocateRamDrive
+
+const char* formatName(RamBufferFormat format)
+{
+    switch (format) {
+    case RamBufferFormat::Entry:
+        return "Entry";
+    case RamBufferFormat::Block:
+        return "Block";
+    case RamBufferFormat::Compressed:
+        return "Compressed";
+    default:
+        return "Compact";
+    }
+}
+
+struct Ring {
+    std::vector<uint8_t> memory;
+    std::vector<uint8_t> cache;
+    std::unique_ptr<IRamBuffer> buffer;
+    time_t first = 0; // oldest and newest time
+    time_t last = 0;
+    time_t next = START; // time of the next poll
+    size_t polls = 0;
+    std::vector<uint16_t> serials;
+
+    Ring(RamBufferFormat format, size_t size)
+        : memory(size)
+        , cache(CACHE_SIZE)
+    {
+        if (format == RamBufferFormat::Entry) {
+            buffer = std::make_unique<RamBuffer>(memory.data(), size, cache.data(), cache.size());
+        } else {
+            buffer = std::make_unique<RamBlockBuffer>(memory.data(), size, cache.data(), cache.size(), format);
+        }
+        buffer->PowerOnInitialize();
+        for (size_t i = 0; i < SENSORS; i++) {
+            serials.push_back(0x2800 + i);
+        }
+    }
+
+    // one poll of all sensors, values change slowly like temperatures
+    void poll()
+    {
+        dataEntry_t batch[SENSORS];
+        for (size_t i = 0; i < SENSORS; i++) {
+            float value = 20.0f + ((polls + i * 7) % 64) / 16.0f;
+            batch[i] = { serials[i], next, value };
+        }
+        buffer->writeBatch(batch, SENSORS);
+        last = next;
+        next += POLL_INTERVAL;
+        polls++;
+    }
+
+    void fill()
+    {
+        while (buffer->getOldestTime() <= START) {
+            poll();
+        }
+        // some more, so the ring is not just wrapped
+        for (size_t i = polls / 10; i > 0; i--) {
+            poll();
+        }
+        first = buffer->getOldestTime();
+    }
+};
+
+// filled rings are shared by the benchmarks, the write benchmarks append to them
+Ring& getRing(RamBufferFormat format, size_t megabytes)
+{
+    static std::map<std::pair<RamBufferFormat, size_t>, std::unique_ptr<Ring>> rings;
+    auto& ring = rings[{ format, megabytes }];
+    if (!ring) {
+        ring = std::make_unique<Ring>(format, megabytes * 1024 * 1024);
+        ring->fill();
+    }
+    return *ring;
+}
+
+class Counters {
+public:
+    Counters()
+        : _written(PsramCache::getBytesAdded())
+        , _allocations(allocations)
+    {
+    }
+
+    void report(benchmark::State& state)
+    {
+        state.counters["written/op"] = benchmark::Counter(PsramCache::getBytesAdded() - _written, benchmark::Counter::kAvgIterations);
+        state.counters["allocs/op"] = benchmark::Counter(allocations - _allocations, benchmark::Counter::kAvgIterations);
+    }
+
+private:
+    uint64_t _written;
+    uint64_t _allocations;
+};
+
+void writeValue(benchmark::State& state, RamBufferFormat format)
+{
+    Ring& ring = getRing(format, state.range(0));
+    size_t sensor = 0;
+    Counters counters;
+    for (auto _ : state) {
+        ring.buffer->writeValue(ring.serials[sensor], ring.next, 21.0f + sensor / 16.0f);
+        if (++sensor == SENSORS) {
+            sensor = 0;
+            ring.next += POLL_INTERVAL;
+        }
+    }
+    counters.report(state);
+}
+
+void writePoll(benchmark::State& state, RamBufferFormat format)
+{
+    Ring& ring = getRing(format, state.range(0));
+    Counters counters;
+    for (auto _ : state) {
+        ring.poll();
+    }
+    counters.report(state);
+    state.SetItemsProcessed(state.iterations() * SENSORS);
+}
+
+// first entry of one sensor at a random time
+void findStart(benchmark::State& state, Ring& ring)
+{
+    std::mt19937 rng(1);
+    Counters counters;
+    uint16_t serial = ring.serials[5 % ring.serials.size()];
+    for (auto _ : state) {
+        time_t time = ring.first + rng() % (ring.last - ring.first);
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        benchmark::DoNotOptimize(ring.buffer->getEntry(serial, time, cursor, entry));
+    }
+    counters.report(state);
+}
+
+// one day of state.range(0) sensors
+void scanDay(benchmark::State& state, Ring& ring)
+{
+    std::vector<uint16_t> serials(ring.serials.begin(), ring.serials.begin() + min<size_t>(state.range(0), ring.serials.size()));
+    time_t from = max<time_t>(ring.first, ring.last - 2 * 24 * 60 * 60);
+    size_t entries = 0;
+    Counters counters;
+    for (auto _ : state) {
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        while (ring.buffer->getEntry(serials, from, cursor, entry)) {
+            entries++;
+        }
+    }
+    counters.report(state);
+    state.SetItemsProcessed(entries);
+    state.counters["entries/op"] = benchmark::Counter(entries, benchmark::Counter::kAvgIterations);
+}
+
+// the whole ring with ecc, as after a power on
+void integrityCheck(benchmark::State& state, Ring& ring)
+{
+    Counters counters;
+    for (auto _ : state) {
+        if (!ring.buffer->IntegrityCheck()) {
+            state.SkipWithError("IntegrityCheck failed");
+            break;
+        }
+    }
+    counters.report(state);
+    state.SetBytesProcessed(state.iterations() * ring.buffer->getUsedBytes());
+}
+
+// compressed backup of the whole ring, see RamDriveBackupStream
+void backupStream(benchmark::State& state, Ring& ring)
+{
+    std::vector<uint8_t> buffer(4096);
+    size_t bytes = 0;
+    Counters counters;
+    for (auto _ : state) {
+        RamBufferSnapshot snapshot = ring.buffer->getSnapshot();
+        RamBufferCursor cursor;
+        BackupStreamEncoder encoder;
+        dataEntry_t entry;
+        bool end = false;
+        while (!end) {
+            encoder.begin(buffer.data(), buffer.size());
+            while (!encoder.full()) {
+                if (!ring.buffer->getSnapshotEntry(snapshot, cursor, entry)) {
+                    encoder.finish();
+                    end = true;
+                    break;
+                }
+                encoder.add(entry);
+            }
+            benchmark::DoNotOptimize(buffer.data());
+        }
+        bytes = encoder.getPosition();
+    }
+    counters.report(state);
+    state.SetBytesProcessed(state.iterations() * ring.buffer->getUsedBytes());
+    state.counters["stream_bytes"] = bytes;
+}
+
+// downloaded backup, the ring is sized to it
+std::unique_ptr<Ring> loadBackup(const char* path)
+{
+    std::ifstream file(path, std::ios::binary);
+    std::vector<uint8_t> data((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    if (data.size() < 8) {
+        return nullptr;
+    }
+
+    std::unique_ptr<Ring> ring;
+    if (memcmp(data.data(), BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC)) == 0) {
+        BackupStreamDecoder decoder;
+        std::vector<dataEntry_t> entries;
+        if (!decoder.write(data.data(), data.size(), entries) || !decoder.finished()) {
+            return nullptr;
+        }
+        ring = std::make_unique<Ring>(RamBufferFormat::Entry, sizeof(dataEntryHeader_t) + (entries.size() + 1) * (sizeof(dataEntryFEC_t) + sizeof(dataEntryLink_t)));
+        ring->buffer->writeBatch(entries.data(), entries.size());
+    } else {
+        RamBufferFormat format = RamBufferFormat::Entry;
+        size_t size = sizeof(dataEntryHeader_t) + (data.size() / sizeof(dataEntryFEC_t) + 1) * (sizeof(dataEntryFEC_t) + sizeof(dataEntryLink_t));
+        if (memcmp(data.data(), RAMBUFFER_BACKUP_MAGIC, sizeof(RAMBUFFER_BACKUP_MAGIC)) == 0) {
+            format = static_cast<RamBufferFormat>(reinterpret_cast<const dataBlockBackup_t*>(data.data())->format);
+            size = sizeof(dataBlockHeader_t) + data.size() + sizeof(dataBlock_t);
+        }
+        ring = std::make_unique<Ring>(format, size);
+        if (!ring->buffer->restoreBackup(0, data.data(), data.size(), true)) {
+            return nullptr;
+        }
+    }
+
+    // newest time and the sensors
+    ring->serials.clear();
+    ring->first = ring->buffer->getOldestTime();
+    RamBufferSnapshot snapshot = ring->buffer->getSnapshot();
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    while (ring->buffer->getSnapshotEntry(snapshot, cursor, entry)) {
+        ring->last = max(ring->last, entry.time);
+        if (std::find(ring->serials.begin(), ring->serials.end(), entry.serial) == ring->serials.end()) {
+            ring->serials.push_back(entry.serial);
+        }
+    }
+    if (ring->last <= ring->first || ring->serials.empty()) {
+        return nullptr;
+    }
+    return ring;
+}
+
+void registerBenchmarks()
+{
+    const RamBufferFormat formats[] = { RamBufferFormat::Entry, RamBufferFormat::Block, RamBufferFormat::Compressed, RamBufferFormat::Compact };
+    for (RamBufferFormat format : formats) {
+        std::string name = formatName(format);
+        benchmark::RegisterBenchmark(("WriteValue/" + name).c_str(), writeValue, format)->Arg(1)->Arg(6);
+        benchmark::RegisterBenchmark(("WritePoll/" + name).c_str(), writePoll, format)->Arg(1)->Arg(6);
+        for (size_t megabytes : { 1, 6 }) {
+            std::string ring = name + "/" + std::to_string(megabytes) + "MB";
+            auto get = [format, megabytes]() -> Ring& { return getRing(format, megabytes); };
+            benchmark::RegisterBenchmark(("FindStart/" + ring).c_str(), [get](benchmark::State& state) { findStart(state, get()); });
+            benchmark::RegisterBenchmark(("ScanDay/" + ring).c_str(), [get](benchmark::State& state) { scanDay(state, get()); })->Arg(1)->Arg(30)->ArgName("sensors");
+            benchmark::RegisterBenchmark(("IntegrityCheck/" + ring).c_str(), [get](benchmark::State& state) { integrityCheck(state, get()); })->Unit(benchmark::kMillisecond);
+            benchmark::RegisterBenchmark(("BackupStream/" + ring).c_str(), [get](benchmark::State& state) { backupStream(state, get()); })->Unit(benchmark::kMillisecond);
+        }
+    }
+
+    const char* path = getenv("LOGGER_BENCH_BACKUP");
+    if (path == nullptr) {
+        return;
+    }
+    static std::unique_ptr<Ring> backup = loadBackup(path);
+    if (!backup) {
+        fprintf(stderr, "LOGGER_BENCH_BACKUP: %s is not a valid backup\n", path);
+        exit(1);
+    }
+    benchmark::RegisterBenchmark("FindStart/Backup", [](benchmark::State& state) { findStart(state, *backup); });
+    benchmark::RegisterBenchmark("ScanDay/Backup", [](benchmark::State& state) { scanDay(state, *backup); })->Arg(1)->Arg(30)->ArgName("sensors");
+    benchmark::RegisterBenchmark("IntegrityCheck/Backup", [](benchmark::State& state) { integrityCheck(state, *backup); })->Unit(benchmark::kMillisecond);
+    benchmark::RegisterBenchmark("BackupStream/Backup", [](benchmark::State& state) { backupStream(state, *backup); })->Unit(benchmark::kMillisecond);
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    registerBenchmarks();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) {
+        return 1;
+    }
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,142 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Helpers of the fuzz targets: the input is read as a sequence of choices (ring size, entries, patches), the ring
+// is exercised like by RamDriveClass after a reset. Every loop over the ring is bounded by its capacity, a longer
+// walk aborts like a memory error, so the fuzzer keeps the input.
+
+#include "Logger/IRamBuffer.h"
+#include <cstdio>
+#include <cstdlib>
+
+#define FUZZ_CHECK(cond)                                                            \
+    do {                                                                            \
+        if (!(cond)) {                                                              \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            abort();                                                                \
+        }                                                                           \
+    } while (0)
+
+// Reads the input from the front, 0 after its end
+class FuzzInput {
+public:
+    FuzzInput(const uint8_t* data, size_t size)
+        : _data(data)
+        , _size(size)
+    {
+    }
+
+    uint8_t u8()
+    {
+        if (_size == 0) {
+            return 0;
+        }
+        _size--;
+        return *_data++;
+    }
+    uint16_t u16() { return u8() | (u8() << 8); }
+    uint32_t u32() { return u16() | (static_cast<uint32_t>(u16()) << 16); }
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+    const uint8_t* data() const { return _data; }
+
+private:
+    const uint8_t* _data;
+    size_t _size;
+};
+
+const time_t FUZZ_START_TIME = 1700000000;
+const uint16_t FUZZ_SERIAL = 0x2800;
+const uint8_t FUZZ_SENSORS = 5;
+
+// polls of FUZZ_SENSORS sensors every 60 seconds, starting at time
+static inline time_t fuzzFill(IRamBuffer& buffer, time_t time, size_t count)
+{
+    dataEntry_t poll[FUZZ_SENSORS];
+    for (size_t i = 0; i < count; i += FUZZ_SENSORS, time += 60) {
+        size_t n = count - i < FUZZ_SENSORS ? count - i : FUZZ_SENSORS;
+        for (size_t s = 0; s < n; s++) {
+            poll[s] = { static_cast<uint16_t>(FUZZ_SERIAL + s), time, static_cast<float>(i + s) / 16.0f };
+        }
+        buffer.writeBatch(poll, n);
+    }
+    return time;
+}
+
+// IntegrityCheck after a reset like RamDriveClass: PowerOnInitialize if the header or too many entries are invalid.
+// maxSteps: entries (blocks) of the ring, the check must not verify more.
+static inline void fuzzRecover(IRamBuffer& buffer, bool decode, size_t maxSteps, FuzzInput& in)
+{
+    if (!buffer.beginIntegrityCheck(decode)) {
+        buffer.PowerOnInitialize();
+        return;
+    }
+
+    const size_t chunk = 1 + in.u8() % 16;
+    size_t steps = 0;
+    time_t time = FUZZ_START_TIME + 30 * 24 * 60 * 60;
+    IntegrityState state;
+    while ((state = buffer.continueIntegrityCheck(chunk)) == IntegrityState::Verifying) {
+        steps += chunk;
+        FUZZ_CHECK(steps <= maxSteps + chunk);
+        FUZZ_CHECK(buffer.getVerifyProgress() <= 100);
+
+        // the logging continues during the check
+        if (in.u8() & 1) {
+            time = fuzzFill(buffer, time, FUZZ_SENSORS);
+        }
+    }
+    if (state == IntegrityState::Failed) {
+        buffer.PowerOnInitialize();
+    }
+}
+
+// Queries, snapshot and backup of a recovered ring. maxEntries: entries that fit into the ring.
+static inline void fuzzQuery(IRamBuffer& buffer, size_t maxEntries, FuzzInput& in)
+{
+    dataEntry_t entry;
+    const time_t from = buffer.getOldestTime() + static_cast<int16_t>(in.u16());
+
+    for (uint16_t serial = FUZZ_SERIAL; serial < FUZZ_SERIAL + FUZZ_SENSORS; serial++) {
+        RamBufferCursor cursor;
+        size_t found = 0;
+        while (buffer.getEntry(serial, from, cursor, entry)) {
+            FUZZ_CHECK(++found <= maxEntries);
+            FUZZ_CHECK(entry.serial == serial && entry.time >= from);
+        }
+    }
+
+    std::vector<uint16_t> serials;
+    for (uint8_t s = 0; s < FUZZ_SENSORS; s++) {
+        serials.push_back(FUZZ_SERIAL + s);
+    }
+    RamBufferCursor cursor;
+    uint32_t position = 0, index = 0;
+    size_t found = 0;
+    while (buffer.getEntry(serials, from, from + 365 * 24 * 60 * 60, cursor, entry)) {
+        FUZZ_CHECK(++found <= maxEntries);
+        buffer.saveCursor(cursor, position, index);
+    }
+    if (found > 0) {
+        RamBufferCursor restored;
+        if (buffer.restoreCursor(position, index, serials, restored)) {
+            size_t more = 0;
+            while (buffer.getEntry(serials, from, from + 365 * 24 * 60 * 60, restored, entry)) {
+                FUZZ_CHECK(++more <= maxEntries);
+            }
+        }
+    }
+
+    RamBufferSnapshot snapshot = buffer.getSnapshot();
+    FUZZ_CHECK(buffer.isSnapshotValid(snapshot));
+    FUZZ_CHECK(buffer.getBackupSize(snapshot) <= buffer.getTotalBytes() + 64);
+    RamBufferCursor snapshotCursor;
+    found = 0;
+    while (buffer.getSnapshotEntry(snapshot, snapshotCursor, entry)) {
+        FUZZ_CHECK(++found <= maxEntries);
+    }
+    uint8_t chunk[512];
+    for (size_t offset = 0; buffer.readBackup(snapshot, offset, chunk, sizeof(chunk)) > 0; offset += sizeof(chunk)) {
+        FUZZ_CHECK(offset <= buffer.getBackupSize(snapshot));
+    }
+}
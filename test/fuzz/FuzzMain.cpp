@@ -0,0 +1,241 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Driver of the fuzz targets without libFuzzer (gcc, AFL). Options like libFuzzer:
+//
+//   fuzz_x <files or directories>     run the inputs, e.g. a corpus or a crash
+//   fuzz_x -runs=N [-seed=S] [dirs]   N random inputs, mutated from the given inputs and the previous ones
+//   fuzz_x                            one input from stdin (AFL)
+//
+// -max_len=L limits the random inputs, -timeout=S aborts an input that runs longer. The input of a failed run is
+// written to crash-<run> in the working directory.
+
+#include <algorithm>
+#include <chrono>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <random>
+#include <string>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size);
+extern "C" void __sanitizer_set_death_callback(void (*callback)(void)) __attribute__((weak));
+
+static std::vector<uint8_t> current;
+static char crashName[64] = "crash-input";
+
+static void saveCrash()
+{
+    int fd = open(crashName, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd >= 0) {
+        ssize_t written = write(fd, current.data(), current.size());
+        (void)written;
+        close(fd);
+    }
+    const char message[] = "fuzz: input written to ";
+    ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+    written = write(STDERR_FILENO, crashName, strlen(crashName));
+    written = write(STDERR_FILENO, "\n", 1);
+    (void)written;
+}
+
+static void onSignal(int sig)
+{
+    if (sig == SIGALRM) {
+        const char message[] = "fuzz: timeout\n";
+        ssize_t written = write(STDERR_FILENO, message, sizeof(message) - 1);
+        (void)written;
+    }
+    saveCrash();
+    signal(sig, SIG_DFL);
+    raise(sig == SIGALRM ? SIGABRT : sig);
+}
+
+static bool readFile(const std::string& path, std::vector<uint8_t>& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        return false;
+    }
+    data.clear();
+    uint8_t buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + len);
+    }
+    fclose(file);
+    return true;
+}
+
+static void collect(const std::string& path, std::vector<std::string>& files)
+{
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        fprintf(stderr, "fuzz: %s not found\n", path.c_str());
+        return;
+    }
+    if (!S_ISDIR(info.st_mode)) {
+        files.push_back(path);
+        return;
+    }
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        return;
+    }
+    while (dirent* entry = readdir(dir)) {
+        if (entry->d_name[0] != '.') {
+            collect(path + "/" + entry->d_name, files);
+        }
+    }
+    closedir(dir);
+}
+
+static void run(unsigned timeout)
+{
+    alarm(timeout);
+    LLVMFuzzerTestOneInput(current.data(), current.size());
+    alarm(0);
+}
+
+static void mutate(std::vector<uint8_t>& data, std::mt19937& rng, size_t maxLen)
+{
+    const size_t mutations = 1 + rng() % 8;
+    for (size_t i = 0; i < mutations; i++) {
+        switch (rng() % 6) {
+        case 0: // flip a bit
+            if (!data.empty()) {
+                data[rng() % data.size()] ^= 1 << (rng() % 8);
+            }
+            break;
+        case 1: // random byte
+            if (!data.empty()) {
+                data[rng() % data.size()] = rng();
+            }
+            break;
+        case 2: // interesting byte
+            if (!data.empty()) {
+                static const uint8_t values[] = { 0x00, 0x01, 0x7F, 0x80, 0xFE, 0xFF };
+                data[rng() % data.size()] = values[rng() % sizeof(values)];
+            }
+            break;
+        case 3: // insert bytes
+            if (data.size() < maxLen) {
+                size_t pos = data.empty() ? 0 : rng() % (data.size() + 1);
+                size_t count = 1 + rng() % std::min<size_t>(16, maxLen - data.size());
+                for (size_t n = 0; n < count; n++) {
+                    data.insert(data.begin() + pos, static_cast<uint8_t>(rng()));
+                }
+            }
+            break;
+        case 4: // erase bytes
+            if (!data.empty()) {
+                size_t pos = rng() % data.size();
+                size_t count = 1 + rng() % std::min<size_t>(16, data.size() - pos);
+                data.erase(data.begin() + pos, data.begin() + pos + count);
+            }
+            break;
+        default: // copy a part
+            if (data.size() > 1) {
+                size_t from = rng() % data.size();
+                size_t to = rng() % data.size();
+                size_t count = 1 + rng() % std::min<size_t>(16, data.size() - std::max(from, to));
+                memmove(&data[to], &data[from], count);
+            }
+            break;
+        }
+    }
+}
+
+int main(int argc, char** argv)
+{
+    unsigned long runs = 0;
+    unsigned long seed = 1;
+    size_t maxLen = 1024;
+    unsigned timeout = 10;
+    std::vector<std::string> files;
+
+    for (int i = 1; i < argc; i++) {
+        if (strncmp(argv[i], "-runs=", 6) == 0) {
+            runs = strtoul(argv[i] + 6, nullptr, 10);
+        } else if (strncmp(argv[i], "-seed=", 6) == 0) {
+            seed = strtoul(argv[i] + 6, nullptr, 10);
+        } else if (strncmp(argv[i], "-max_len=", 9) == 0) {
+            maxLen = strtoul(argv[i] + 9, nullptr, 10);
+        } else if (strncmp(argv[i], "-timeout=", 9) == 0) {
+            timeout = strtoul(argv[i] + 9, nullptr, 10);
+        } else if (argv[i][0] == '-') {
+            fprintf(stderr, "fuzz: unknown option %s\n", argv[i]);
+            return 1;
+        } else {
+            collect(argv[i], files);
+        }
+    }
+
+    signal(SIGALRM, onSignal);
+    signal(SIGABRT, onSignal);
+    if (__sanitizer_set_death_callback != nullptr) {
+        __sanitizer_set_death_callback(saveCrash); // the sanitizer reports the memory errors
+    } else {
+        signal(SIGSEGV, onSignal);
+    }
+
+    if (runs == 0 && files.empty()) {
+        uint8_t buffer[4096];
+        size_t len;
+        while ((len = fread(buffer, 1, sizeof(buffer), stdin)) > 0) {
+            current.insert(current.end(), buffer, buffer + len);
+        }
+        run(timeout);
+        return 0;
+    }
+
+    // the given inputs first, they are the seeds of the random ones
+    std::vector<std::vector<uint8_t>> corpus;
+    for (const std::string& file : files) {
+        if (readFile(file, current)) {
+            snprintf(crashName, sizeof(crashName), "crash-%s", file.substr(file.find_last_of('/') + 1).substr(0, 40).c_str());
+            run(timeout);
+            corpus.push_back(current);
+        }
+    }
+
+    const auto begin = std::chrono::steady_clock::now();
+    double slowest = 0;
+    std::mt19937 rng(seed);
+    for (unsigned long i = 0; i < runs; i++) {
+        if (corpus.empty() || rng() % 8 == 0) {
+            current.resize(rng() % (maxLen + 1));
+            for (uint8_t& byte : current) {
+                byte = rng();
+            }
+        } else {
+            current = corpus[rng() % corpus.size()];
+            mutate(current, rng, maxLen);
+        }
+        snprintf(crashName, sizeof(crashName), "crash-%lu-%lu", seed, i);
+
+        const auto start = std::chrono::steady_clock::now();
+        run(timeout);
+        slowest = std::max(slowest, std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+
+        // keep some inputs to mutate them further
+        if (corpus.size() < 256) {
+            corpus.push_back(current);
+        } else {
+            corpus[rng() % corpus.size()] = current;
+        }
+    }
+
+    printf("fuzz: %zu inputs, %lu runs in %.1f s, slowest %.1f ms\n", files.size(), runs,
+        std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count(), slowest * 1000);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Fuzz target: RamBlockBuffer (Block, Compressed, Compact) after a reset with a corrupted PSRAM. A valid ring is
+// written, the input flips bytes of the header, the open block and the sealed blocks. Optionally the header ecc,
+// the crc of the open block and the ecc of the sealed blocks are recalculated afterwards, so the corrupted values
+// (pointers, counts and lengths) are accepted.
+//
+// input: format (u8), entries (u16), flags (u8), patches: region (u8), offset (u16), xor (u8)
+
+#include "FuzzCommon.h"
+#include "Logger/Crc16.h"
+#include "Logger/RamBlockBuffer.h"
+#include <memory>
+
+const size_t RING_BLOCKS = 3;
+const size_t RING_SIZE = sizeof(dataBlockHeader_t) + RING_BLOCKS * sizeof(dataBlock_t);
+const size_t CACHE_SIZE = 4096;
+const size_t MAX_ENTRIES = RING_BLOCKS * BLOCK_PAYLOAD_LENGTH * 8; // an entry needs at least one bit
+
+enum : uint8_t {
+    FLAG_DECODE = 0x01,
+    FLAG_SEAL_HEADER = 0x02,
+    FLAG_SEAL_OPEN = 0x04,
+    FLAG_SEAL_BLOCKS = 0x08,
+};
+
+static void checkPointers(const uint8_t* ring)
+{
+    const dataBlockHeader_t* header = reinterpret_cast<const dataBlockHeader_t*>(ring);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(ring + sizeof(dataBlockHeader_t));
+    for (const dataBlock_t* p : { header->first, header->last }) {
+        const uintptr_t pos = reinterpret_cast<uintptr_t>(p);
+        FUZZ_CHECK(pos >= start && pos < start + RING_BLOCKS * sizeof(dataBlock_t));
+        FUZZ_CHECK((pos - start) % sizeof(dataBlock_t) == 0);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzInput in(data, size);
+    std::unique_ptr<uint8_t[]> ring(new uint8_t[RING_SIZE]);
+    std::unique_ptr<uint8_t[]> cache(new uint8_t[CACHE_SIZE]);
+
+    const RamBufferFormat format = static_cast<RamBufferFormat>(1 + in.u8() % 3);
+    const size_t entries = in.u16() % 2048;
+    const uint8_t flags = in.u8();
+    {
+        RamBlockBuffer buffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE, format);
+        buffer.PowerOnInitialize();
+        fuzzFill(buffer, FUZZ_START_TIME, entries);
+    }
+
+    // the PSRAM upset
+    dataBlockHeader_t* header = reinterpret_cast<dataBlockHeader_t*>(ring.get());
+    dataBlock_t* blocks = reinterpret_cast<dataBlock_t*>(ring.get() + sizeof(dataBlockHeader_t));
+    dataBlock_t* open = header->last;
+    const size_t patches = in.u8() % 32;
+    for (size_t i = 0; i < patches && !in.empty(); i++) {
+        const uint8_t region = in.u8() % 4;
+        const uint16_t offset = in.u16();
+        const uint8_t value = in.u8();
+        uint8_t* pos;
+        switch (region) {
+        case 0: // header
+            pos = ring.get() + offset % BLOCK_HEADER_MSG_LENGTH;
+            break;
+        case 1: // info of a block
+            pos = reinterpret_cast<uint8_t*>(&blocks[offset % RING_BLOCKS].info) + (offset >> 8) % sizeof(dataBlockInfo_t);
+            break;
+        case 2: // open block
+            pos = reinterpret_cast<uint8_t*>(open) + offset % sizeof(dataBlock_t);
+            break;
+        default: // anywhere
+            pos = ring.get() + (offset * 3u) % RING_SIZE;
+            break;
+        }
+        *pos ^= value;
+    }
+    if (flags & FLAG_SEAL_BLOCKS) {
+        RS::ReedSolomon<BLOCK_WORD_LENGTH, BLOCK_ECC_LENGTH> rsBlock;
+        for (size_t b = 0; b < RING_BLOCKS; b++) {
+            if (&blocks[b] == open) {
+                continue;
+            }
+            uint8_t* block = reinterpret_cast<uint8_t*>(&blocks[b]);
+            for (size_t word = 0; word < BLOCK_WORDS; word++) {
+                rsBlock.EncodeBlock(&block[word * BLOCK_WORD_LENGTH], blocks[b].ecc[word]);
+            }
+        }
+    }
+    if (flags & FLAG_SEAL_OPEN) {
+        uint8_t* block = reinterpret_cast<uint8_t*>(open);
+        for (size_t word = 0; word < BLOCK_WORDS; word++) {
+            uint16_t crc = Crc16::Calc(&block[word * BLOCK_WORD_LENGTH], BLOCK_WORD_LENGTH);
+            memcpy(open->ecc[word], &crc, sizeof(crc));
+        }
+    }
+    if (flags & FLAG_SEAL_HEADER) {
+        RS::ReedSolomon<BLOCK_HEADER_MSG_LENGTH, BLOCK_HEADER_ECC_LENGTH> rsHeader;
+        rsHeader.EncodeBlock(header, header->ecc);
+    }
+
+    // reset: a new object on the old PSRAM
+    RamBlockBuffer buffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE, format);
+    fuzzRecover(buffer, flags & FLAG_DECODE, RING_BLOCKS, in);
+    checkPointers(ring.get());
+    FUZZ_CHECK(buffer.getUsedBytes() <= buffer.getTotalBytes());
+
+    fuzzQuery(buffer, MAX_ENTRIES, in);
+
+    // the logging continues and wraps the ring
+    fuzzFill(buffer, FUZZ_START_TIME + 60 * 24 * 60 * 60, 1024 + in.u16() % 1024);
+    checkPointers(ring.get());
+    fuzzQuery(buffer, MAX_ENTRIES, in);
+    return 0;
+}
@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Fuzz target: RamBuffer after a reset with a corrupted PSRAM. A valid ring is written, the input flips bytes of the
+// header, the commits, the entries and the links. Optionally the crc of the commits and the header ecc are
+// recalculated afterwards, like a wrong correction of the ecc, so the pointers read back are wrong but accepted.
+// After the IntegrityCheck (it rebuilds the links) the links are overwritten again: they are not protected, the
+// queries must end anyway.
+//
+// input: entries (u16), flags (u8), patches: region (u8), offset (u16), xor (u8), link patches: entry (u16), link (u16)
+
+#include "FuzzCommon.h"
+#include "Logger/Crc16.h"
+#include "Logger/RamBuffer.h"
+#include <memory>
+
+const size_t RING_ELEMENTS = 256;
+const size_t RING_SIZE = sizeof(dataEntryHeader_t) + RING_ELEMENTS * (sizeof(dataEntryFEC_t) + sizeof(dataEntryLink_t));
+const size_t CACHE_SIZE = 4096;
+
+enum : uint8_t {
+    FLAG_DECODE = 0x01, // IntegrityCheck after power on, otherwise after a software reset
+    FLAG_SEAL_COMMITS = 0x02,
+    FLAG_SEAL_HEADER = 0x04,
+    FLAG_LINKS = 0x08, // overwrite links after the IntegrityCheck
+};
+
+static void sealCommit(dataEntryCommit_t& commit)
+{
+    commit.crc = Crc16::Calc(reinterpret_cast<uint8_t*>(&commit), offsetof(dataEntryCommit_t, crc));
+}
+
+static void patchLinks(uint8_t* ring, FuzzInput& in)
+{
+    dataEntryLink_t* links = reinterpret_cast<dataEntryLink_t*>(ring + sizeof(dataEntryHeader_t) + RING_ELEMENTS * sizeof(dataEntryFEC_t));
+    const size_t patches = in.u8() % 16;
+    for (size_t i = 0; i < patches && !in.empty(); i++) {
+        const uint16_t entry = in.u16() % RING_ELEMENTS;
+        links[entry] = in.u16();
+    }
+}
+
+static void checkPointers(const uint8_t* ring)
+{
+    // first and last point to entries of the ring
+    const dataEntryHeader_t* header = reinterpret_cast<const dataEntryHeader_t*>(ring);
+    const uintptr_t start = reinterpret_cast<uintptr_t>(ring + sizeof(dataEntryHeader_t));
+    for (const dataEntryFEC_t* p : { header->first, header->last }) {
+        const uintptr_t pos = reinterpret_cast<uintptr_t>(p);
+        FUZZ_CHECK(pos >= start && pos < start + RING_ELEMENTS * sizeof(dataEntryFEC_t));
+        FUZZ_CHECK((pos - start) % sizeof(dataEntryFEC_t) == 0);
+    }
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzInput in(data, size);
+    std::unique_ptr<uint8_t[]> ring(new uint8_t[RING_SIZE]);
+    std::unique_ptr<uint8_t[]> cache(new uint8_t[CACHE_SIZE]);
+
+    const size_t entries = in.u16() % (3 * RING_ELEMENTS);
+    const uint8_t flags = in.u8();
+    {
+        RamBuffer buffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE);
+        buffer.PowerOnInitialize();
+        fuzzFill(buffer, FUZZ_START_TIME, entries);
+    }
+
+    // the PSRAM upset
+    dataEntryHeader_t* header = reinterpret_cast<dataEntryHeader_t*>(ring.get());
+    const size_t patches = in.u8() % 32;
+    for (size_t i = 0; i < patches && !in.empty(); i++) {
+        const uint8_t region = in.u8() % 4;
+        const uint16_t offset = in.u16();
+        const uint8_t value = in.u8();
+        size_t pos;
+        switch (region) {
+        case 0: // header, protected by the ecc
+            pos = offset % HEADER_MSG_LENGTH;
+            break;
+        case 1: // first, last and the commits
+            pos = offsetof(dataEntryHeader_t, first) + offset % (sizeof(dataEntryHeader_t) - offsetof(dataEntryHeader_t, first));
+            break;
+        case 2: // entries and links
+            pos = sizeof(dataEntryHeader_t) + offset % (RING_SIZE - sizeof(dataEntryHeader_t));
+            break;
+        default: // anywhere
+            pos = offset % RING_SIZE;
+            break;
+        }
+        ring[pos] ^= value;
+    }
+    if (flags & FLAG_SEAL_COMMITS) {
+        sealCommit(header->commit[0]);
+        sealCommit(header->commit[1]);
+        sealCommit(header->base);
+    }
+    if (flags & FLAG_SEAL_HEADER) {
+        RS::ReedSolomon<HEADER_MSG_LENGTH, HEADER_ECC_LENGTH> rsHeader;
+        rsHeader.EncodeBlock(header, header->ecc);
+    }
+
+    // reset: a new object on the old PSRAM
+    RamBuffer buffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE);
+    fuzzRecover(buffer, flags & FLAG_DECODE, RING_ELEMENTS, in);
+    checkPointers(ring.get());
+    FUZZ_CHECK(buffer.getUsedBytes() <= buffer.getTotalBytes());
+    if (flags & FLAG_LINKS) {
+        patchLinks(ring.get(), in);
+    }
+
+    fuzzQuery(buffer, RING_ELEMENTS, in);
+
+    // the logging continues and wraps the ring
+    fuzzFill(buffer, FUZZ_START_TIME + 60 * 24 * 60 * 60, RING_ELEMENTS + in.u8());
+    checkPointers(ring.get());
+    if (flags & FLAG_LINKS) {
+        patchLinks(ring.get(), in);
+    }
+    fuzzQuery(buffer, RING_ELEMENTS, in);
+    return 0;
+}
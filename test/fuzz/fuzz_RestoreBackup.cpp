@@ -0,0 +1,109 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Fuzz target: restore of an uploaded backup. The upload is written in chunks into RamBuffer, into a RamBlockBuffer
+// (with or without the header of a block backup) or decoded by BackupStreamDecoder and merged like by mergeBackup.
+// Afterwards the ring is checked and queried as after a reset.
+//
+// input: target (u8), flags (u8), chunk size (u8), upload
+
+#include "FuzzCommon.h"
+#include "Logger/BackupStream.h"
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/RamBuffer.h"
+#include <memory>
+
+const size_t RING_SIZE = 8 * 1024;
+const size_t CACHE_SIZE = 4096;
+const size_t MAX_ENTRIES = RING_SIZE * 8; // an entry needs at least one bit
+
+enum : uint8_t {
+    FLAG_BLOCK_HEADER = 0x01, // prepend a valid header of a block backup
+    FLAG_STREAM_HEADER = 0x02, // prepend a valid header of a compressed backup
+    FLAG_FILL = 0x04, // the ring is not empty before the restore
+};
+
+static void upload(IRamBuffer& buffer, const std::vector<uint8_t>& data, size_t chunk)
+{
+    for (size_t pos = 0;; pos += chunk) {
+        size_t len = min(chunk, data.size() - pos);
+        bool final = pos + len == data.size();
+        if (!buffer.restoreBackup(pos, data.data() + pos, len, final) || final) {
+            return;
+        }
+    }
+}
+
+static void decode(IRamBuffer& buffer, const std::vector<uint8_t>& data, size_t chunk)
+{
+    BackupStreamDecoder decoder;
+    std::vector<dataEntry_t> entries;
+    size_t total = 0;
+    for (size_t pos = 0; pos < data.size(); pos += chunk) {
+        if (!decoder.write(data.data() + pos, min(chunk, data.size() - pos), entries)) {
+            break;
+        }
+        total += entries.size();
+        FUZZ_CHECK(total <= data.size() / 3); // a record has at least 3 bytes
+
+        size_t merged;
+        if (!buffer.mergeBatch(entries.data(), entries.size(), merged)) {
+            buffer.writeBatch(entries.data(), entries.size());
+        }
+        FUZZ_CHECK(merged <= entries.size());
+        entries.clear();
+    }
+    FUZZ_CHECK(!decoder.finished() || decoder.getCount() == total);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    FuzzInput in(data, size);
+    const uint8_t target = in.u8() % 5;
+    const uint8_t flags = in.u8();
+    const size_t chunk = 1 + in.u8();
+
+    std::unique_ptr<uint8_t[]> ring(new uint8_t[RING_SIZE]);
+    std::unique_ptr<uint8_t[]> cache(new uint8_t[CACHE_SIZE]);
+    std::unique_ptr<IRamBuffer> buffer;
+    if (target == 0 || target == 4) {
+        buffer.reset(new RamBuffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE));
+    } else {
+        buffer.reset(new RamBlockBuffer(ring.get(), RING_SIZE, cache.get(), CACHE_SIZE, static_cast<RamBufferFormat>(target)));
+    }
+    buffer->PowerOnInitialize();
+    if (flags & FLAG_FILL) {
+        fuzzFill(*buffer, FUZZ_START_TIME, in.u8() * 4);
+    }
+
+    std::vector<uint8_t> backup;
+    if (flags & FLAG_BLOCK_HEADER) {
+        dataBlockBackup_t header;
+        memcpy(header.magic, RAMBUFFER_BACKUP_MAGIC, sizeof(header.magic));
+        header.format = target;
+        header.blockSize = sizeof(dataBlock_t);
+        backup.insert(backup.end(), reinterpret_cast<uint8_t*>(&header), reinterpret_cast<uint8_t*>(&header + 1));
+    }
+    if (flags & FLAG_STREAM_HEADER) {
+        const uint8_t header[BACKUPSTREAM_HEADER_LENGTH] = { 'T', 'L', 'B', 'Z', BACKUPSTREAM_VERSION, 0, 0, 0 };
+        backup.insert(backup.end(), header, header + sizeof(header));
+    }
+    backup.insert(backup.end(), in.data(), in.data() + in.size());
+
+    if (target == 4) {
+        decode(*buffer, backup, chunk);
+    } else {
+        upload(*buffer, backup, chunk);
+    }
+
+    // the restored data after a reset
+    FuzzInput none(nullptr, 0);
+    fuzzRecover(*buffer, true, RING_SIZE / sizeof(dataEntryFEC_t), none);
+    FUZZ_CHECK(buffer->getUsedBytes() <= buffer->getTotalBytes());
+    fuzzQuery(*buffer, MAX_ENTRIES, none);
+    fuzzFill(*buffer, FUZZ_START_TIME + 60 * 24 * 60 * 60, 600);
+    fuzzQuery(*buffer, MAX_ENTRIES, none);
+    return 0;
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+// Host build: the part of the Arduino core used by the Logger storage classes (see test/README)
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <string>
+#include <thread>
+
+using std::isnan;
+using std::max;
+using std::min;
+
+#define DEC 10
+#define constrain(amt, low, high) ((amt) < (low) ? (low) : ((amt) > (high) ? (high) : (amt)))
+
+unsigned long millis();
+unsigned long micros();
+inline void delay(unsigned long ms) { std::this_thread::sleep_for(std::chrono::milliseconds(ms)); }
+inline void yield() { std::this_thread::yield(); }
+
+// false as long as the time is not synchronized, see HostShim::setTime
+bool getLocalTime(struct tm* info, uint32_t ms = 5000);
+
+enum esp_reset_reason_t {
+    ESP_RST_UNKNOWN,
+    ESP_RST_POWERON,
+    ESP_RST_SW,
+};
+esp_reset_reason_t esp_reset_reason();
+uint32_t esp_random();
+
+class EspClass {
+public:
+    uint32_t getPsramSize();
+    uint32_t getFreePsram() { return getPsramSize(); }
+};
+extern EspClass ESP;
+
+class String {
+public:
+    String(const char* s = "")
+        : _s(s)
+    {
+    }
+    String(const std::string& s)
+        : _s(s)
+    {
+    }
+    bool isEmpty() const { return _s.empty(); }
+    const char* c_str() const { return _s.c_str(); }
+    size_t length() const { return _s.size(); }
+    long toInt() const { return atol(_s.c_str()); }
+    String& operator=(const char* s)
+    {
+        _s = s;
+        return *this;
+    }
+    String operator+(const String& o) const { return String(_s + o._s); }
+    String operator+(const char* o) const { return String(_s + o); }
+    bool operator==(const String& o) const { return _s == o._s; }
+    bool operator==(const char* o) const { return _s == o; }
+    bool operator!=(const String& o) const { return _s != o._s; }
+
+private:
+    std::string _s;
+};
@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "HostShim.h"
+#include "MessageOutput.h"
+#include <atomic>
+
+EspClass ESP;
+MessageOutputClass MessageOutput;
+
+static std::atomic<bool> fakeTime { false };
+static std::atomic<time_t> fakeNow { 0 };
+static uint32_t psramSize = 0;
+static esp_reset_reason_t resetReason = ESP_RST_POWERON;
+static const std::chrono::steady_clock::time_point bootTime = std::chrono::steady_clock::now();
+
+// Datasensor reads the time with time(), so the libc function is replaced for the tests
+extern "C" time_t time(time_t* result)
+{
+    time_t now;
+    if (fakeTime) {
+        now = fakeNow;
+    } else {
+        timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        now = ts.tv_sec;
+    }
+    if (result != nullptr) {
+        *result = now;
+    }
+    return now;
+}
+
+namespace HostShim {
+void setTime(time_t time)
+{
+    fakeNow = time;
+    fakeTime = true;
+}
+
+void advanceTime(time_t seconds)
+{
+    fakeNow += seconds;
+}
+
+void useSystemTime()
+{
+    fakeTime = false;
+}
+
+void setPsramSize(uint32_t size)
+{
+    psramSize = size;
+}
+
+void setResetReason(esp_reset_reason_t reason)
+{
+    resetReason = reason;
+}
+}
+
+unsigned long millis()
+{
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+unsigned long micros()
+{
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - bootTime).count();
+}
+
+bool getLocalTime(struct tm* info, uint32_t)
+{
+    time_t now = time(nullptr);
+    gmtime_r(&now, info);
+    return info->tm_year > (2016 - 1900);
+}
+
+esp_reset_reason_t esp_reset_reason()
+{
+    return resetReason;
+}
+
+uint32_t esp_random()
+{
+    static uint32_t state = 0x5eed1234;
+    state ^= state << 13;
+    state ^= state >> 17;
+    state ^= state << 5;
+    return state;
+}
+
+uint32_t EspClass::getPsramSize()
+{
+    return psramSize;
+}
+
+static bool verbose()
+{
+    static bool enabled = getenv("LOGGER_HOST_VERBOSE") != nullptr;
+    return enabled;
+}
+
+size_t MessageOutputClass::printf(const char* format, ...)
+{
+    if (!verbose()) {
+        return 0;
+    }
+    va_list args;
+    va_start(args, format);
+    int len = vfprintf(stderr, format, args);
+    va_end(args);
+    return len > 0 ? len : 0;
+}
+
+size_t MessageOutputClass::print(const char* str)
+{
+    return verbose() ? fprintf(stderr, "%s", str) : 0;
+}
+
+size_t MessageOutputClass::println(const char* str)
+{
+    return verbose() ? fprintf(stderr, "%s\n", str) : 0;
+}
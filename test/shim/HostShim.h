@@ -0,0 +1,13 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <Arduino.h>
+
+// Host build: state of the board the tests can change
+namespace HostShim {
+void setTime(time_t time); // time() and getLocalTime return it (UTC) instead of the system time, 0: not synchronized
+void advanceTime(time_t seconds);
+void useSystemTime();
+void setPsramSize(uint32_t size); // 0: no PSRAM, RamDriveClass::AllocateRamDrive uses 4096 bytes of RAM
+void setResetReason(esp_reset_reason_t reason);
+}
@@ -0,0 +1,16 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstdarg>
+#include <cstddef>
+#include <cstdio>
+
+// Host build: the console output is shown with LOGGER_HOST_VERBOSE=1
+class MessageOutputClass {
+public:
+    size_t printf(const char* format, ...);
+    size_t print(const char* str);
+    size_t println(const char* str = "");
+};
+
+extern MessageOutputClass MessageOutput;
@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <functional>
+#include <vector>
+
+// Host build: the tasks run when the test calls Scheduler::execute, the interval is not used
+
+#define TASK_MILLISECOND 1UL
+#define TASK_SECOND 1000UL
+#define TASK_MINUTE 60000UL
+#define TASK_IMMEDIATE 0
+#define TASK_FOREVER (-1)
+
+class Task {
+public:
+    Task(unsigned long, long, std::function<void()> callback)
+        : _callback(callback)
+    {
+    }
+    void enable() { _enabled = true; }
+    void disable() { _enabled = false; }
+    bool isEnabled() const { return _enabled; }
+    void run()
+    {
+        if (_enabled && _callback) {
+            _callback();
+        }
+    }
+
+private:
+    std::function<void()> _callback;
+    bool _enabled = false;
+};
+
+class Scheduler {
+public:
+    void addTask(Task& task) { _tasks.push_back(&task); }
+    void execute()
+    {
+        for (Task* task : _tasks) {
+            task->run();
+        }
+    }
+
+private:
+    std::vector<Task*> _tasks;
+};
@@ -0,0 +1,51 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Host build without the Arduino-FEC library (see RS_FEC_DIR in test/CMakeLists.txt): same interface, but the ecc is
+// only a checksum. Errors are detected, not corrected.
+namespace RS {
+
+template <const uint8_t msg_length, const uint8_t ecc_length>
+class ReedSolomon {
+public:
+    static_assert(static_cast<unsigned>(msg_length) + ecc_length <= 255, "longer than a Reed-Solomon codeword");
+
+    void EncodeBlock(const void* src, void* dst)
+    {
+        calc(static_cast<const uint8_t*>(src), static_cast<uint8_t*>(dst));
+    }
+
+    // src: message followed by the ecc, 0: valid, 1: error
+    int Decode(const void* src, void* dst, uint8_t* = nullptr, size_t = 0)
+    {
+        uint8_t ecc[ecc_length];
+        calc(static_cast<const uint8_t*>(src), ecc);
+        if (memcmp(ecc, static_cast<const uint8_t*>(src) + msg_length, ecc_length) != 0) {
+            return 1;
+        }
+        if (src != dst) {
+            memmove(dst, src, msg_length);
+        }
+        return 0;
+    }
+
+private:
+    void calc(const uint8_t* msg, uint8_t* ecc)
+    {
+        // FNV-1a
+        uint32_t hash = 2166136261u;
+        for (uint8_t i = 0; i < msg_length; i++) {
+            hash = (hash ^ msg[i]) * 16777619u;
+        }
+        for (uint8_t i = 0; i < ecc_length; i++) {
+            hash = (hash ^ i) * 16777619u;
+            ecc[i] = hash >> 24;
+        }
+    }
+};
+
+}
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Host stress test of the lock free readers (SeqLock) used by RamDriveClass::getFile.
+// One writer appends to a ring and overwrites the oldest entries, several readers stream the ring in chunks like
+// the response filler: the cursor is saved before a chunk and restored if the chunk was not valid.
+//
+//   g++ -std=gnu++17 -O2 -pthread -Iinclude test/stress/seqlock_stress.cpp -o seqlock_stress && ./seqlock_stress
+
+#include "Logger/SeqLock.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+struct Entry {
+    uint32_t time;
+    uint16_t serial;
+    uint16_t check; // depends on time and serial, a torn entry does not fit
+    float value;
+};
+
+static uint16_t checkOf(uint32_t time, uint16_t serial) { return static_cast<uint16_t>(time * 2654435761u >> 16) ^ serial; }
+
+const size_t RING_SIZE = 4096;
+const uint16_t SENSORS = 30;
+const size_t CHUNK_ENTRIES = 64;
+
+static Entry ring[RING_SIZE];
+static std::atomic<uint64_t> written { 0 }; // entries appended so far, the ring holds the last RING_SIZE
+static SeqLock seqLock;
+static std::atomic<bool> stop { false };
+
+static void writer()
+{
+    uint32_t time = 1;
+    while (!stop) {
+        seqLock.writeBegin();
+        for (uint16_t serial = 0; serial < SENSORS; serial++) {
+            Entry& entry = ring[written % RING_SIZE];
+            entry.time = time;
+            entry.serial = serial;
+            entry.value = time * 0.01f;
+            entry.check = checkOf(time, serial);
+            written++;
+        }
+        seqLock.writeEnd();
+        time++;
+    }
+}
+
+struct Cursor {
+    uint64_t pos = 0; // next entry
+    uint32_t lastTime = 0;
+};
+
+struct Result {
+    uint64_t chunks = 0;
+    uint64_t retries = 0;
+    uint64_t entries = 0;
+    uint64_t errors = 0;
+};
+
+// one chunk as the response filler does it, false at the end of the data
+static bool fillChunk(Cursor& cursor, uint16_t serial, std::vector<Entry>& out)
+{
+    out.clear();
+    uint64_t end = written;
+    uint64_t oldest = end > RING_SIZE ? end - RING_SIZE : 0;
+    if (cursor.pos < oldest) {
+        cursor.pos = oldest; // overwritten meanwhile -> continue with the oldest entry
+    }
+    while (cursor.pos < end && out.size() < CHUNK_ENTRIES) {
+        const Entry& entry = ring[cursor.pos++ % RING_SIZE];
+        if (entry.serial == serial) {
+            out.push_back(entry);
+        }
+    }
+    return cursor.pos < end || !out.empty();
+}
+
+static void reader(uint16_t serial, Result& result)
+{
+    std::vector<Entry> out;
+    while (!stop) {
+        Cursor cursor;
+        while (!stop) {
+            Cursor saved = cursor;
+            uint32_t seq = seqLock.readBegin();
+            bool more = fillChunk(cursor, serial, out);
+            if (!seqLock.readValid(seq)) {
+                cursor = saved;
+                result.retries++;
+                std::this_thread::yield();
+                continue;
+            }
+            result.chunks++;
+            for (const Entry& entry : out) {
+                result.entries++;
+                if (entry.serial != serial || entry.check != checkOf(entry.time, entry.serial) || entry.value != entry.time * 0.01f || entry.time <= cursor.lastTime) {
+                    result.errors++;
+                }
+                cursor.lastTime = entry.time;
+            }
+            if (!more) {
+                break;
+            }
+        }
+    }
+}
+
+int main()
+{
+    const int READERS = 4;
+    std::vector<Result> results(READERS);
+    std::vector<std::thread> threads;
+
+    threads.emplace_back(writer);
+    for (int i = 0; i < READERS; i++) {
+        threads.emplace_back(reader, static_cast<uint16_t>(i * 7 % SENSORS), std::ref(results[i]));
+    }
+    std::this_thread::sleep_for(std::chrono::seconds(3));
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+
+    uint64_t errors = 0;
+    for (int i = 0; i < READERS; i++) {
+        printf("reader %d: chunks %llu, retries %llu, entries %llu, errors %llu\n", i,
+            (unsigned long long)results[i].chunks, (unsigned long long)results[i].retries,
+            (unsigned long long)results[i].entries, (unsigned long long)results[i].errors);
+        errors += results[i].errors;
+    }
+    printf("written %llu, %s\n", (unsigned long long)written.load(), errors == 0 ? "OK" : "FAILED");
+    return errors == 0 ? 0 : 1;
+}
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Host stress test of the StagingRing used by RamDriveClass::writeValue.
+// Several producers stage values, the consumer is locked out from time to time (like a backup holding the mutex)
+// and drains in batches. Every value has to arrive exactly once and in order per producer, or be counted as
+// overflow.
+//
+//   g++ -std=gnu++17 -O2 -pthread -Iinclude test/stress/staging_ring_stress.cpp -o staging_ring_stress && ./staging_ring_stress
+
+#include "Logger/StagingRing.h"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <thread>
+#include <vector>
+
+struct Value {
+    uint16_t producer;
+    uint32_t seq;
+};
+
+const size_t RING_SIZE = 256;
+const size_t DRAIN_BATCH = 32;
+const int PRODUCERS = 3;
+
+static StagingRing<Value, RING_SIZE> ring;
+static std::atomic<bool> stop { false };
+static std::atomic<uint64_t> rejected { 0 };
+static uint32_t produced[PRODUCERS];
+
+static void producer(uint16_t id)
+{
+    uint32_t seq = 0;
+    while (!stop) {
+        if (!ring.push({ id, seq })) {
+            rejected++;
+        }
+        seq++; // a rejected value is lost, the consumer sees a gap
+        if ((seq & 63) == 0) {
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+        }
+    }
+    produced[id] = seq;
+}
+
+int main()
+{
+    std::vector<std::thread> threads;
+    for (int i = 0; i < PRODUCERS; i++) {
+        threads.emplace_back(producer, static_cast<uint16_t>(i));
+    }
+
+    std::vector<int64_t> last(PRODUCERS, -1);
+    uint64_t received = 0;
+    uint64_t gaps = 0;
+    uint64_t errors = 0;
+
+    auto consume = [&](size_t max) {
+        Value value;
+        for (size_t i = 0; i < max && ring.pop(value); i++) {
+            received++;
+            if (value.producer >= PRODUCERS || value.seq <= last[value.producer]) {
+                errors++; // duplicate or out of order
+                continue;
+            }
+            gaps += value.seq - last[value.producer] - 1;
+            last[value.producer] = value.seq;
+        }
+    };
+
+    auto begin = std::chrono::steady_clock::now();
+    while (std::chrono::steady_clock::now() - begin < std::chrono::seconds(3)) {
+        if ((received & 0xFFFF) < 0x100) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(2)); // busy, e.g. backup
+        }
+        consume(DRAIN_BATCH);
+    }
+    stop = true;
+    for (auto& thread : threads) {
+        thread.join();
+    }
+    consume(SIZE_MAX);
+    for (int i = 0; i < PRODUCERS; i++) {
+        gaps += produced[i] - last[i] - 1; // rejected at the end
+    }
+
+    printf("staged %u, drained %u, overflow %u, received %llu, gaps %llu, errors %llu\n",
+        ring.getStaged(), ring.getDrained(), ring.getOverflow(),
+        (unsigned long long)received, (unsigned long long)gaps, (unsigned long long)errors);
+
+    bool ok = errors == 0
+        && ring.getStaged() == ring.getDrained()
+        && received == ring.getDrained()
+        && gaps == ring.getOverflow()
+        && rejected == ring.getOverflow();
+    printf("%s\n", ok ? "OK" : "FAILED");
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,242 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Converts the day files of the SD card between the text and the binary format (SDCARD_FORMAT) on Linux, with the
+// DayFile code of the firmware. A converted text file is read back and compared line by line.
+//
+//   dayfile_convert <DD_SSSS.txt> [out.bin]   text to binary, default: the same name with .bin
+//   dayfile_convert <DD_SSSS.bin> [out.txt]   binary to text ("time;value" lines like the text file)
+//   dayfile_convert <dir>                     all DD_SSSS.txt below dir to binary, e.g. a copy of the card
+//
+// The start of the day is local midnight: run it with the TZ of the unit.
+
+#include "Logger/DayFile.h"
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <string>
+#include <sys/stat.h>
+#include <vector>
+
+namespace {
+
+bool endsWith(const std::string& text, const char* suffix)
+{
+    size_t len = strlen(suffix);
+    return text.size() >= len && text.compare(text.size() - len, len, suffix) == 0;
+}
+
+bool readFile(const std::string& path, std::string& data)
+{
+    FILE* file = fopen(path.c_str(), "rb");
+    if (file == nullptr) {
+        fprintf(stderr, "%s: cannot open\n", path.c_str());
+        return false;
+    }
+    data.clear();
+    char buffer[4096];
+    size_t len;
+    while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.append(buffer, len);
+    }
+    fclose(file);
+    return true;
+}
+
+bool writeFile(const std::string& path, const void* data, size_t len)
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (file == nullptr || fwrite(data, 1, len, file) != len) {
+        fprintf(stderr, "%s: cannot write\n", path.c_str());
+        if (file != nullptr) {
+            fclose(file);
+        }
+        return false;
+    }
+    return fclose(file) == 0;
+}
+
+// the lines of a binary file from start
+bool toText(const std::string& bytes, time_t start, std::string& text, uint32_t& skipped)
+{
+    if (bytes.size() < sizeof(dayFileHeader_t)) {
+        return false;
+    }
+    dayFileHeader_t header;
+    memcpy(&header, bytes.data(), sizeof(header));
+    if (!DayFile::isHeader(header)) {
+        return false;
+    }
+
+    DayFileReader reader(header, start, [&bytes](uint32_t index, dayFileBlock_t& block) {
+        size_t offset = DayFile::blockOffset(index);
+        if (offset + sizeof(block) > bytes.size()) {
+            return false;
+        }
+        memcpy(&block, &bytes[offset], sizeof(block));
+        return true;
+    });
+    uint8_t buffer[4096];
+    size_t len;
+    text.clear();
+    while ((len = reader.read(buffer, sizeof(buffer))) > 0) {
+        text.append(reinterpret_cast<char*>(buffer), len);
+    }
+    skipped = reader.getSkippedBlocks();
+    return true;
+}
+
+bool textToBinary(const std::string& in, const std::string& out)
+{
+    std::string text;
+    if (!readFile(in, text)) {
+        return false;
+    }
+    std::string name = in.substr(in.find_last_of('/') + 1);
+    unsigned day, serial;
+    if (sscanf(name.c_str(), "%2u_%4X.txt", &day, &serial) != 2) {
+        fprintf(stderr, "%s: not a day file DD_SSSS.txt\n", in.c_str());
+        return false;
+    }
+
+    // written like SDCardClass, a full block at a time
+    std::string bytes;
+    auto write = [&bytes](size_t offset, const void* data, size_t len) {
+        if (bytes.size() < offset + len) {
+            bytes.resize(offset + len);
+        }
+        memcpy(&bytes[offset], data, len);
+    };
+    auto flush = [&write](DayFileWriter& writer) {
+        write(0, &writer.header(), sizeof(dayFileHeader_t));
+        write(writer.blockOffset(), &writer.block(), sizeof(dayFileBlock_t));
+        writer.written();
+    };
+
+    DayFileWriter writer;
+    std::string expected;
+    size_t lines = 0, rejected = 0;
+    bool started = false;
+    for (size_t pos = 0; pos < text.size();) {
+        size_t end = text.find('\n', pos);
+        std::string line = text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+        pos = end == std::string::npos ? text.size() : end + 1;
+
+        time_t time;
+        float value;
+        if (!DayFile::parseLine(line.c_str(), time, value)) {
+            rejected += !line.empty() && line != "\r";
+            continue;
+        }
+        if (!started) {
+            writer.begin(serial, time);
+            started = true;
+        }
+        if (writer.full()) {
+            flush(writer);
+        }
+        if (!writer.add(time, value)) {
+            rejected++;
+            continue;
+        }
+        lines++;
+        char normalized[32];
+        snprintf(normalized, sizeof(normalized), "%ld;%.2f\n", static_cast<long>(time), value);
+        expected += normalized;
+    }
+    if (!started) {
+        fprintf(stderr, "%s: no lines\n", in.c_str());
+        return false;
+    }
+    flush(writer);
+
+    std::string check;
+    uint32_t skipped;
+    if (!toText(bytes, 0, check, skipped) || check != expected) {
+        fprintf(stderr, "%s: read back differs\n", in.c_str());
+        return false;
+    }
+    if (!writeFile(out, bytes.data(), bytes.size())) {
+        return false;
+    }
+    printf("%s: %zu lines, %zu rejected, %zu -> %zu bytes\n", in.c_str(), lines, rejected, text.size(), bytes.size());
+    return true;
+}
+
+bool binaryToText(const std::string& in, const std::string& out)
+{
+    std::string bytes, text;
+    uint32_t skipped;
+    if (!readFile(in, bytes)) {
+        return false;
+    }
+    if (!toText(bytes, 0, text, skipped)) {
+        fprintf(stderr, "%s: invalid header\n", in.c_str());
+        return false;
+    }
+    if (skipped > 0) {
+        fprintf(stderr, "%s: %u blocks with a wrong crc skipped\n", in.c_str(), skipped);
+    }
+    return writeFile(out, text.data(), text.size());
+}
+
+bool convertDirectory(const std::string& path, size_t& files)
+{
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        fprintf(stderr, "%s: cannot open\n", path.c_str());
+        return false;
+    }
+    bool ok = true;
+    while (dirent* entry = readdir(dir)) {
+        std::string name = entry->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+        std::string child = path + "/" + name;
+        struct stat info;
+        if (stat(child.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+            ok &= convertDirectory(child, files);
+        } else if (endsWith(name, ".txt")) {
+            ok &= textToBinary(child, child.substr(0, child.size() - 4) + ".bin");
+            files++;
+        }
+    }
+    closedir(dir);
+    return ok;
+}
+
+int usage()
+{
+    fprintf(stderr, "usage: dayfile_convert <DD_SSSS.txt> [out.bin] | <DD_SSSS.bin> [out.txt] | <dir>\n");
+    return 2;
+}
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || argc > 3) {
+        return usage();
+    }
+    const std::string in = argv[1];
+
+    struct stat info;
+    if (stat(in.c_str(), &info) == 0 && S_ISDIR(info.st_mode)) {
+        size_t files = 0;
+        bool ok = convertDirectory(in, files);
+        printf("%zu files\n", files);
+        return ok && files > 0 ? 0 : 1;
+    }
+
+    const std::string base = in.substr(0, in.size() - 4);
+    if (endsWith(in, ".txt")) {
+        return textToBinary(in, argc > 2 ? argv[2] : base + ".bin") ? 0 : 1;
+    }
+    if (endsWith(in, ".bin")) {
+        return binaryToText(in, argc > 2 ? argv[2] : base + ".txt") ? 0 : 1;
+    }
+    return usage();
+}
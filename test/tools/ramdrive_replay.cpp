@@ -0,0 +1,597 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+// Replay of a downloaded RamDrive backup (/api/livedata/backup) on Linux: the file is mapped and uploaded in chunks
+// into the RamBuffer code of the firmware, the ring lives in an anonymous mapping like in the PSRAM. Afterwards the
+// commands run on it, every one with its time.
+//
+//   ramdrive_replay [options] <backup> <command>...
+//   ramdrive_replay --synth <backup> <entry|block|compressed|compact|stream> <days> <sensors>
+//
+// options:
+//   --format entry|block|compressed|compact   ring of a raw or compressed backup (default entry), a block backup
+//                                             uses its own format
+//   --chunk N                                 upload chunk size (default 4096, at least 16)
+//
+// commands:
+//   info                                      sensors, entries and time range
+//   check                                     restart on the same memory and IntegrityCheck
+//   query <serials|all> <from> <to>           from <= time < to, unix time or YYYY-MM-DD[THH:MM[:SS]] (local), "-": open
+//   csv <file|->                              all entries "serial;time;value" in the stored order
+//   days <dir>                                day files <dir>/YYYY/MM/DD_SSSS.txt like SDCardClass (TZ of the unit!)
+//   backup <file> [raw|compressed]            backup of the ring, raw: the stored format
+
+#include "Datastore.h"
+#include "Logger/BackupStream.h"
+#include "Logger/RamBlockBuffer.h"
+#include "Logger/RamBuffer.h"
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <limits>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+const size_t CACHE_SIZE = 64 * 1024;
+
+class Timer {
+public:
+    double ms() const { return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - _start).count(); }
+
+private:
+    std::chrono::steady_clock::time_point _start = std::chrono::steady_clock::now();
+};
+
+void report(const char* name, double ms, const char* format, ...)
+{
+    char text[256];
+    va_list args;
+    va_start(args, format);
+    vsnprintf(text, sizeof(text), format, args);
+    va_end(args);
+    printf("%-10s %10.3f ms  %s\n", name, ms, text);
+}
+
+const char* formatName(RamBufferFormat format)
+{
+    switch (format) {
+    case RamBufferFormat::Entry:
+        return "entry";
+    case RamBufferFormat::Block:
+        return "block";
+    case RamBufferFormat::Compressed:
+        return "compressed";
+    default:
+        return "compact";
+    }
+}
+
+bool parseFormat(const char* name, RamBufferFormat& format)
+{
+    for (RamBufferFormat f : { RamBufferFormat::Entry, RamBufferFormat::Block, RamBufferFormat::Compressed, RamBufferFormat::Compact }) {
+        if (strcmp(name, formatName(f)) == 0) {
+            format = f;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool parseTime(const char* text, time_t open, time_t& time)
+{
+    if (strcmp(text, "-") == 0) {
+        time = open;
+        return true;
+    }
+    char* end;
+    long long value = strtoll(text, &end, 10);
+    if (*end == '\0') {
+        time = value;
+        return true;
+    }
+    struct tm info = {};
+    int n = sscanf(text, "%d-%d-%dT%d:%d:%d", &info.tm_year, &info.tm_mon, &info.tm_mday, &info.tm_hour, &info.tm_min, &info.tm_sec);
+    if (n < 3) {
+        return false;
+    }
+    info.tm_year -= 1900;
+    info.tm_mon -= 1;
+    info.tm_isdst = -1;
+    time = mktime(&info);
+    return time != -1;
+}
+
+// ring in an anonymous mapping like the PSRAM
+class Ring {
+public:
+    Ring(RamBufferFormat format, size_t size)
+        : _format(format)
+        , _size(size)
+        , _cache(CACHE_SIZE)
+    {
+        _memory = static_cast<uint8_t*>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        if (_memory == MAP_FAILED) {
+            _memory = nullptr;
+            return;
+        }
+        restart();
+        buffer->PowerOnInitialize();
+    }
+    ~Ring()
+    {
+        buffer.reset();
+        if (_memory != nullptr) {
+            munmap(_memory, _size);
+        }
+    }
+    bool valid() const { return _memory != nullptr; }
+
+    // a new object on the old memory, like after a reset
+    void restart()
+    {
+        if (_format == RamBufferFormat::Entry) {
+            buffer.reset(new RamBuffer(_memory, _size, _cache.data(), _cache.size()));
+        } else {
+            buffer.reset(new RamBlockBuffer(_memory, _size, _cache.data(), _cache.size(), _format));
+        }
+    }
+
+    static size_t sizeFor(RamBufferFormat format, size_t entries)
+    {
+        if (format == RamBufferFormat::Entry) {
+            return sizeof(dataEntryHeader_t) + (entries + 1) * (sizeof(dataEntryFEC_t) + sizeof(dataEntryLink_t));
+        }
+        // the Block format needs the most bytes per entry, the open block and the next one are not full
+        return sizeof(dataBlockHeader_t) + (entries / (BLOCK_PAYLOAD_LENGTH / sizeof(dataEntry_t)) + 3) * sizeof(dataBlock_t);
+    }
+
+    RamBufferFormat format() const { return _format; }
+    std::unique_ptr<IRamBuffer> buffer;
+
+private:
+    RamBufferFormat _format;
+    size_t _size;
+    uint8_t* _memory = nullptr;
+    std::vector<uint8_t> _cache;
+};
+
+// read-only mapping of the backup
+class MappedFile {
+public:
+    explicit MappedFile(const char* path)
+    {
+        int fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info;
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (data != MAP_FAILED) {
+                _data = static_cast<const uint8_t*>(data);
+                _size = info.st_size;
+            }
+        }
+        close(fd);
+    }
+    ~MappedFile()
+    {
+        if (_data != nullptr) {
+            munmap(const_cast<uint8_t*>(_data), _size);
+        }
+    }
+    const uint8_t* data() const { return _data; }
+    size_t size() const { return _size; }
+
+private:
+    const uint8_t* _data = nullptr;
+    size_t _size = 0;
+};
+
+std::unique_ptr<Ring> load(const char* path, RamBufferFormat format, size_t chunk)
+{
+    Timer timer;
+    MappedFile file(path);
+    if (file.data() == nullptr || file.size() < BACKUPSTREAM_HEADER_LENGTH) {
+        fprintf(stderr, "%s: no backup\n", path);
+        return nullptr;
+    }
+    report("map", timer.ms(), "%s, %zu bytes", path, file.size());
+
+    std::unique_ptr<Ring> ring;
+    if (memcmp(file.data(), BACKUPSTREAM_MAGIC, sizeof(BACKUPSTREAM_MAGIC)) == 0) {
+        // compressed backup, decoded like RamDriveClass::restoreBackup
+        timer = Timer();
+        BackupStreamDecoder decoder;
+        std::vector<dataEntry_t> entries;
+        for (size_t pos = 0; pos < file.size(); pos += chunk) {
+            if (!decoder.write(file.data() + pos, min(chunk, file.size() - pos), entries)) {
+                fprintf(stderr, "%s: corrupt compressed backup at %zu\n", path, pos);
+                return nullptr;
+            }
+        }
+        if (!decoder.finished()) {
+            fprintf(stderr, "%s: compressed backup without trailer\n", path);
+            return nullptr;
+        }
+        report("decode", timer.ms(), "compressed backup, %zu entries", entries.size());
+
+        timer = Timer();
+        ring = std::make_unique<Ring>(format, Ring::sizeFor(format, entries.size()));
+        if (!ring->valid()) {
+            return nullptr;
+        }
+        ring->buffer->writeBatch(entries.data(), entries.size());
+        report("restore", timer.ms(), "%s ring, %zu bytes", formatName(format), ring->buffer->getTotalBytes());
+        return ring;
+    }
+
+    size_t size = Ring::sizeFor(format, file.size() / sizeof(dataEntryFEC_t));
+    if (memcmp(file.data(), RAMBUFFER_BACKUP_MAGIC, sizeof(RAMBUFFER_BACKUP_MAGIC)) == 0) {
+        format = static_cast<RamBufferFormat>(reinterpret_cast<const dataBlockBackup_t*>(file.data())->format);
+        size = sizeof(dataBlockHeader_t) + file.size() + sizeof(dataBlock_t);
+    }
+
+    // the upload of the web interface, in chunks
+    timer = Timer();
+    ring = std::make_unique<Ring>(format, size);
+    if (!ring->valid()) {
+        return nullptr;
+    }
+    for (size_t pos = 0; pos < file.size(); pos += chunk) {
+        size_t len = min(chunk, file.size() - pos);
+        if (!ring->buffer->restoreBackup(pos, file.data() + pos, len, pos + len == file.size())) {
+            fprintf(stderr, "%s: restore failed at %zu\n", path, pos);
+            return nullptr;
+        }
+    }
+    report("restore", timer.ms(), "%s ring, %zu bytes", formatName(format), ring->buffer->getTotalBytes());
+    return ring;
+}
+
+void info(Ring& ring)
+{
+    struct Sensor {
+        size_t count = 0;
+        time_t first = 0;
+        time_t last = 0;
+    };
+    std::map<uint16_t, Sensor> sensors;
+
+    Timer timer;
+    IRamBuffer& buffer = *ring.buffer;
+    RamBufferSnapshot snapshot = buffer.getSnapshot();
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t entries = 0;
+    size_t unordered = 0;
+    time_t previous = 0;
+    while (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+        Sensor& sensor = sensors[entry.serial];
+        if (sensor.count++ == 0) {
+            sensor.first = entry.time;
+        }
+        sensor.last = max(sensor.last, entry.time);
+        unordered += entry.time < previous;
+        previous = entry.time;
+        entries++;
+    }
+    report("info", timer.ms(), "%s, %zu entries, %zu sensors, %zu/%zu bytes, %zu out of order", formatName(ring.format()), entries,
+        sensors.size(), buffer.getUsedBytes(), buffer.getTotalBytes(), unordered);
+
+    for (const auto& it : sensors) {
+        char first[32], last[32];
+        struct tm tm;
+        localtime_r(&it.second.first, &tm);
+        strftime(first, sizeof(first), "%Y-%m-%d %H:%M:%S", &tm);
+        localtime_r(&it.second.last, &tm);
+        strftime(last, sizeof(last), "%Y-%m-%d %H:%M:%S", &tm);
+        printf("    %04X %8zu entries  %s .. %s\n", it.first, it.second.count, first, last);
+    }
+}
+
+void check(Ring& ring)
+{
+    // reset: the new object knows only the memory
+    ring.restart();
+    IRamBuffer& buffer = *ring.buffer;
+
+    Timer timer;
+    if (!buffer.beginIntegrityCheck(true)) {
+        report("check", timer.ms(), "header invalid");
+        return;
+    }
+    report("check", timer.ms(), "header");
+
+    timer = Timer();
+    IntegrityState state;
+    while ((state = buffer.continueIntegrityCheck(SIZE_MAX)) == IntegrityState::Verifying) { }
+    report("check", timer.ms(), "%s, %zu errors, %zu reboots", state == IntegrityState::Verified ? "verified" : "failed",
+        buffer.getErrorCount(), buffer.getRebootCount());
+}
+
+bool query(Ring& ring, const char* serialList, const char* fromText, const char* toText)
+{
+    time_t from, to;
+    if (!parseTime(fromText, 0, from) || !parseTime(toText, std::numeric_limits<time_t>::max(), to)) {
+        fprintf(stderr, "query: invalid time\n");
+        return false;
+    }
+
+    std::vector<uint16_t> serials;
+    IRamBuffer& buffer = *ring.buffer;
+    if (strcmp(serialList, "all") == 0) {
+        RamBufferSnapshot snapshot = buffer.getSnapshot();
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        while (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+            if (std::find(serials.begin(), serials.end(), entry.serial) == serials.end()) {
+                serials.push_back(entry.serial);
+            }
+        }
+    } else {
+        std::string list = serialList;
+        for (size_t pos = 0; pos < list.size();) {
+            size_t next = list.find(',', pos);
+            serials.push_back(strtoul(list.substr(pos, next - pos).c_str(), nullptr, 16));
+            pos = next == std::string::npos ? list.size() : next + 1;
+        }
+    }
+
+    Timer timer;
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    double firstMs = 0;
+    size_t count = 0;
+    while (buffer.getEntry(serials, from, to, cursor, entry)) {
+        if (count++ == 0) {
+            firstMs = timer.ms();
+        }
+    }
+    double ms = timer.ms();
+    report("query", ms, "%zu sensors, %zu entries, first after %.3f ms, %.0f entries/s", serials.size(), count, firstMs,
+        ms > 0 ? count / ms * 1000 : 0.0);
+    return true;
+}
+
+bool csv(Ring& ring, const char* path)
+{
+    FILE* file = strcmp(path, "-") == 0 ? stdout : fopen(path, "w");
+    if (file == nullptr) {
+        fprintf(stderr, "csv: can not create %s\n", path);
+        return false;
+    }
+
+    Timer timer;
+    IRamBuffer& buffer = *ring.buffer;
+    RamBufferSnapshot snapshot = buffer.getSnapshot();
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t count = 0;
+    fprintf(file, "serial;time;value\n");
+    while (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+        fprintf(file, "%04X;%ld;%.2f\n", entry.serial, static_cast<long>(entry.time), entry.value);
+        count++;
+    }
+    if (file != stdout) {
+        fclose(file);
+    }
+    report("csv", timer.ms(), "%zu entries to %s", count, path);
+    return true;
+}
+
+bool days(Ring& ring, const char* dir)
+{
+    // one open file per sensor, a new one when its day changes
+    struct DayFile {
+        int day = -1;
+        FILE* file = nullptr;
+    };
+    std::map<uint16_t, DayFile> files;
+    size_t count = 0, created = 0;
+
+    Timer timer;
+    IRamBuffer& buffer = *ring.buffer;
+    RamBufferSnapshot snapshot = buffer.getSnapshot();
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    bool ok = true;
+    while (ok && buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+        struct tm timeinfo;
+        Datastore.getTmTime(&timeinfo, entry.time, 0);
+        int day = (timeinfo.tm_year * 12 + timeinfo.tm_mon) * 32 + timeinfo.tm_mday;
+
+        DayFile& dayFile = files[entry.serial];
+        if (dayFile.day != day) {
+            if (dayFile.file != nullptr) {
+                fclose(dayFile.file);
+            }
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%04d", dir, timeinfo.tm_year + 1900);
+            mkdir(dir, 0755);
+            mkdir(path, 0755);
+            snprintf(&path[strlen(path)], sizeof(path) - strlen(path), "/%02d", timeinfo.tm_mon + 1);
+            mkdir(path, 0755);
+            snprintf(&path[strlen(path)], sizeof(path) - strlen(path), "/%02d_%04X.txt", timeinfo.tm_mday, entry.serial);
+            dayFile.file = fopen(path, "a");
+            dayFile.day = day;
+            created++;
+            if (dayFile.file == nullptr) {
+                fprintf(stderr, "days: can not create %s\n", path);
+                ok = false;
+                break;
+            }
+        }
+        fprintf(dayFile.file, "%ld;%.2f\n", static_cast<long>(entry.time), entry.value);
+        count++;
+    }
+    for (auto& it : files) {
+        if (it.second.file != nullptr) {
+            fclose(it.second.file);
+        }
+    }
+    report("days", timer.ms(), "%zu entries, %zu day files in %s", count, created, dir);
+    return ok;
+}
+
+bool backup(Ring& ring, const char* path, bool compressed)
+{
+    FILE* file = fopen(path, "wb");
+    if (file == nullptr) {
+        fprintf(stderr, "backup: can not create %s\n", path);
+        return false;
+    }
+
+    Timer timer;
+    IRamBuffer& buffer = *ring.buffer;
+    RamBufferSnapshot snapshot = buffer.getSnapshot();
+    std::vector<uint8_t> chunk(4096);
+    size_t total = 0;
+    if (compressed) {
+        BackupStreamEncoder encoder;
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        bool finished = false;
+        while (!finished) {
+            encoder.begin(chunk.data(), chunk.size());
+            while (!encoder.full() && !finished) {
+                if (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+                    encoder.add(entry);
+                } else {
+                    encoder.finish();
+                    finished = true;
+                }
+            }
+            fwrite(chunk.data(), 1, encoder.end(), file);
+            total += encoder.end();
+        }
+        // the rest of the trailer
+        for (encoder.begin(chunk.data(), chunk.size()); encoder.end() > 0; encoder.begin(chunk.data(), chunk.size())) {
+            fwrite(chunk.data(), 1, encoder.end(), file);
+            total += encoder.end();
+        }
+    } else {
+        for (size_t len; (len = buffer.readBackup(snapshot, total, chunk.data(), chunk.size())) > 0; total += len) {
+            fwrite(chunk.data(), 1, len, file);
+        }
+    }
+    fclose(file);
+    report("backup", timer.ms(), "%s, %zu bytes to %s", compressed ? "compressed" : "raw", total, path);
+    return true;
+}
+
+// synthetic backup: sensors polled every 60 seconds for days, temperatures as random walk
+int synth(const char* path, const char* formatText, int dayCount, int sensorCount)
+{
+    bool stream = strcmp(formatText, "stream") == 0;
+    RamBufferFormat format = RamBufferFormat::Entry;
+    if ((!stream && !parseFormat(formatText, format)) || dayCount <= 0 || sensorCount <= 0 || sensorCount > 250) {
+        fprintf(stderr, "synth: invalid arguments\n");
+        return 1;
+    }
+
+    Timer timer;
+    const size_t polls = static_cast<size_t>(dayCount) * 24 * 60;
+    Ring ring(format, Ring::sizeFor(format, polls * sensorCount));
+    if (!ring.valid()) {
+        return 1;
+    }
+    std::mt19937 rng(1);
+    std::normal_distribution<float> step(0.0f, 0.05f);
+    std::vector<float> values(sensorCount, 20.0f);
+    std::vector<dataEntry_t> poll(sensorCount);
+    time_t time = 1700000000;
+    for (size_t p = 0; p < polls; p++, time += 60) {
+        for (int s = 0; s < sensorCount; s++) {
+            values[s] += step(rng);
+            poll[s] = { static_cast<uint16_t>(0x2800 + s), time, roundf(values[s] * 16.0f) / 16.0f }; // DS18B20 resolution
+        }
+        ring.buffer->writeBatch(poll.data(), poll.size());
+    }
+    report("synth", timer.ms(), "%zu entries, %s", polls * sensorCount, stream ? "compressed" : formatName(format));
+    return backup(ring, path, stream) ? 0 : 1;
+}
+
+int usage()
+{
+    fprintf(stderr,
+        "usage: ramdrive_replay [--format entry|block|compressed|compact] [--chunk N] <backup> <command>...\n"
+        "       ramdrive_replay --synth <backup> <entry|block|compressed|compact|stream> <days> <sensors>\n"
+        "commands: info | check | query <serials|all> <from> <to> | csv <file|-> | days <dir> | backup <file> [raw|compressed]\n");
+    return 2;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    RamBufferFormat format = RamBufferFormat::Entry;
+    size_t chunk = 4096;
+    int arg = 1;
+    for (; arg < argc && strncmp(argv[arg], "--", 2) == 0; arg++) {
+        if (strcmp(argv[arg], "--synth") == 0) {
+            return arg + 4 < argc ? synth(argv[arg + 1], argv[arg + 2], atoi(argv[arg + 3]), atoi(argv[arg + 4])) : usage();
+        } else if (strcmp(argv[arg], "--format") == 0 && arg + 1 < argc && parseFormat(argv[arg + 1], format)) {
+            arg++;
+        } else if (strcmp(argv[arg], "--chunk") == 0 && arg + 1 < argc && atoi(argv[arg + 1]) >= 16) {
+            chunk = atoi(argv[++arg]);
+        } else {
+            return usage();
+        }
+    }
+    if (arg >= argc) {
+        return usage();
+    }
+
+    std::unique_ptr<Ring> ring = load(argv[arg++], format, chunk);
+    if (!ring) {
+        return 1;
+    }
+
+    while (arg < argc) {
+        const char* command = argv[arg++];
+        const int left = argc - arg;
+        bool ok;
+        if (strcmp(command, "info") == 0) {
+            info(*ring);
+            ok = true;
+        } else if (strcmp(command, "check") == 0) {
+            check(*ring);
+            ok = true;
+        } else if (strcmp(command, "query") == 0 && left >= 3) {
+            ok = query(*ring, argv[arg], argv[arg + 1], argv[arg + 2]);
+            arg += 3;
+        } else if (strcmp(command, "csv") == 0 && left >= 1) {
+            ok = csv(*ring, argv[arg++]);
+        } else if (strcmp(command, "days") == 0 && left >= 1) {
+            ok = days(*ring, argv[arg++]);
+        } else if (strcmp(command, "backup") == 0 && left >= 1) {
+            const char* path = argv[arg++];
+            bool compressed = arg < argc && strcmp(argv[arg], "compressed") == 0;
+            if (arg < argc && (compressed || strcmp(argv[arg], "raw") == 0)) {
+                arg++;
+            }
+            ok = backup(*ring, path, compressed);
+        } else {
+            return usage();
+        }
+        if (!ok) {
+            return 1;
+        }
+    }
+    return 0;
+}
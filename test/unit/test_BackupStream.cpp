@@ -0,0 +1,124 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/BackupStream.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+static bool operator==(const dataEntry_t& a, const dataEntry_t& b)
+{
+    return a.serial == b.serial && a.time == b.time && memcmp(&a.value, &b.value, sizeof(float)) == 0;
+}
+
+namespace {
+
+std::vector<dataEntry_t> sample()
+{
+    std::vector<dataEntry_t> entries;
+    for (int i = 0; i < 2000; i++) {
+        entries.push_back({ static_cast<uint16_t>(0x3f00 + i % 7), static_cast<time_t>(1700000000 + i * 9), 18.0f + (i % 50) / 16.0f });
+    }
+    entries.push_back({ 0x1234, 1700100000, 21.1f }); // not a multiple of 1/16: raw float
+    entries.push_back({ 0x1234, 1600000000, -5.3f }); // time goes back
+    return entries;
+}
+
+// encoded into buffers of bufferSize bytes
+std::vector<uint8_t> encode(const std::vector<dataEntry_t>& entries, size_t bufferSize)
+{
+    BackupStreamEncoder encoder;
+    std::vector<uint8_t> stream;
+    std::vector<uint8_t> buffer(bufferSize);
+    size_t next = 0;
+    bool finished = false;
+    while (true) {
+        encoder.begin(buffer.data(), buffer.size());
+        while (!encoder.full() && next < entries.size()) {
+            encoder.add(entries[next++]);
+        }
+        if (!encoder.full() && next == entries.size() && !finished) {
+            encoder.finish();
+            finished = true;
+        }
+        stream.insert(stream.end(), buffer.begin(), buffer.begin() + encoder.end());
+        if (finished && encoder.end() < buffer.size()) {
+            break;
+        }
+    }
+    return stream;
+}
+
+TEST(BackupStream, RoundTrip)
+{
+    auto entries = sample();
+    auto stream = encode(entries, 4096);
+    EXPECT_LT(stream.size(), entries.size() * sizeof(dataEntry_t) / 2);
+
+    BackupStreamDecoder decoder;
+    std::vector<dataEntry_t> decoded;
+    ASSERT_TRUE(decoder.write(stream.data(), stream.size(), decoded));
+    EXPECT_TRUE(decoder.finished());
+    EXPECT_EQ(decoder.getCount(), entries.size());
+    EXPECT_EQ(decoded, entries);
+}
+
+TEST(BackupStream, SplitBuffersAndChunks)
+{
+    auto entries = sample();
+    auto whole = encode(entries, 4096);
+    for (size_t size : { 7, 13, 64, 1000 }) {
+        auto stream = encode(entries, size);
+        ASSERT_EQ(stream, whole) << "buffer size " << size;
+
+        BackupStreamDecoder decoder;
+        std::vector<dataEntry_t> decoded;
+        for (size_t offset = 0; offset < stream.size(); offset += size) {
+            ASSERT_TRUE(decoder.write(&stream[offset], min(size, stream.size() - offset), decoded));
+        }
+        EXPECT_TRUE(decoder.finished());
+        EXPECT_EQ(decoded, entries);
+    }
+}
+
+TEST(BackupStream, ManySensorsReuseSlots)
+{
+    std::vector<dataEntry_t> entries;
+    for (int i = 0; i < 1000; i++) {
+        entries.push_back({ static_cast<uint16_t>(i % 300), static_cast<time_t>(1700000000 + i), 1.0f });
+    }
+    auto stream = encode(entries, 512);
+    BackupStreamDecoder decoder;
+    std::vector<dataEntry_t> decoded;
+    ASSERT_TRUE(decoder.write(stream.data(), stream.size(), decoded));
+    EXPECT_EQ(decoded, entries);
+}
+
+TEST(BackupStream, CorruptStreamIsRejected)
+{
+    auto stream = encode(sample(), 4096);
+    std::vector<dataEntry_t> decoded;
+
+    auto wrongCrc = stream;
+    wrongCrc[wrongCrc.size() - 1] ^= 1;
+    BackupStreamDecoder crcDecoder;
+    EXPECT_FALSE(crcDecoder.write(wrongCrc.data(), wrongCrc.size(), decoded));
+    EXPECT_FALSE(crcDecoder.finished());
+
+    auto wrongMagic = stream;
+    wrongMagic[0] = 'X';
+    BackupStreamDecoder magicDecoder;
+    EXPECT_FALSE(magicDecoder.write(wrongMagic.data(), wrongMagic.size(), decoded));
+
+    auto trailing = stream;
+    trailing.push_back(0);
+    BackupStreamDecoder trailingDecoder;
+    EXPECT_FALSE(trailingDecoder.write(trailing.data(), trailing.size(), decoded));
+
+    BackupStreamDecoder truncatedDecoder;
+    EXPECT_TRUE(truncatedDecoder.write(stream.data(), stream.size() - 3, decoded));
+    EXPECT_FALSE(truncatedDecoder.finished());
+}
+
+}
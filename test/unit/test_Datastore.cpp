@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Datastore.h"
+#include "HostShim.h"
+#include <gtest/gtest.h>
+#include <vector>
+
+namespace {
+
+const time_t START = 1700000000; // 2023-11-14 22:13:20 UTC
+
+// records the batches
+class DeviceMock : public IDataStoreDevice {
+public:
+    void writeValue(uint16_t serial, time_t time, float value) override { batches.push_back({ { serial, time, value } }); }
+    void writeBatch(const dataEntry_t* entries, size_t count) override { batches.emplace_back(entries, entries + count); }
+    bool getFile(const std::vector<uint16_t>&, time_t, uint32_t length, uint32_t, GraphDataFormat, ResponseFiller&) override
+    {
+        fileLength = length;
+        return true;
+    }
+    bool getTileFile(const std::vector<uint16_t>&, time_t, uint32_t, uint32_t, GraphDataFormat, ResponseFiller&) override { return false; }
+    bool getBackup(BackupRange&, ResponseFiller&) override { return false; }
+    bool restoreBackup(size_t, const uint8_t*, size_t, bool) override { return false; }
+
+    std::vector<std::vector<dataEntry_t>> batches;
+    uint32_t fileLength = 0;
+};
+
+class DatastoreTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        HostShim::setTime(START);
+        _datastore.init(&_device);
+        _datastore.addSensor(1);
+        _datastore.addSensor(2);
+    }
+
+    void TearDown() override { HostShim::useSystemTime(); }
+
+    DeviceMock _device;
+    DatastoreClass _datastore;
+};
+
+TEST_F(DatastoreTest, OnlyChangesAreWritten)
+{
+    _datastore.addValue(1, 20.0f);
+    ASSERT_EQ(_device.batches.size(), 1u);
+    EXPECT_EQ(_device.batches[0][0].time, START);
+
+    // unchanged: nothing written
+    HostShim::advanceTime(60);
+    _datastore.addValue(1, 20.0f);
+    HostShim::advanceTime(60);
+    _datastore.addValue(1, 20.0f);
+    EXPECT_EQ(_device.batches.size(), 1u);
+
+    // changed: the last time of the old value and the new one
+    HostShim::advanceTime(60);
+    _datastore.addValue(1, 21.0f);
+    ASSERT_EQ(_device.batches.size(), 2u);
+    ASSERT_EQ(_device.batches[1].size(), 2u);
+    EXPECT_EQ(_device.batches[1][0].time, START + 120);
+    EXPECT_EQ(_device.batches[1][0].value, 20.0f);
+    EXPECT_EQ(_device.batches[1][1].time, START + 180);
+    EXPECT_EQ(_device.batches[1][1].value, 21.0f);
+}
+
+TEST_F(DatastoreTest, OnePollIsOneBatch)
+{
+    _datastore.addValues({ { 1, 20.0f }, { 2, 30.0f }, { 3, 40.0f } }); // 3 is unknown
+    ASSERT_EQ(_device.batches.size(), 1u);
+    ASSERT_EQ(_device.batches[0].size(), 2u);
+    EXPECT_EQ(_device.batches[0][1].serial, 2);
+
+    uint32_t time;
+    float value;
+    ASSERT_TRUE(_datastore.getTemperature(2, time, value));
+    EXPECT_EQ(time, static_cast<uint32_t>(START));
+    EXPECT_EQ(value, 30.0f);
+    EXPECT_FALSE(_datastore.getTemperature(3, time, value));
+}
+
+TEST_F(DatastoreTest, NewDayWritesValue)
+{
+    _datastore.addValue(1, 20.0f);
+    HostShim::setTime(START - START % 86400 + 86400 + 10); // next day
+    _datastore.addValue(1, 20.0f);
+    ASSERT_EQ(_device.batches.size(), 2u);
+    EXPECT_EQ(_device.batches[1].back().time, START - START % 86400 + 86400 + 10);
+}
+
+TEST_F(DatastoreTest, NoTimeNoWrite)
+{
+    HostShim::setTime(0);
+    _datastore.addValue(1, 20.0f);
+    EXPECT_TRUE(_device.batches.empty());
+    EXPECT_TRUE(_datastore.valueChanged(1, 60));
+}
+
+TEST_F(DatastoreTest, RangeFallsBackToFile)
+{
+    RangeQuery range;
+    range.serials = { 1 };
+    range.from = START;
+    range.to = START + 100;
+    ResponseFiller filler;
+    EXPECT_TRUE(_datastore.getTemperatureRange(range, GraphDataFormat::Text, filler));
+    EXPECT_EQ(_device.fileLength, 99u); // to is excluded
+
+    range.cursor = "1-2-3-4";
+    EXPECT_FALSE(_datastore.getTemperatureRange(range, GraphDataFormat::Text, filler));
+}
+
+}
@@ -0,0 +1,296 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/DayFile.h"
+#include <gtest/gtest.h>
+#include <string>
+#include <vector>
+
+namespace {
+
+const uint16_t SERIAL = 0x2800;
+const time_t DAY = DayFile::dayStart(1700000000);
+
+// the file on the card, written like SDCardClass writes it
+class CardFile {
+public:
+    void flush(DayFileWriter& writer)
+    {
+        if (writer.headerChanged()) {
+            write(0, &writer.header(), sizeof(dayFileHeader_t));
+        }
+        write(writer.blockOffset(), &writer.block(), sizeof(dayFileBlock_t));
+        writer.written();
+    }
+
+    void write(size_t offset, const void* data, size_t len)
+    {
+        if (bytes.size() < offset + len) {
+            bytes.resize(offset + len);
+        }
+        memcpy(&bytes[offset], data, len);
+    }
+
+    const dayFileHeader_t& header() const { return *reinterpret_cast<const dayFileHeader_t*>(bytes.data()); }
+    uint32_t blocks() const { return (bytes.size() - sizeof(dayFileHeader_t)) / sizeof(dayFileBlock_t); }
+    dayFileBlock_t* block(uint32_t index) { return reinterpret_cast<dayFileBlock_t*>(&bytes[DayFile::blockOffset(index)]); }
+
+    DayFileReader::BlockReader reader()
+    {
+        return [this](uint32_t index, dayFileBlock_t& block) {
+            reads.push_back(index);
+            if (index >= blocks()) {
+                return false;
+            }
+            memcpy(&block, this->block(index), sizeof(block));
+            return true;
+        };
+    }
+
+    std::vector<uint8_t> bytes;
+    std::vector<uint32_t> reads;
+};
+
+float valueAt(int i) { return 18.0f + (i % 300) / 100.0f - (i % 7) * 0.25f; }
+
+// one value per minute, written after every 10 values and when a block is full
+std::string writeDay(CardFile& file, DayFileWriter& writer, int count)
+{
+    std::string text;
+    writer.begin(SERIAL, DAY + 30);
+    for (int i = 0; i < count; i++) {
+        if (writer.full()) {
+            file.flush(writer);
+        }
+        time_t time = DAY + i * 60;
+        EXPECT_TRUE(writer.add(time, valueAt(i)));
+        if (i % 10 == 9) {
+            file.flush(writer);
+        }
+
+        char line[32];
+        snprintf(line, sizeof(line), "%ld;%.2f\n", static_cast<long>(time), valueAt(i));
+        text += line;
+    }
+    file.flush(writer);
+    return text;
+}
+
+std::string readAll(DayFileReader& reader, size_t bufferSize)
+{
+    std::string text;
+    std::vector<uint8_t> buffer(bufferSize);
+    size_t len;
+    while ((len = reader.read(buffer.data(), buffer.size())) > 0) {
+        text.append(reinterpret_cast<char*>(buffer.data()), len);
+        if (len < buffer.size()) {
+            break; // like the responseFiller
+        }
+    }
+    return text;
+}
+
+} // namespace
+
+TEST(DayFileTest, ReadsLikeTheTextFile)
+{
+    CardFile file;
+    DayFileWriter writer;
+    std::string text = writeDay(file, writer, 24 * 60);
+
+    ASSERT_TRUE(DayFile::isHeader(file.header()));
+    EXPECT_EQ(file.blocks(), (24 * 60 + DAYFILE_BLOCK_RECORDS - 1) / DAYFILE_BLOCK_RECORDS);
+
+    for (size_t bufferSize : { 7, 512, 4096 }) {
+        DayFileReader reader(file.header(), DAY, file.reader());
+        EXPECT_EQ(readAll(reader, bufferSize), text) << bufferSize;
+        EXPECT_EQ(reader.getSkippedBlocks(), 0u);
+    }
+}
+
+TEST(DayFileTest, StartSeeksToItsHour)
+{
+    CardFile file;
+    DayFileWriter writer;
+    std::string text = writeDay(file, writer, 24 * 60);
+
+    const time_t start = DAY + 20 * 3600 + 30 * 60 + 15; // 20:30:15, the first line is 20:31
+    DayFileReader reader(file.header(), start, file.reader());
+    std::string lines = readAll(reader, 1024);
+
+    char first[32];
+    snprintf(first, sizeof(first), "%ld;", static_cast<long>(DAY + (20 * 60 + 31) * 60));
+    EXPECT_EQ(lines, text.substr(text.find(first)));
+
+    // the first block read holds the first record of 20:00
+    ASSERT_FALSE(file.reads.empty());
+    EXPECT_EQ(file.reads.front(), (20u * 60) / DAYFILE_BLOCK_RECORDS);
+}
+
+TEST(DayFileTest, HoursWithoutRecords)
+{
+    CardFile file;
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY);
+    ASSERT_TRUE(writer.add(DAY + 3 * 3600, 20.0f));
+    ASSERT_TRUE(writer.add(DAY + 9 * 3600 + 5, 21.0f));
+    file.flush(writer);
+
+    EXPECT_EQ(DayFile::findRecord(file.header(), DAY), 0u);
+    EXPECT_EQ(DayFile::findRecord(file.header(), DAY + 4 * 3600), 1u); // the next hour with a record
+    EXPECT_EQ(DayFile::findRecord(file.header(), DAY + 10 * 3600), DAYFILE_NO_RECORD);
+
+    DayFileReader reader(file.header(), DAY + 10 * 3600, file.reader());
+    uint8_t buffer[64];
+    EXPECT_EQ(reader.read(buffer, sizeof(buffer)), 0u);
+    EXPECT_TRUE(file.reads.empty());
+}
+
+TEST(DayFileTest, CorruptBlockIsSkipped)
+{
+    CardFile file;
+    DayFileWriter writer;
+    std::string text = writeDay(file, writer, 3 * DAYFILE_BLOCK_RECORDS);
+    file.block(1)->records[5].value ^= 0x10;
+
+    DayFileReader reader(file.header(), DAY, file.reader());
+    std::string lines = readAll(reader, 256);
+    EXPECT_EQ(reader.getSkippedBlocks(), 1u);
+    EXPECT_EQ(std::count(lines.begin(), lines.end(), '\n'), 2 * DAYFILE_BLOCK_RECORDS);
+}
+
+TEST(DayFileTest, ValuesOutsideTheDayAreRejected)
+{
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY + 100);
+    EXPECT_FALSE(writer.add(DAY - 1, 20.0f));
+    EXPECT_FALSE(writer.add(DAY + DAYFILE_HOURS * 3600, 20.0f));
+    EXPECT_FALSE(writer.add(DAY + 100, NAN));
+    EXPECT_TRUE(writer.add(DAY + 24 * 3600 + 10, 20.0f)); // the 25th hour
+
+    for (int i = 1; i < DAYFILE_BLOCK_RECORDS; i++) {
+        EXPECT_TRUE(writer.add(DAY + i, 20.0f));
+    }
+    EXPECT_TRUE(writer.full());
+    EXPECT_FALSE(writer.add(DAY + 1000, 20.0f)); // the block has to be written first
+}
+
+TEST(DayFileTest, ValuesAreClampedToTheRecord)
+{
+    CardFile file;
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY);
+    ASSERT_TRUE(writer.add(DAY, -1000.0f));
+    ASSERT_TRUE(writer.add(DAY + 1, 1000.0f));
+    ASSERT_TRUE(writer.add(DAY + 2, -0.004f));
+    file.flush(writer);
+
+    DayFileReader reader(file.header(), DAY, file.reader());
+    char expected[96];
+    snprintf(expected, sizeof(expected), "%ld;-327.68\n%ld;327.67\n%ld;0.00\n", static_cast<long>(DAY), static_cast<long>(DAY + 1), static_cast<long>(DAY + 2));
+    EXPECT_EQ(readAll(reader, 256), expected);
+}
+
+TEST(DayFileTest, ResumeAfterReset)
+{
+    CardFile file;
+    std::string text;
+    {
+        DayFileWriter writer;
+        text = writeDay(file, writer, 100); // ends in a partial block
+    }
+    const uint32_t blocks = file.blocks();
+
+    // after the reset: new values are buffered, the file is read when they are written
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY + 100 * 60);
+    for (int i = 100; i < 110; i++) {
+        ASSERT_TRUE(writer.add(DAY + i * 60, valueAt(i)));
+        char line[32];
+        snprintf(line, sizeof(line), "%ld;%.2f\n", static_cast<long>(DAY + i * 60), valueAt(i));
+        text += line;
+    }
+    dayFileBlock_t last = *file.block(blocks - 1);
+    ASSERT_TRUE(writer.resume(file.header(), blocks, DayFile::isBlock(last) ? &last : nullptr));
+    file.flush(writer);
+    EXPECT_EQ(file.blocks(), blocks); // continued in the last block
+
+    DayFileReader reader(file.header(), DAY, file.reader());
+    EXPECT_EQ(readAll(reader, 333), text);
+
+    // another day or sensor is not resumed
+    DayFileWriter other;
+    other.begin(SERIAL, DAY + 24 * 3600 + 3600);
+    EXPECT_FALSE(other.resume(file.header(), blocks, nullptr));
+    other.begin(SERIAL + 1, DAY);
+    EXPECT_FALSE(other.resume(file.header(), blocks, nullptr));
+}
+
+TEST(DayFileTest, ResumeStartsANewBlockIfTheLastIsInvalid)
+{
+    CardFile file;
+    {
+        DayFileWriter writer;
+        writeDay(file, writer, 50);
+    }
+    const uint32_t blocks = file.blocks();
+
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY);
+    ASSERT_TRUE(writer.add(DAY + 60 * 60, 22.0f));
+    ASSERT_TRUE(writer.resume(file.header(), blocks, nullptr));
+    file.flush(writer);
+    EXPECT_EQ(file.blocks(), blocks + 1);
+
+    DayFileReader reader(file.header(), DAY + 60 * 60, file.reader());
+    char expected[32];
+    snprintf(expected, sizeof(expected), "%ld;22.00\n", static_cast<long>(DAY + 60 * 60));
+    EXPECT_EQ(readAll(reader, 512), expected);
+}
+
+TEST(DayFileTest, TornHeaderIsRebuiltFromTheBlocks)
+{
+    CardFile file;
+    std::string text;
+    {
+        DayFileWriter writer;
+        text = writeDay(file, writer, 5 * 60); // 5 hours
+    }
+    const dayFileHeader_t original = file.header();
+    file.bytes[20] ^= 0x5A; // an hour of the header
+    ASSERT_FALSE(DayFile::isHeader(file.header()));
+
+    dayFileHeader_t rebuilt;
+    DayFile::rebuildHeader(rebuilt, SERIAL, DAY + 3600, file.blocks(), file.reader());
+    EXPECT_EQ(memcmp(&rebuilt, &original, sizeof(rebuilt)), 0);
+
+    // the writer continues behind the blocks and rewrites the header
+    const uint32_t blocks = file.blocks();
+    DayFileWriter writer;
+    writer.begin(SERIAL, DAY + 5 * 3600);
+    ASSERT_TRUE(writer.add(DAY + 5 * 3600, 22.5f));
+    dayFileBlock_t last = *file.block(blocks - 1);
+    writer.rebuild(blocks, file.reader(), &last);
+    EXPECT_TRUE(writer.headerChanged());
+    file.flush(writer);
+    ASSERT_TRUE(DayFile::isHeader(file.header()));
+
+    char line[32];
+    snprintf(line, sizeof(line), "%ld;22.50\n", static_cast<long>(DAY + 5 * 3600));
+    DayFileReader reader(file.header(), DAY, file.reader());
+    EXPECT_EQ(readAll(reader, 512), text + line);
+}
+
+TEST(DayFileTest, ParseLine)
+{
+    time_t time;
+    float value;
+    ASSERT_TRUE(DayFile::parseLine("1700000000;-12.25\n", time, value));
+    EXPECT_EQ(time, 1700000000);
+    EXPECT_FLOAT_EQ(value, -12.25f);
+    EXPECT_FALSE(DayFile::parseLine("1700000000-12.25", time, value));
+    EXPECT_FALSE(DayFile::parseLine(";12", time, value));
+    EXPECT_FALSE(DayFile::parseLine("1700000000;\n", time, value));
+}
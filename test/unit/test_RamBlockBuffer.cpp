@@ -0,0 +1,205 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/Crc16.h"
+#include "Logger/RamBlockBuffer.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+static bool operator==(const dataEntry_t& a, const dataEntry_t& b)
+{
+    return a.serial == b.serial && a.time == b.time && a.value == b.value;
+}
+
+namespace {
+
+const time_t START = 1700000000;
+
+// the values are multiples of 1/16, so the Compact format stores them exactly
+class RamBlockBufferTest : public ::testing::TestWithParam<RamBufferFormat> {
+protected:
+    void SetUp() override
+    {
+        _memory.resize(64 * 1024);
+        _buffer = std::make_unique<RamBlockBuffer>(_memory.data(), _memory.size(), nullptr, 0, GetParam());
+        _buffer->PowerOnInitialize();
+    }
+
+    std::vector<dataEntry_t> write(size_t count, time_t start = START)
+    {
+        std::vector<dataEntry_t> written;
+        for (size_t i = 0; i < count; i++) {
+            dataEntry_t entry = { static_cast<uint16_t>(1 + i % 3), static_cast<time_t>(start + i * 20), 20.0f + (i % 40) * 0.25f };
+            _buffer->writeValue(entry.serial, entry.time, entry.value);
+            written.push_back(entry);
+        }
+        return written;
+    }
+
+    static std::vector<dataEntry_t> readAll(IRamBuffer& buffer)
+    {
+        std::vector<dataEntry_t> entries;
+        RamBufferSnapshot snapshot = buffer.getSnapshot();
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        while (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    std::vector<uint8_t> _memory;
+    std::unique_ptr<RamBlockBuffer> _buffer;
+};
+
+TEST_P(RamBlockBufferTest, ReadsOneSerialInOrder)
+{
+    auto written = write(1000);
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t count = 0;
+    while (_buffer->getEntry(3, START, cursor, entry)) {
+        ASSERT_EQ(entry, written[2 + count * 3]);
+        count++;
+    }
+    EXPECT_EQ(count, 333u);
+}
+
+TEST_P(RamBlockBufferTest, StartsAtTime)
+{
+    auto written = write(1000);
+    std::vector<dataEntry_t> entries;
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    while (_buffer->getEntry({ 1, 2, 3 }, written[700].time, cursor, entry)) {
+        entries.push_back(entry);
+    }
+    ASSERT_EQ(entries.size(), 300u);
+    EXPECT_EQ(entries.front(), written[700]);
+}
+
+TEST_P(RamBlockBufferTest, WrapKeepsNewestEntries)
+{
+    std::vector<dataEntry_t> written;
+    while (_buffer->getOldestTime() <= START && written.size() < 1000000) {
+        auto more = write(1000, START + written.size() * 20);
+        written.insert(written.end(), more.begin(), more.end());
+    }
+    ASSERT_GT(_buffer->getOldestTime(), START);
+    auto entries = readAll(*_buffer);
+    ASSERT_FALSE(entries.empty());
+    ASSERT_LT(entries.size(), written.size());
+    EXPECT_TRUE(std::equal(entries.begin(), entries.end(), written.end() - entries.size()));
+}
+
+TEST_P(RamBlockBufferTest, IntegrityCheckAfterRestart)
+{
+    auto written = write(3000);
+    _buffer->flushCache();
+
+    RamBlockBuffer restarted(_memory.data(), _memory.size(), nullptr, 0, GetParam());
+    ASSERT_TRUE(restarted.IntegrityCheck());
+    EXPECT_EQ(restarted.getErrorCount(), 0u);
+    EXPECT_EQ(readAll(restarted), written);
+
+    // an other format does not use the data
+    RamBufferFormat other = GetParam() == RamBufferFormat::Block ? RamBufferFormat::Compact : RamBufferFormat::Block;
+    RamBlockBuffer changed(_memory.data(), _memory.size(), nullptr, 0, other);
+    EXPECT_FALSE(changed.beginIntegrityCheck(true));
+}
+
+TEST_P(RamBlockBufferTest, IntegrityCheckStopsWhenFirstPassesVerified)
+{
+    size_t count = 0;
+    while (_buffer->getUsedBlocks() < _buffer->getTotalBlocks()) {
+        write(100, START + count * 20);
+        count += 100;
+    }
+    _buffer->flushCache();
+
+    RamBlockBuffer restarted(_memory.data(), _memory.size(), nullptr, 0, GetParam());
+    ASSERT_TRUE(restarted.beginIntegrityCheck(true));
+    EXPECT_EQ(restarted.continueIntegrityCheck(restarted.getTotalBlocks() - 3), IntegrityState::Verifying);
+
+    // the new blocks overwrite the 2 unverified ones and some verified
+    const size_t perBlock = count / restarted.getTotalBlocks();
+    for (size_t i = 0; i < 8 * perBlock; i++) {
+        restarted.writeValue(1 + i % 3, START + (count + i) * 20, 20.0f + (i % 40) * 0.25f);
+    }
+    EXPECT_EQ(restarted.continueIntegrityCheck(1), IntegrityState::Verified);
+}
+
+TEST_P(RamBlockBufferTest, BackupAndRestore)
+{
+    auto written = write(2500);
+    RamBufferSnapshot snapshot = _buffer->getSnapshot();
+    size_t size = _buffer->getBackupSize(snapshot);
+    std::vector<uint8_t> backup(size);
+    ASSERT_EQ(_buffer->readBackup(snapshot, 0, backup.data(), size), size);
+
+    std::vector<uint8_t> memory(_memory.size());
+    RamBlockBuffer restored(memory.data(), memory.size(), nullptr, 0, GetParam());
+    for (size_t offset = 0; offset < size; offset += 1000) {
+        size_t len = min<size_t>(1000, size - offset);
+        ASSERT_TRUE(restored.restoreBackup(offset, &backup[offset], len, offset + len == size));
+    }
+    EXPECT_EQ(readAll(restored), written);
+}
+
+TEST_P(RamBlockBufferTest, MergeIsNotSupported)
+{
+    dataEntry_t entry = { 1, START, 1.0f };
+    size_t merged;
+    EXPECT_FALSE(_buffer->mergeBatch(&entry, 1, merged));
+    EXPECT_EQ(merged, 0u);
+}
+
+TEST_P(RamBlockBufferTest, CursorContinuesQuery)
+{
+    auto written = write(2000);
+    std::vector<uint16_t> serials = { 2 };
+    time_t to = written.back().time + 1;
+
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    std::vector<dataEntry_t> pages;
+    while (pages.size() < 250 && _buffer->getEntry(serials, START, to, cursor, entry)) {
+        pages.push_back(entry);
+    }
+    uint32_t position, index;
+    _buffer->saveCursor(cursor, position, index);
+
+    RamBufferCursor restored;
+    ASSERT_TRUE(_buffer->restoreCursor(position, index, serials, restored));
+    while (_buffer->getEntry(serials, START, to, restored, entry)) {
+        pages.push_back(entry);
+    }
+    ASSERT_EQ(pages.size(), 667u);
+    for (size_t i = 0; i < pages.size(); i++) {
+        ASSERT_EQ(pages[i], written[1 + i * 3]);
+    }
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, RamBlockBufferTest,
+    ::testing::Values(RamBufferFormat::Block, RamBufferFormat::Compressed, RamBufferFormat::Compact),
+    [](const ::testing::TestParamInfo<RamBufferFormat>& info) {
+        return info.param == RamBufferFormat::Block ? "Block" : info.param == RamBufferFormat::Compressed ? "Compressed" : "Compact";
+    });
+
+}
+
+// the open blocks written with Calc before a firmware update keep a valid crc
+TEST(Crc16Test, UpdateMatchesCalc)
+{
+    std::vector<uint8_t> data(BLOCK_WORD_LENGTH);
+    for (size_t i = 0; i < data.size(); i++) {
+        data[i] = static_cast<uint8_t>(i * 37 + 11);
+    }
+    for (size_t len : { 0, 1, 2, 14, 100, static_cast<int>(BLOCK_WORD_LENGTH) }) {
+        EXPECT_EQ(Crc16::Update(0, data.data(), len), static_cast<uint16_t>(Crc16::Calc(data.data(), len))) << len;
+    }
+    EXPECT_EQ(Crc16::Update(Crc16::Update(0, data.data(), 100), &data[100], 139), Crc16::Update(0, data.data(), 239));
+}
@@ -0,0 +1,350 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/Crc16.h"
+#include "Logger/RamBuffer.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <vector>
+
+static bool operator==(const dataEntry_t& a, const dataEntry_t& b)
+{
+    return a.serial == b.serial && a.time == b.time && a.value == b.value;
+}
+
+namespace {
+
+const time_t START = 1700000000;
+
+class RamBufferTest : public ::testing::Test {
+protected:
+    void SetUp() override
+    {
+        _memory.resize(32 * 1024);
+        _buffer = std::make_unique<RamBuffer>(_memory.data(), _memory.size(), nullptr, 0);
+        _buffer->PowerOnInitialize();
+    }
+
+    // serials 1..3 every 20 seconds
+    std::vector<dataEntry_t> write(size_t count, time_t start = START)
+    {
+        std::vector<dataEntry_t> written;
+        for (size_t i = 0; i < count; i++) {
+            dataEntry_t entry = { static_cast<uint16_t>(1 + i % 3), static_cast<time_t>(start + i * 20), i * 0.25f };
+            _buffer->writeValue(entry.serial, entry.time, entry.value);
+            written.push_back(entry);
+        }
+        return written;
+    }
+
+    std::vector<dataEntry_t> read(const std::vector<uint16_t>& serials, time_t from, time_t to)
+    {
+        std::vector<dataEntry_t> entries;
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        while (_buffer->getEntry(serials, from, to, cursor, entry)) {
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    std::vector<dataEntry_t> readAll(IRamBuffer& buffer)
+    {
+        std::vector<dataEntry_t> entries;
+        RamBufferSnapshot snapshot = buffer.getSnapshot();
+        RamBufferCursor cursor;
+        dataEntry_t entry;
+        while (buffer.getSnapshotEntry(snapshot, cursor, entry)) {
+            entries.push_back(entry);
+        }
+        return entries;
+    }
+
+    std::vector<uint8_t> _memory;
+    std::unique_ptr<RamBuffer> _buffer;
+};
+
+TEST_F(RamBufferTest, EmptyBuffer)
+{
+    dataEntry_t entry;
+    RamBufferCursor cursor;
+    EXPECT_FALSE(_buffer->getEntry(1, START, cursor, entry));
+    EXPECT_EQ(_buffer->getUsedBytes(), 0u);
+    EXPECT_EQ(_buffer->getOldestTime(), 0);
+}
+
+TEST_F(RamBufferTest, ReadsOneSerialInOrder)
+{
+    auto written = write(300);
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t count = 0;
+    while (_buffer->getEntry(2, START, cursor, entry)) {
+        ASSERT_EQ(entry, written[1 + count * 3]);
+        count++;
+    }
+    EXPECT_EQ(count, 100u);
+}
+
+TEST_F(RamBufferTest, StartsAtTime)
+{
+    auto written = write(300);
+    auto entries = read({ 1, 2, 3 }, written[150].time, START + 24 * 60 * 60);
+    ASSERT_EQ(entries.size(), 150u);
+    EXPECT_EQ(entries.front(), written[150]);
+    EXPECT_EQ(entries.back(), written.back());
+}
+
+TEST_F(RamBufferTest, OneDayPerQueryUnlessRanged)
+{
+    // 3 days, one entry per hour
+    for (int i = 0; i < 72; i++) {
+        _buffer->writeValue(1, START + i * 3600, i);
+    }
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t count = 0;
+    while (_buffer->getEntry(1, START, cursor, entry)) {
+        count++;
+    }
+    EXPECT_EQ(count, 24u);
+    EXPECT_EQ(read({ 1 }, START, START + 72 * 3600).size(), 72u);
+    EXPECT_EQ(read({ 1 }, START + 3600, START + 5 * 3600).size(), 4u); // to is excluded
+}
+
+TEST_F(RamBufferTest, WrapKeepsNewestEntries)
+{
+    size_t capacity = _buffer->getTotalElements();
+    auto written = write(capacity + 100);
+    auto entries = readAll(*_buffer);
+    ASSERT_EQ(entries.size(), capacity);
+    EXPECT_EQ(entries.front(), written[100]);
+    EXPECT_EQ(entries.back(), written.back());
+    EXPECT_EQ(_buffer->getOldestTime(), written[100].time);
+}
+
+TEST_F(RamBufferTest, IntegrityCheckAfterRestart)
+{
+    auto written = write(500);
+    _buffer->flushCache();
+
+    RamBuffer restarted(_memory.data(), _memory.size(), nullptr, 0);
+    ASSERT_TRUE(restarted.IntegrityCheck());
+    EXPECT_EQ(restarted.getErrorCount(), 0u);
+    EXPECT_EQ(restarted.getRebootCount(), 1u);
+    EXPECT_EQ(readAll(restarted), written);
+}
+
+TEST_F(RamBufferTest, IntegrityCheckFindsCorruptedEntry)
+{
+    write(500);
+    _buffer->flushCache();
+
+    // value of the entry in the middle
+    dataEntryFEC_t* entries = reinterpret_cast<dataEntryFEC_t*>(_memory.data() + sizeof(dataEntryHeader_t));
+    reinterpret_cast<uint8_t*>(&entries[250].entry.value)[1] ^= 0x10;
+
+    RamBuffer restarted(_memory.data(), _memory.size(), nullptr, 0);
+    ASSERT_TRUE(restarted.IntegrityCheck());
+    auto after = readAll(restarted);
+#ifdef LOGGER_HOST_RS_STANDIN
+    EXPECT_EQ(restarted.getErrorCount(), 1u); // detected and skipped
+    EXPECT_EQ(after.size(), 499u);
+#else
+    EXPECT_EQ(after.size(), 500u); // corrected
+#endif
+}
+
+TEST_F(RamBufferTest, CorruptedHeaderIsRejected)
+{
+    write(10);
+    _buffer->flushCache();
+    memset(_memory.data(), 0xA5, 64); // more than the ecc can correct
+
+    RamBuffer restarted(_memory.data(), _memory.size(), nullptr, 0);
+    EXPECT_FALSE(restarted.beginIntegrityCheck(true));
+}
+
+TEST_F(RamBufferTest, MisalignedCommitIsRejected)
+{
+    write(10);
+    _buffer->flushCache();
+
+    // last of both commits points into an entry and the crc fits, e.g. after a wrong correction
+    dataEntryHeader_t* header = reinterpret_cast<dataEntryHeader_t*>(_memory.data());
+    for (dataEntryCommit_t& commit : header->commit) {
+        commit.last = reinterpret_cast<dataEntryFEC_t*>(reinterpret_cast<uint8_t*>(commit.last) + 6);
+        commit.crc = Crc16::Calc(reinterpret_cast<uint8_t*>(&commit), offsetof(dataEntryCommit_t, crc));
+    }
+
+    RamBuffer restarted(_memory.data(), _memory.size(), nullptr, 0);
+    ASSERT_TRUE(restarted.IntegrityCheck()); // first and last of the header ecc
+    EXPECT_EQ((reinterpret_cast<uint8_t*>(header->last) - reinterpret_cast<uint8_t*>(header->start)) % sizeof(dataEntryFEC_t), 0u);
+}
+
+TEST_F(RamBufferTest, IntegrityCheckStopsWhenFirstPassesVerified)
+{
+    size_t capacity = _buffer->getTotalElements();
+    write(capacity + 10);
+    _buffer->flushCache();
+
+    RamBuffer restarted(_memory.data(), _memory.size(), nullptr, 0);
+    ASSERT_TRUE(restarted.beginIntegrityCheck(true));
+    EXPECT_EQ(restarted.continueIntegrityCheck(capacity - 5), IntegrityState::Verifying);
+
+    // the new entries overwrite the 5 unverified ones and some verified
+    for (int i = 0; i < 20; i++) {
+        restarted.writeValue(1, START + 100000 + i * 20, i);
+    }
+    EXPECT_EQ(restarted.continueIntegrityCheck(1), IntegrityState::Verified);
+}
+
+TEST_F(RamBufferTest, CorruptedLinkDoesNotLeaveTheRing)
+{
+    const size_t elements = _buffer->getTotalElements() + 1;
+    write(_buffer->getTotalElements() + 10);
+
+    dataEntryHeader_t* header = reinterpret_cast<dataEntryHeader_t*>(_memory.data());
+    dataEntryLink_t* links = reinterpret_cast<dataEntryLink_t*>(_memory.data() + sizeof(dataEntryHeader_t) + elements * sizeof(dataEntryFEC_t));
+    auto index = [&](const dataEntryFEC_t* fec) { return static_cast<size_t>(fec - header->start); };
+    auto serialAt = [&](size_t i) { return header->start[i % elements].entry.serial; };
+
+    // the newest entry of serial 1 links over last to the oldest one, another entry of serial 1 links backwards
+    size_t newest = (index(header->last) + elements - 1) % elements;
+    while (serialAt(newest) != 1) {
+        newest = (newest + elements - 1) % elements;
+    }
+    size_t oldest = index(header->first);
+    while (serialAt(oldest) != 1) {
+        oldest = (oldest + 1) % elements;
+    }
+    links[newest] = static_cast<dataEntryLink_t>((oldest + elements - newest) % elements);
+    size_t middle = (newest + elements / 2) % elements;
+    while (serialAt(middle) != 1) {
+        middle = (middle + 1) % elements;
+    }
+    links[middle] = static_cast<dataEntryLink_t>(elements - 3);
+
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    size_t count = 0;
+    time_t time = 0;
+    while (_buffer->getEntry(1, START, cursor, entry) && count <= elements) {
+        EXPECT_GE(entry.time, time);
+        time = entry.time;
+        count++;
+    }
+    EXPECT_EQ(count, read({ 1 }, START, START + 24 * 60 * 60).size());
+    EXPECT_LE(count, elements / 3 + 1);
+}
+
+TEST_F(RamBufferTest, BackupAndRestore)
+{
+    auto written = write(700);
+    RamBufferSnapshot snapshot = _buffer->getSnapshot();
+    size_t size = _buffer->getBackupSize(snapshot);
+    std::vector<uint8_t> backup(size);
+    for (size_t offset = 0; offset < size; offset += 100) {
+        ASSERT_EQ(_buffer->readBackup(snapshot, offset, &backup[offset], min<size_t>(100, size - offset)), min<size_t>(100, size - offset));
+    }
+
+    std::vector<uint8_t> memory(_memory.size());
+    RamBuffer restored(memory.data(), memory.size(), nullptr, 0);
+    for (size_t offset = 0; offset < size; offset += 333) {
+        size_t len = min<size_t>(333, size - offset);
+        ASSERT_TRUE(restored.restoreBackup(offset, &backup[offset], len, offset + len == size));
+    }
+    EXPECT_EQ(readAll(restored), written);
+}
+
+TEST_F(RamBufferTest, SnapshotIsInvalidAfterOverwrite)
+{
+    write(10);
+    RamBufferSnapshot snapshot = _buffer->getSnapshot();
+    EXPECT_TRUE(_buffer->isSnapshotValid(snapshot));
+    write(_buffer->getTotalElements(), START + 1000);
+    EXPECT_FALSE(_buffer->isSnapshotValid(snapshot));
+}
+
+TEST_F(RamBufferTest, MergeInsertsByTime)
+{
+    auto written = write(100, START + 1000);
+    std::vector<dataEntry_t> older;
+    for (int i = 0; i < 50; i++) {
+        older.push_back({ 4, static_cast<time_t>(START + i * 10), 1.0f });
+    }
+    // identical entries are skipped
+    older.push_back(written[10]);
+
+    size_t merged;
+    ASSERT_TRUE(_buffer->mergeBatch(older.data(), older.size(), merged));
+    EXPECT_EQ(merged, 50u);
+
+    auto entries = readAll(*_buffer);
+    ASSERT_EQ(entries.size(), 150u);
+    EXPECT_TRUE(std::is_sorted(entries.begin(), entries.end(), [](const dataEntry_t& a, const dataEntry_t& b) { return a.time < b.time; }));
+    EXPECT_EQ(read({ 4 }, START, START + 24 * 60 * 60).size(), 50u);
+    EXPECT_TRUE(_buffer->IntegrityCheck());
+}
+
+TEST_F(RamBufferTest, MergeInStepsKeepsLinks)
+{
+    // the links of every serial must match the stored order, also after wrapping and with new values afterwards
+    write(600, START + 10000);
+    for (int batchNo = 0; batchNo < 3; batchNo++) {
+        std::vector<dataEntry_t> older;
+        for (int i = 0; i < 300; i++) {
+            older.push_back({ static_cast<uint16_t>(i % 7 == 0 ? 4 : 2), static_cast<time_t>(START + 3000 * batchNo + i * 20 + 5), static_cast<float>(i) });
+        }
+        ASSERT_TRUE(_buffer->beginMerge(older.data(), older.size()));
+        size_t merged = 0;
+        while (!_buffer->continueMerge(7, merged)) { }
+        EXPECT_EQ(merged, 300u);
+    }
+    write(50, START + 30000);
+
+    auto all = readAll(*_buffer);
+    ASSERT_EQ(all.size(), _buffer->getTotalElements());
+    EXPECT_TRUE(std::is_sorted(all.begin(), all.end(), [](const dataEntry_t& a, const dataEntry_t& b) { return a.time < b.time; }));
+    for (uint16_t serial = 1; serial <= 4; serial++) {
+        std::vector<dataEntry_t> expected;
+        std::copy_if(all.begin(), all.end(), std::back_inserter(expected), [serial](const dataEntry_t& e) { return e.serial == serial; });
+        EXPECT_EQ(read({ serial }, START, START + 24 * 60 * 60), expected) << serial;
+    }
+}
+
+TEST_F(RamBufferTest, CursorContinuesQuery)
+{
+    auto written = write(300);
+    std::vector<uint16_t> serials = { 1, 3 };
+    auto all = read(serials, START, START + 24 * 60 * 60);
+
+    RamBufferCursor cursor;
+    dataEntry_t entry;
+    std::vector<dataEntry_t> pages;
+    for (int i = 0; i < 10 && _buffer->getEntry(serials, START, START + 24 * 60 * 60, cursor, entry); i++) {
+        pages.push_back(entry);
+    }
+    uint32_t position, index;
+    _buffer->saveCursor(cursor, position, index);
+
+    write(5, written.back().time + 20); // appended meanwhile
+    RamBufferCursor restored;
+    ASSERT_TRUE(_buffer->restoreCursor(position, index, serials, restored));
+    while (_buffer->getEntry(serials, START, written.back().time + 1, restored, entry)) {
+        pages.push_back(entry);
+    }
+    EXPECT_EQ(pages, all);
+
+    // a cursor of other serials
+    EXPECT_FALSE(_buffer->restoreCursor(position, index, { 2 }, restored));
+    EXPECT_FALSE(_buffer->restoreCursor(position, 1, serials, restored));
+
+    // overwritten
+    write(_buffer->getTotalElements(), START + 100000);
+    EXPECT_FALSE(_buffer->restoreCursor(position, index, serials, restored));
+}
+
+}
@@ -0,0 +1,336 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "HostShim.h"
+#include "Logger/RamDrive.h"
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace {
+
+const time_t START = 1700000000;
+
+std::string readAll(ResponseFiller& filler, size_t chunk = 512)
+{
+    std::string data;
+    std::vector<uint8_t> buffer(chunk);
+    size_t len;
+    while ((len = filler(buffer.data(), buffer.size(), data.size())) > 0) {
+        data.append(reinterpret_cast<char*>(buffer.data()), len);
+    }
+    return data;
+}
+
+// text response without the padding of the chunks
+std::vector<std::string> lines(const std::string& data)
+{
+    std::vector<std::string> result;
+    size_t pos = 0;
+    while (pos < data.size()) {
+        size_t end = data.find('\n', pos);
+        std::string line = data.substr(pos, end - pos);
+        pos = end == std::string::npos ? data.size() : end + 1;
+        if (line.find_first_not_of(' ') != std::string::npos) {
+            result.push_back(line);
+        }
+    }
+    return result;
+}
+
+class RamDriveTest : public ::testing::TestWithParam<RamBufferFormat> {
+protected:
+    static void SetUpTestSuite()
+    {
+        HostShim::setPsramSize(256 * 1024);
+        RamDriveClass::AllocateRamDrive();
+    }
+
+    static void TearDownTestSuite()
+    {
+        RamDriveClass::FreeRamDrive();
+        HostShim::setPsramSize(0);
+    }
+
+    void SetUp() override
+    {
+        _drive = std::make_unique<RamDriveClass>(GetParam());
+        _drive->init(_scheduler);
+        for (int i = 0; i < 1000 && _drive->getVerifyProgress() < 100; i++) {
+            _scheduler.execute();
+        }
+
+        // the PSRAM keeps the data of the last test, an empty backup clears it
+        BackupStreamEncoder encoder;
+        uint8_t empty[32];
+        encoder.begin(empty, sizeof(empty));
+        encoder.finish();
+        ASSERT_TRUE(_drive->restoreBackup(0, empty, encoder.end(), true));
+        ASSERT_EQ(_drive->getOldestTime(), 0);
+        runTasks();
+    }
+
+    // verify and the rebuild of the tiles
+    void runTasks()
+    {
+        for (int i = 0; i < 1000; i++) {
+            _scheduler.execute();
+        }
+    }
+
+    // new snapshot: pending until _countTask has counted its size
+    std::string compressedBackup(BackupRange& range)
+    {
+        range.compressed = true;
+        ResponseFiller filler;
+        if (!_drive->getBackup(range, filler)) {
+            EXPECT_TRUE(range.pending);
+            runTasks();
+            range.pending = false;
+            EXPECT_TRUE(_drive->getBackup(range, filler));
+        }
+        return filler ? readAll(filler) : std::string();
+    }
+
+    std::vector<std::string> tiles(uint16_t serial, time_t hour)
+    {
+        ResponseFiller filler;
+        if (!_drive->getTileFile({ serial }, hour, 3 * 60 * 60, 3600, GraphDataFormat::Text, filler)) {
+            return { "no tiles" };
+        }
+        return lines(readAll(filler));
+    }
+
+    // serials 1..3 every 10 minutes
+    std::vector<std::string> write(size_t count)
+    {
+        std::vector<std::string> expected;
+        for (size_t i = 0; i < count; i++) {
+            uint16_t serial = 1 + i % 3;
+            time_t time = START + i * 600;
+            float value = 20.0f + (i % 16) * 0.25f;
+            _drive->writeValue(serial, time, value);
+            if (serial != 3) {
+                char line[40];
+                snprintf(line, sizeof(line), "%x;%ld;%.2f", serial, static_cast<long>(time), value);
+                expected.push_back(line);
+            }
+        }
+        return expected;
+    }
+
+    Scheduler _scheduler;
+    std::unique_ptr<RamDriveClass> _drive;
+};
+
+TEST_P(RamDriveTest, GetFileOverSeveralDays)
+{
+    auto expected = write(1500); // about 10 days
+    ResponseFiller filler;
+    ASSERT_TRUE(_drive->getFile({ 1, 2 }, START, 11 * 24 * 60 * 60, 0, GraphDataFormat::Text, filler));
+    EXPECT_EQ(lines(readAll(filler)), expected);
+}
+
+TEST_P(RamDriveTest, GetFileWithMaxPoints)
+{
+    write(1500);
+    ResponseFiller filler;
+    ASSERT_TRUE(_drive->getFile({ 1 }, START, 11 * 24 * 60 * 60, 50, GraphDataFormat::Text, filler));
+    size_t count = lines(readAll(filler)).size();
+    EXPECT_GT(count, 0u);
+    EXPECT_LE(count, 50u);
+}
+
+TEST_P(RamDriveTest, RangeInPages)
+{
+    auto expected = write(1500);
+    for (uint32_t limit : { 1u, 17u, 400u }) {
+        RangeQuery range;
+        range.serials = { 1, 2 };
+        range.from = START;
+        range.to = START + 11 * 24 * 60 * 60;
+        range.limit = limit;
+        std::vector<std::string> result;
+        do {
+            ResponseFiller filler;
+            ASSERT_TRUE(_drive->getRange(range, GraphDataFormat::Text, filler));
+            auto page = lines(readAll(filler));
+            ASSERT_LE(page.size(), limit);
+            result.insert(result.end(), page.begin(), page.end());
+        } while (!range.cursor.isEmpty());
+        EXPECT_EQ(result, expected) << "limit " << limit;
+    }
+
+    RangeQuery invalid;
+    invalid.serials = { 1 };
+    invalid.from = START;
+    invalid.to = START + 1000;
+    invalid.cursor = "no cursor";
+    ResponseFiller filler;
+    EXPECT_FALSE(_drive->getRange(invalid, GraphDataFormat::Text, filler));
+}
+
+TEST_P(RamDriveTest, CompressedBackupAndRestore)
+{
+    auto expected = write(1000);
+    BackupRange range;
+    range.compressed = true;
+    ResponseFiller filler;
+    ASSERT_FALSE(_drive->getBackup(range, filler));
+    ASSERT_TRUE(range.pending);
+    ASSERT_FALSE(range.snapshot.isEmpty());
+    runTasks();
+    range.pending = false;
+    ASSERT_TRUE(_drive->getBackup(range, filler));
+    std::string backup = readAll(filler, 1000);
+    EXPECT_EQ(backup.size(), range.total);
+
+    // second part of the same snapshot
+    BackupRange part;
+    part.compressed = true;
+    part.snapshot = range.snapshot;
+    part.offset = backup.size() / 2;
+    ASSERT_TRUE(_drive->getBackup(part, filler));
+    EXPECT_EQ(readAll(filler, 700), backup.substr(part.offset));
+
+    write(10);
+    const uint8_t* data = reinterpret_cast<const uint8_t*>(backup.data());
+    for (size_t offset = 0; offset < backup.size(); offset += 256) {
+        size_t len = min<size_t>(256, backup.size() - offset);
+        ASSERT_TRUE(_drive->restoreBackup(offset, data + offset, len, offset + len == backup.size()));
+    }
+    ASSERT_TRUE(_drive->getFile({ 1, 2 }, START, 11 * 24 * 60 * 60, 0, GraphDataFormat::Text, filler));
+    EXPECT_EQ(lines(readAll(filler)), expected);
+}
+
+TEST_P(RamDriveTest, BackupSizeCountedInSteps)
+{
+    // a full RamDrive, the backup is larger than RAMDRIVE_COUNT_BYTES
+    for (size_t i = 0; i < 40000; i++) {
+        _drive->writeValue(1 + i % 30, START + i * 20, (i * 7919 % 4000) / 16.0f);
+    }
+    BackupRange range;
+    std::string backup = compressedBackup(range);
+    EXPECT_GT(backup.size(), RAMDRIVE_COUNT_BYTES);
+    EXPECT_EQ(backup.size(), range.total);
+
+    // overwritten while counting
+    _drive->writeValue(1, START + 900000, 1.0f);
+    BackupRange overwritten;
+    overwritten.compressed = true;
+    ResponseFiller filler;
+    ASSERT_FALSE(_drive->getBackup(overwritten, filler));
+    for (size_t i = 0; i < 40000; i++) {
+        _drive->writeValue(1 + i % 30, START + 1000000 + i * 20, (i * 7919 % 4000) / 16.0f);
+    }
+    runTasks();
+    overwritten.pending = false;
+    EXPECT_FALSE(_drive->getBackup(overwritten, filler));
+    EXPECT_FALSE(overwritten.pending);
+}
+
+TEST_P(RamDriveTest, MergeBackup)
+{
+    auto expected = write(300);
+    BackupRange range;
+    std::string backup = compressedBackup(range);
+    ResponseFiller filler;
+
+    // the same data again adds nothing, only the default format supports it
+    bool supported = _drive->mergeBackup(0, reinterpret_cast<const uint8_t*>(backup.data()), backup.size(), true);
+    EXPECT_EQ(supported, GetParam() == RamBufferFormat::Entry);
+    ASSERT_TRUE(_drive->getFile({ 1, 2 }, START, 11 * 24 * 60 * 60, 0, GraphDataFormat::Text, filler));
+    EXPECT_EQ(lines(readAll(filler)), expected);
+}
+
+TEST_P(RamDriveTest, Tiles)
+{
+    // one value per minute for 3 hours
+    const time_t hour = START - START % 3600;
+    const uint16_t serial = 7 + static_cast<uint16_t>(GetParam());
+    for (int i = 0; i < 180; i++) {
+        _drive->writeValue(serial, hour + i * 60, i % 2 ? 10.0f : 20.0f);
+    }
+    auto result = tiles(serial, hour);
+    ASSERT_FALSE(result.empty());
+    EXPECT_LE(result.size(), 4u);
+    EXPECT_NE(result[0].find(";15.00;10.00;20.00"), std::string::npos) << result[0];
+}
+
+TEST_P(RamDriveTest, TilesOfSeveralSensors)
+{
+    // one value per minute for 3 hours, sensor 3 writes the values of the last 10 minutes late (unchanged values)
+    const time_t hour = START - START % 3600;
+    for (int i = 0; i < 180; i++) {
+        _drive->writeValue(1, hour + i * 60, 10.0f);
+        _drive->writeValue(2, hour + i * 60, 20.0f);
+        if (i < 170) {
+            _drive->writeValue(3, hour + i * 60, 30.0f);
+        }
+    }
+    for (int i = 170; i < 180; i++) {
+        _drive->writeValue(3, hour + i * 60, 30.0f);
+    }
+
+    // the 1 minute tiles of the small TileIndex do not reach back 3 hours: the entries are used instead
+    ResponseFiller filler;
+    EXPECT_FALSE(_drive->getTileFile({ 1, 2, 3 }, hour, 3 * 60 * 60, 60, GraphDataFormat::Text, filler));
+
+    ASSERT_TRUE(_drive->getTileFile({ 1, 2, 3 }, hour + 160 * 60, 20 * 60 - 1, 60, GraphDataFormat::Text, filler));
+    auto result = lines(readAll(filler));
+    ASSERT_EQ(result.size(), 60u);
+    long last = 0;
+    int count[3] = {};
+    for (const auto& line : result) {
+        unsigned serial;
+        long time;
+        ASSERT_EQ(sscanf(line.c_str(), "%x;%ld;", &serial, &time), 2) << line;
+        ASSERT_TRUE(serial >= 1 && serial <= 3) << line;
+        EXPECT_GE(time, last) << line; // ordered by time over all sensors
+        last = time;
+        count[serial - 1]++;
+    }
+    EXPECT_EQ(count[0], 20);
+    EXPECT_EQ(count[1], 20);
+    EXPECT_EQ(count[2], 20);
+}
+
+TEST_P(RamDriveTest, RestoreRebuildsTiles)
+{
+    const time_t hour = START - START % 3600;
+    for (int i = 0; i < 180; i++) {
+        _drive->writeValue(1, hour + i * 60, 20.0f);
+    }
+    BackupRange range;
+    std::string backup = compressedBackup(range);
+
+    // other values of the same hours, replaced by the backup
+    for (int i = 0; i < 180; i++) {
+        _drive->writeValue(2, hour + i * 60, 30.0f);
+    }
+    ASSERT_TRUE(_drive->restoreBackup(0, reinterpret_cast<const uint8_t*>(backup.data()), backup.size(), true));
+    EXPECT_EQ(tiles(1, hour), std::vector<std::string> { "no tiles" }); // entries until the rebuild has finished
+    runTasks();
+    EXPECT_FALSE(tiles(1, hour).empty());
+    EXPECT_TRUE(tiles(2, hour).empty());
+}
+
+INSTANTIATE_TEST_SUITE_P(Formats, RamDriveTest,
+    ::testing::Values(RamBufferFormat::Entry, RamBufferFormat::Block, RamBufferFormat::Compressed, RamBufferFormat::Compact),
+    [](const ::testing::TestParamInfo<RamBufferFormat>& info) {
+        switch (info.param) {
+        case RamBufferFormat::Entry:
+            return "Entry";
+        case RamBufferFormat::Block:
+            return "Block";
+        case RamBufferFormat::Compressed:
+            return "Compressed";
+        default:
+            return "Compact";
+        }
+    });
+
+}
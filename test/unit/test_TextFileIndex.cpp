@@ -0,0 +1,161 @@
+// SPDX-License-Identifier: GPL-2.0-or-later
+/*
+ * Copyright (C) 2024 Sebastian Hinz
+ */
+
+#include "Logger/TextFileIndex.h"
+#include <gtest/gtest.h>
+#include <string>
+
+namespace {
+
+const time_t DAY = 1699920000; // 2023-11-14 00:00 UTC
+const uint32_t FILE_KEY = 0x2800;
+
+// a day file like SDCardClass writes it, one line every interval seconds
+std::string dayFile(int lines, int interval)
+{
+    std::string text;
+    char line[32];
+    for (int i = 0; i < lines; i++) {
+        snprintf(line, sizeof(line), "%ld;%.2f\n", static_cast<long>(DAY + i * interval), -5.0f + (i % 4000) / 100.0f);
+        text += line;
+    }
+    return text;
+}
+
+TextFileIndex::Reader reader(const std::string& text)
+{
+    return [&text](size_t position, uint8_t* buffer, size_t len) -> size_t {
+        if (position >= text.size()) {
+            return 0;
+        }
+        len = std::min(len, text.size() - position);
+        memcpy(buffer, &text[position], len);
+        return len;
+    };
+}
+
+// start of the first line with a time >= start, like the sequential search of getFile
+size_t firstLine(const std::string& text, time_t start)
+{
+    for (size_t pos = 0; pos < text.size(); pos = text.find('\n', pos) + 1) {
+        if (atol(&text[pos]) >= start) {
+            return pos;
+        }
+    }
+    return text.size();
+}
+
+void expectBefore(const std::string& text, size_t position, time_t start, bool near = true)
+{
+    size_t expected = firstLine(text, start);
+    EXPECT_TRUE(position == 0 || text[position - 1] == '\n') << "not a line start: " << position;
+    EXPECT_LE(position, expected) << start;
+    if (near) {
+        EXPECT_LE(expected - position, TEXTFILE_SCAN + 32u) << start;
+    }
+}
+
+} // namespace
+
+TEST(TextFileIndexTest, FindsTheLineBeforeStart)
+{
+    const std::string text = dayFile(8640, 10); // 10 s, ~150 kB
+    for (time_t start : { DAY - 100, DAY, DAY + 5, DAY + 3600, DAY + 12 * 3600 + 7, DAY + 86380, DAY + 86400, DAY + 200000 }) {
+        TextFileIndex index;
+        size_t position = index.find(FILE_KEY, text.size(), start, reader(text));
+        expectBefore(text, position, start);
+        EXPECT_LE(index.getProbes(), 20u) << start; // log2(150 kB / 512) + the first line
+    }
+}
+
+TEST(TextFileIndexTest, StartBeforeTheFirstLineNeedsOneRead)
+{
+    const std::string text = dayFile(1000, 60);
+    TextFileIndex index;
+    EXPECT_EQ(index.find(FILE_KEY, text.size(), DAY, reader(text)), 0u);
+    EXPECT_EQ(index.getProbes(), 1u);
+}
+
+TEST(TextFileIndexTest, CachedPointsShortenTheNextSearch)
+{
+    const std::string text = dayFile(8640, 10);
+    TextFileIndex index;
+    const time_t start = DAY + 15 * 3600;
+    expectBefore(text, index.find(FILE_KEY, text.size(), start, reader(text)), start);
+    uint32_t first = index.getProbes();
+
+    // the same start again: the cached points enclose it
+    expectBefore(text, index.find(FILE_KEY, text.size(), start, reader(text)), start);
+    EXPECT_EQ(index.getProbes(), first);
+
+    // another start of the same file
+    uint32_t before = index.getProbes();
+    expectBefore(text, index.find(FILE_KEY, text.size(), start + 600, reader(text)), start + 600);
+    EXPECT_LT(index.getProbes() - before, first);
+}
+
+TEST(TextFileIndexTest, AppendedLinesAreFound)
+{
+    std::string text = dayFile(4000, 10);
+    TextFileIndex index;
+    index.find(FILE_KEY, text.size(), DAY + 20000, reader(text));
+
+    text = dayFile(8000, 10); // the same lines and more
+    for (time_t start : { DAY + 20000, DAY + 39000, DAY + 79990 }) {
+        expectBefore(text, index.find(FILE_KEY, text.size(), start, reader(text)), start);
+    }
+}
+
+TEST(TextFileIndexTest, ReplacedFileIsSearchedAgain)
+{
+    std::string text = dayFile(8000, 10);
+    TextFileIndex index;
+    index.find(FILE_KEY, text.size(), DAY + 70000, reader(text));
+
+    text = dayFile(500, 60); // shorter than the cached positions
+    expectBefore(text, index.find(FILE_KEY, text.size(), DAY + 20000, reader(text)), DAY + 20000);
+}
+
+TEST(TextFileIndexTest, LongLinesAndIncompleteEnd)
+{
+    // lines longer than a probe stop the search, a line without its end
+    std::string text;
+    for (int i = 0; i < 400; i++) {
+        text += std::to_string(DAY + i * 60) + ";" + std::string(i % 3 == 0 ? 60 : 5, '1') + "\n";
+    }
+    text += std::to_string(DAY + 400 * 60) + ";2";
+    for (time_t start : { DAY + 60, DAY + 100 * 60 + 1, DAY + 399 * 60, DAY + 400 * 60 }) {
+        TextFileIndex index;
+        expectBefore(text, index.find(FILE_KEY, text.size(), start, reader(text)), start, false);
+    }
+
+    TextFileIndex index;
+    EXPECT_EQ(index.find(FILE_KEY, 0, DAY, reader(std::string())), 0u);
+}
+
+TEST(TextFileIndexTest, LeastRecentlyUsedFileIsDropped)
+{
+    const std::string text = dayFile(8640, 10);
+    TextFileIndex index;
+    const time_t start = DAY + 10 * 3600;
+    for (uint32_t file = 0; file <= TEXTFILE_INDEX_FILES; file++) {
+        index.find(file, text.size(), start, reader(text));
+    }
+
+    // file 0 was dropped, the others are cached
+    uint32_t before = index.getProbes();
+    index.find(TEXTFILE_INDEX_FILES, text.size(), start, reader(text));
+    EXPECT_EQ(index.getProbes(), before);
+    index.find(0, text.size(), start, reader(text));
+    EXPECT_GT(index.getProbes(), before);
+}
+
+TEST(TextFileIndexTest, FileKeyIsTheLocalDay)
+{
+    const time_t noon = DAY + 12 * 3600; // the same local day for the usual TZ
+    EXPECT_EQ(TextFileIndex::fileKey(0x2800, noon), TextFileIndex::fileKey(0x2800, noon + 3600));
+    EXPECT_NE(TextFileIndex::fileKey(0x2800, noon), TextFileIndex::fileKey(0x2801, noon));
+    EXPECT_NE(TextFileIndex::fileKey(0x2800, noon), TextFileIndex::fileKey(0x2800, noon + 86400));
+}
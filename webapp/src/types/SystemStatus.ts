@@ -45,6 +45,7 @@ export interface SystemStatus {
     ramdrive_oldest: number;
     ramdrive_reboot: number;
     ramdrive_error: number;
+    ramdrive_verify: number;
     // RadioInfo
     nrf_configured: boolean;
     nrf_connected: boolean;
@@ -149,3 +149,15 @@ export function handleBinaryResponse(
         return data;
     });
 }
+
+export function handleArrayBufferResponse(
+    response: Response,
+    emitter: Emitter<Record<EventType, unknown>>,
+    router: Router,
+    ignore_error: boolean = false
+) {
+    if (response.ok) {
+        return response.arrayBuffer();
+    }
+    return handleBinaryResponse(response, emitter, router, ignore_error).then(() => new ArrayBuffer(0));
+}